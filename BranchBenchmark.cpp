@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+    - Times one program's builds (uninstrumented and one per instrumentation variant) and
+      prints the results as a JSON object on stdout; branch_history_benchmark.sh builds the
+      variants and collects the objects of all programs into one file.
+    - Every build runs with "<size> <seed>" as arguments for each size, TRIALS times, the
+      variants interleaved within a trial so that machine drift hits them alike. Runs go
+      in the current directory with BRANCH_HISTORY_STATS=1, whose report gives the events
+      and trace bytes of the run.
+    - Per variant and size it reports the trial times, their median, the slowdown against
+      the uninstrumented build's median, events per second of the whole run, trace bytes
+      per event and peak RSS.
+    - Usage: BranchBenchmark [--trials N] [--sizes N,N,...] [--seed N] --program NAME
+                             --native EXE [VARIANT=EXE ...]
+*/
+
+namespace {
+  struct Variant {
+    std::string name;
+    std::string exe;
+  };
+
+  struct Run {
+    double seconds;
+    long maxRssKb;
+    uint64_t events;
+    uint64_t traceBytes;
+    bool ok;
+  };
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0
+              << " [--trials N] [--sizes N,N,...] [--seed N] --program NAME --native EXE [VARIANT=EXE ...]"
+              << std::endl;
+  }
+
+  uint64_t statValue(const std::string &report, const char *key) {
+    std::string text = "\n" + report, prefix = std::string("\n") + key + "=";
+    size_t at = text.find(prefix);
+    return at == std::string::npos ? 0 : std::strtoull(text.c_str() + at + prefix.size(), nullptr, 10);
+  }
+
+  // Runs exe with its output discarded and its runtime report captured from stderr
+  Run runOnce(const Variant &V, const std::string &program, uint64_t size, uint64_t seed) {
+    Run run = {0, 0, 0, 0, false};
+    int report[2];
+    if (pipe(report) != 0) return run;
+    std::string sizeArg = std::to_string(size), seedArg = std::to_string(seed);
+    std::string programName = program + "_" + V.name;
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+      int devNull = open("/dev/null", O_WRONLY);
+      dup2(devNull, STDOUT_FILENO);
+      dup2(report[1], STDERR_FILENO);
+      close(report[0]);
+      setenv("BRANCH_HISTORY_STATS", "1", 1);
+      setenv("PROGRAM_NAME", programName.c_str(), 1);
+      execl(V.exe.c_str(), V.exe.c_str(), sizeArg.c_str(), seedArg.c_str(), (char *)nullptr);
+      _exit(127);
+    }
+    close(report[1]);
+    if (pid < 0) {
+      close(report[0]);
+      return run;
+    }
+    std::string text;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(report[0], buf, sizeof(buf))) > 0) text.append(buf, size_t(n));
+    close(report[0]);
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) return run;
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    run.maxRssKb = usage.ru_maxrss;
+    run.events = statValue(text, "events");
+    run.traceBytes = statValue(text, "bytes_written");
+    run.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return run;
+  }
+
+  double median(std::vector<double> values) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+  }
+
+  std::string number(double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6g", value);
+    return buf;
+  }
+
+  std::string quoted(const std::string &text) {
+    std::string out = "\"";
+    for (char c : text) {
+      if (c == '"' || c == '\\') out += '\\';
+      out += c;
+    }
+    return out + "\"";
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned trials = 5;
+  uint64_t seed = 1;
+  std::vector<uint64_t> sizes;
+  std::string program;
+  std::vector<Variant> variants;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--trials" && i + 1 < argc) {
+      trials = unsigned(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--sizes" && i + 1 < argc) {
+      for (const char *p = argv[++i]; *p;) {
+        char *end;
+        sizes.push_back(std::strtoull(p, &end, 10));
+        p = *end == ',' ? end + 1 : end + std::strlen(end);
+      }
+    } else if (arg == "--program" && i + 1 < argc) {
+      program = argv[++i];
+    } else if (arg == "--native" && i + 1 < argc) {
+      variants.insert(variants.begin(), {"native", argv[++i]});
+    } else if (arg.compare(0, 2, "--") != 0 && arg.find('=') != std::string::npos) {
+      variants.push_back({arg.substr(0, arg.find('=')), arg.substr(arg.find('=') + 1)});
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (program.empty() || variants.empty() || variants[0].name != "native" || trials == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (sizes.empty()) sizes.push_back(1000000);
+
+  std::cout << "{\"program\": " << quoted(program) << ", \"trials\": " << trials << ", \"seed\": " << seed
+            << ", \"sizes\": [";
+  for (size_t s = 0; s < sizes.size(); s++) {
+    std::vector<std::vector<Run>> runs(variants.size());
+    for (unsigned trial = 0; trial < trials; trial++) {
+      for (size_t v = 0; v < variants.size(); v++) {
+        runs[v].push_back(runOnce(variants[v], program, sizes[s], seed));
+      }
+    }
+
+    double nativeSeconds = 0;
+    std::cout << (s ? ", " : "") << "{\"size\": " << sizes[s] << ", \"variants\": [";
+    for (size_t v = 0; v < variants.size(); v++) {
+      std::vector<double> seconds;
+      long maxRssKb = 0;
+      bool ok = true;
+      for (const Run &R : runs[v]) {
+        seconds.push_back(R.seconds);
+        maxRssKb = std::max(maxRssKb, R.maxRssKb);
+        ok = ok && R.ok;
+      }
+      double mid = median(seconds);
+      if (v == 0) nativeSeconds = mid;
+      // Deterministic programs log the same events every trial
+      uint64_t events = runs[v].back().events, traceBytes = runs[v].back().traceBytes;
+      std::cout << (v ? ", " : "") << "{\"name\": " << quoted(variants[v].name) << ", \"ok\": "
+                << (ok ? "true" : "false") << ", \"seconds\": [";
+      for (size_t t = 0; t < seconds.size(); t++) std::cout << (t ? ", " : "") << number(seconds[t]);
+      std::cout << "], \"median_s\": " << number(mid)
+                << ", \"slowdown\": " << number(nativeSeconds > 0 ? mid / nativeSeconds : 0)
+                << ", \"events\": " << events
+                << ", \"events_per_s\": " << number(mid > 0 ? events / mid : 0)
+                << ", \"trace_bytes\": " << traceBytes
+                << ", \"bytes_per_event\": " << number(events ? double(traceBytes) / events : 0)
+                << ", \"max_rss_kb\": " << maxRssKb << "}";
+      if (!ok) std::cerr << program << " " << variants[v].name << " failed at size " << sizes[s] << std::endl;
+    }
+    std::cout << "]}";
+  }
+  std::cout << "]}" << std::endl;
+  return 0;
+}
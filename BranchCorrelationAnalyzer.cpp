@@ -0,0 +1,255 @@
+#include "BranchTrace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+    - Finds, for the top-K least-predictable branches, which earlier branches best predict them.
+    - Pass 1 ranks branches by mispredictions: TAGE-SC-L labels from BranchPredictorSimulator
+      when given, otherwise a per-branch 2-bit counter computed while streaming.
+    - Pass 2 keeps the last N distinct branches (and their latest outcomes) in a move-to-front
+      list and accumulates 2x2 outcome tables for each (hard branch, recent branch) pair.
+    - Each hard branch owns a fixed number of pair slots; a source probes a small window of
+      them and the least-seen slot is recycled, so memory is K * slots regardless of trace length.
+    - Output: one correlation edge per line, ranked by mutual information.
+    - Usage: BranchCorrelationAnalyzer [--top-k K] [--recent N] [--slots S] [--edges E]
+                                      [--labels labels.txt] <trace> [edges_out]
+*/
+
+namespace {
+  struct PairSlot {
+    uint64_t sourceID = 0;
+    uint64_t counts[4] = {0, 0, 0, 0}; // [sourceOutcome * 2 + targetOutcome]
+    uint64_t total = 0;
+    bool used = false;
+  };
+
+  struct TargetTable {
+    uint64_t branchID = 0;
+    uint64_t executions = 0;
+    uint64_t mispredictions = 0;
+    std::vector<PairSlot> slots;
+  };
+
+  struct RecentBranch {
+    uint64_t branchID;
+    bool taken;
+  };
+
+  struct CorrelationEdge {
+    uint64_t source;
+    uint64_t target;
+    uint64_t samples;
+    double mutualInformation; // bits
+    double agreement;         // accuracy of predicting the target from the source outcome
+    double coverage;          // fraction of target executions that saw the source recently
+  };
+
+  // Loads "branch_id,executions,taken,mispredictions,..." lines written by BranchPredictorSimulator
+  bool loadLabels(const std::string &path, std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> &out) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    std::getline(in, line); // header
+    while (std::getline(in, line)) {
+      std::stringstream ss(line);
+      std::string field;
+      uint64_t values[4];
+      int n = 0;
+      while (n < 4 && std::getline(ss, field, ',')) {
+        values[n++] = std::strtoull(field.c_str(), nullptr, 10);
+      }
+      if (n == 4) {
+        out[values[0]] = {values[1], values[3]};
+      }
+    }
+    return true;
+  }
+
+  double mutualInformation(const uint64_t counts[4]) {
+    double total = double(counts[0] + counts[1] + counts[2] + counts[3]);
+    if (total == 0) return 0.0;
+    double mi = 0.0;
+    for (int s = 0; s < 2; s++) {
+      for (int t = 0; t < 2; t++) {
+        double joint = counts[s * 2 + t] / total;
+        if (joint == 0) continue;
+        double ps = (counts[s * 2] + counts[s * 2 + 1]) / total;
+        double pt = (counts[t] + counts[2 + t]) / total;
+        mi += joint * std::log2(joint / (ps * pt));
+      }
+    }
+    return mi;
+  }
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [--top-k K] [--recent N] [--slots S] [--edges E]"
+              << " [--labels labels.txt] <trace> [edges_out]" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t topK = 32, recentN = 16, slotsPerTarget = 64, edgesPerTarget = 8;
+  std::string labelsPath;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--top-k" && i + 1 < argc) {
+      topK = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--recent" && i + 1 < argc) {
+      recentN = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--slots" && i + 1 < argc) {
+      slotsPerTarget = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--edges" && i + 1 < argc) {
+      edgesPerTarget = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--labels" && i + 1 < argc) {
+      labelsPath = argv[++i];
+    } else if (arg.compare(0, 2, "--") == 0) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.empty() || positional.size() > 2 || !topK || !recentN || !slotsPerTarget) {
+    usage(argv[0]);
+    return 1;
+  }
+  const std::string &tracePath = positional[0];
+
+  // Pass 1: rank branches by how badly they are predicted
+  std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> stats; // branchID -> (executions, mispredictions)
+  if (!labelsPath.empty()) {
+    if (!loadLabels(labelsPath, stats)) {
+      std::cerr << "Failed to open " << labelsPath << std::endl;
+      return 1;
+    }
+  } else {
+    std::unordered_map<uint64_t, uint8_t> bimodal;
+    bool ok = forEachBranchEvent(tracePath, [&](uint64_t branchID, bool taken) {
+      uint8_t &ctr = bimodal.emplace(branchID, 2).first->second;
+      auto &s = stats[branchID];
+      s.first++;
+      s.second += (ctr >= 2) != taken;
+      if (taken) { if (ctr < 3) ctr++; }
+      else if (ctr > 0) ctr--;
+    });
+    if (!ok) {
+      std::cerr << "Failed to open " << tracePath << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<std::pair<uint64_t, std::pair<uint64_t, uint64_t>>> ranked(stats.begin(), stats.end());
+  std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+    if (a.second.second != b.second.second) return a.second.second > b.second.second;
+    return a.first < b.first;
+  });
+  std::vector<TargetTable> targets;
+  std::vector<int32_t> targetIndex; // branchID -> index into targets, -1 if not a hard branch
+  for (const auto &R : ranked) {
+    if (targets.size() == topK || R.second.second == 0) break;
+    TargetTable T;
+    T.branchID = R.first;
+    T.mispredictions = R.second.second;
+    T.slots.resize(slotsPerTarget);
+    if (R.first >= targetIndex.size()) targetIndex.resize(R.first + 1, -1);
+    targetIndex[R.first] = int32_t(targets.size());
+    targets.push_back(std::move(T));
+  }
+
+  // Pass 2: accumulate outcome tables against the last N distinct branches
+  const size_t probeWindow = std::min<size_t>(8, slotsPerTarget);
+  std::vector<RecentBranch> recent;
+  recent.reserve(recentN + 1);
+  bool ok = forEachBranchEvent(tracePath, [&](uint64_t branchID, bool taken) {
+    if (branchID < targetIndex.size() && targetIndex[branchID] >= 0) {
+      TargetTable &T = targets[targetIndex[branchID]];
+      T.executions++;
+      for (const RecentBranch &R : recent) {
+        if (R.branchID == branchID) continue;
+        // Bounded probe window around the source's home slot; the least-seen
+        // slot in the window is recycled when the source is not present.
+        size_t home = size_t((R.branchID * 0x9E3779B97F4A7C15ull) >> 32) % T.slots.size();
+        PairSlot *slot = nullptr;
+        PairSlot *victim = nullptr;
+        for (size_t p = 0; p < probeWindow; p++) {
+          PairSlot &S = T.slots[(home + p) % T.slots.size()];
+          if (S.used && S.sourceID == R.branchID) {
+            slot = &S;
+            break;
+          }
+          if (!victim || (victim->used && (!S.used || S.total < victim->total))) victim = &S;
+        }
+        if (!slot) {
+          slot = victim;
+          *slot = PairSlot();
+          slot->used = true;
+          slot->sourceID = R.branchID;
+        }
+        slot->counts[(R.taken ? 2 : 0) + (taken ? 1 : 0)]++;
+        slot->total++;
+      }
+    }
+
+    // Move-to-front update of the recent distinct branches
+    size_t pos = 0;
+    while (pos < recent.size() && recent[pos].branchID != branchID) pos++;
+    if (pos == recent.size()) {
+      if (recent.size() < recentN) {
+        recent.push_back({branchID, taken});
+      } else {
+        pos = recent.size() - 1;
+      }
+    }
+    for (size_t j = pos; j > 0; j--) recent[j] = recent[j - 1];
+    recent[0] = {branchID, taken};
+  });
+  if (!ok) {
+    std::cerr << "Failed to open " << tracePath << std::endl;
+    return 1;
+  }
+
+  std::ofstream outFile;
+  if (positional.size() == 2) {
+    outFile.open(positional[1], std::ios::out);
+    if (!outFile) {
+      std::cerr << "Failed to open " << positional[1] << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &out = positional.size() == 2 ? static_cast<std::ostream &>(outFile) : std::cout;
+  out << "source_branch,target_branch,samples,mutual_information,agreement,coverage\n";
+  size_t totalEdges = 0;
+  for (const TargetTable &T : targets) {
+    std::vector<CorrelationEdge> edges;
+    for (const PairSlot &S : T.slots) {
+      if (!S.used || S.total == 0) continue;
+      uint64_t agree = std::max(S.counts[0], S.counts[1]) + std::max(S.counts[2], S.counts[3]);
+      edges.push_back({S.sourceID, T.branchID, S.total, mutualInformation(S.counts),
+                       double(agree) / S.total, T.executions ? double(S.total) / T.executions : 0.0});
+    }
+    std::sort(edges.begin(), edges.end(), [](const CorrelationEdge &a, const CorrelationEdge &b) {
+      if (a.mutualInformation != b.mutualInformation) return a.mutualInformation > b.mutualInformation;
+      return a.source < b.source;
+    });
+    if (edges.size() > edgesPerTarget) edges.resize(edgesPerTarget);
+    for (const CorrelationEdge &E : edges) {
+      out << E.source << "," << E.target << "," << E.samples << "," << E.mutualInformation << ","
+          << E.agreement << "," << E.coverage << "\n";
+    }
+    totalEdges += edges.size();
+  }
+
+  std::cerr << "Correlated " << targets.size() << " hard branches against the last " << recentN
+            << " distinct branches: " << totalEdges << " edges ("
+            << targets.size() * slotsPerTarget * sizeof(PairSlot) / 1024 << " KB of pair tables)" << std::endl;
+  return 0;
+}
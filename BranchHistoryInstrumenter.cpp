@@ -1,21 +1,133 @@
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include <algorithm>
+#include <iterator>
+#include <string>
 #include <vector>
 
 using namespace llvm;
 
 namespace {
+  // Runtime recording modes with their own entry point, logBranchOutcome_<mode>
+  // (see DynamicLog.cpp); the plain pass calls the environment-configured logBranchOutcome
+  const char *const RuntimeModes[] = {"count", "trace", "pack", "sample", "predict", "shards", "atomic"};
+
   struct BranchHistoryInstrumenter : public PassInfoMixin<BranchHistoryInstrumenter> {
+    std::string LogFuncName;
+    // Calls use preserve_most, so the instrumented code need not spill its
+    // caller-saved registers around them; the runtime entry point must match
+    bool PreserveMost;
+
+    // Non-empty: exit tests of batchable loops (see batchableExit) go through this
+    // logBranchOutcomesBulk entry point instead of a call per iteration
+    std::string BulkFuncName;
+
+    explicit BranchHistoryInstrumenter(std::string LogFuncName = "logBranchOutcome", bool PreserveMost = false,
+                                       std::string BulkFuncName = "")
+        : LogFuncName(std::move(LogFuncName)), PreserveMost(PreserveMost), BulkFuncName(std::move(BulkFuncName)) {}
+
+    // The exit test of an innermost loop that calls nothing and has no other conditional
+    // branch. Nothing else can log a branch between its outcomes until the loop exits, so
+    // logging them in batches leaves the trace unchanged.
+    static BranchInst *batchableExit(Loop *L) {
+      if (!L->getSubLoops().empty() || !L->getLoopPreheader()) {
+        return nullptr;
+      }
+      BranchInst *Exit = nullptr;
+      for (BasicBlock *BB : L->blocks()) {
+        auto *BI = dyn_cast<BranchInst>(BB->getTerminator());
+        if (!BI) {
+          return nullptr;
+        }
+        for (Instruction &I : *BB) {
+          if (isa<CallBase>(I) && !isa<IntrinsicInst>(I)) {
+            return nullptr;
+          }
+        }
+        if (BI->isConditional()) {
+          if (Exit || L->contains(BI->getSuccessor(0)) == L->contains(BI->getSuccessor(1))) {
+            return nullptr;
+          }
+          Exit = BI;
+        }
+      }
+      return Exit;
+    }
+
+    // Keeps the loop's outcomes in a 64-bit register (bit i: the i-th outcome since the
+    // last flush) and passes them to the runtime every 64 iterations and on exit. Only
+    // the one-word flush buffer escapes, so the register and count stay in SSA values
+    // once SROA runs.
+    void batchLoopExit(Function &F, Loop *L, BranchInst *BI, Value *BranchID, FunctionCallee BulkFunc) {
+      LLVMContext &Ctx = F.getContext();
+      Type *I64 = Type::getInt64Ty(Ctx);
+      IRBuilder<> EntryBuilder(&*F.getEntryBlock().getFirstInsertionPt());
+      AllocaInst *Bits = EntryBuilder.CreateAlloca(I64, nullptr, "branch.bits");
+      AllocaInst *Count = EntryBuilder.CreateAlloca(I64, nullptr, "branch.count");
+      AllocaInst *Flush = EntryBuilder.CreateAlloca(I64, nullptr, "branch.flush");
+      BasicBlock *ExitBB = BI->getSuccessor(L->contains(BI->getSuccessor(0)) ? 1 : 0);
+
+      IRBuilder<> PreheaderBuilder(L->getLoopPreheader()->getTerminator());
+      PreheaderBuilder.CreateStore(ConstantInt::get(I64, 0), Bits);
+      PreheaderBuilder.CreateStore(ConstantInt::get(I64, 0), Count);
+
+      IRBuilder<> Builder(BI);
+      Value *N = Builder.CreateLoad(I64, Count);
+      Value *Bit = Builder.CreateShl(Builder.CreateZExt(BI->getCondition(), I64), N);
+      Value *NewBits = Builder.CreateOr(Builder.CreateLoad(I64, Bits), Bit);
+      Value *NewCount = Builder.CreateAdd(N, ConstantInt::get(I64, 1));
+      Builder.CreateStore(NewBits, Bits);
+      Builder.CreateStore(NewCount, Count);
+      Value *Full = Builder.CreateICmpEQ(NewCount, ConstantInt::get(I64, 64));
+      Instruction *FlushTerm =
+          SplitBlockAndInsertIfThen(Full, BI, false, MDBuilder(Ctx).createBranchWeights(1, 63));
+      IRBuilder<> FlushBuilder(FlushTerm);
+      FlushBuilder.CreateStore(NewBits, Flush);
+      FlushBuilder.CreateCall(BulkFunc, {BranchID, Flush, NewCount});
+      FlushBuilder.CreateStore(ConstantInt::get(I64, 0), Bits);
+      FlushBuilder.CreateStore(ConstantInt::get(I64, 0), Count);
+
+      // The rest, ending with the exiting outcome, before anything after the loop runs
+      BasicBlock *ExitEdge = SplitEdge(BI->getParent(), ExitBB);
+      IRBuilder<> ExitBuilder(&*ExitEdge->getFirstInsertionPt());
+      ExitBuilder.CreateStore(ExitBuilder.CreateLoad(I64, Bits), Flush);
+      ExitBuilder.CreateCall(BulkFunc, {BranchID, Flush, ExitBuilder.CreateLoad(I64, Count)});
+    }
+
     PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
       // Declare the logging function
       LLVMContext &Ctx = F.getContext();
       FunctionCallee LogFunc = F.getParent()->getOrInsertFunction(
-        "logBranchOutcome", Type::getVoidTy(Ctx), Type::getInt64Ty(Ctx), Type::getInt1Ty(Ctx)
+        LogFuncName, Type::getVoidTy(Ctx), Type::getInt64Ty(Ctx), Type::getInt1Ty(Ctx)
       );
+      // The outcome is a C bool: the caller must zero-extend it
+      if (auto *Callee = dyn_cast<Function>(LogFunc.getCallee())) {
+        Callee->addParamAttr(1, Attribute::ZExt);
+        if (PreserveMost) {
+          Callee->setCallingConv(CallingConv::PreserveMost);
+        }
+      }
+
+      // Loop exit tests logged in batches keep their IDs; they are rewritten once all
+      // branches are numbered, since batching splits blocks
+      DenseMap<BranchInst *, Loop *> BatchableExits;
+      std::vector<std::pair<BranchInst *, Value *>> Batched;
+      if (!BulkFuncName.empty()) {
+        LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+        for (Loop *L : LI.getLoopsInPreorder()) {
+          if (BranchInst *Exit = batchableExit(L)) {
+            BatchableExits[Exit] = L;
+          }
+        }
+      }
 
       // Static counter for unique branch IDs
       static uint64_t BranchCounter = 0;
@@ -28,21 +140,67 @@ namespace {
 
             // Use a unique integer ID instead of PtrToInt
             Value *BranchID = ConstantInt::get(Type::getInt64Ty(Ctx), BranchCounter++);
+            if (BatchableExits.count(BI)) {
+              Batched.push_back({BI, BranchID});
+              continue;
+            }
 
             // Get condition value (taken = 1, not taken = 0)
             Value *Condition = BI->getCondition();
 
             // Insert call to logBranchOutcome before the branch
-            Builder.CreateCall(LogFunc, {BranchID, Condition});
+            CallInst *Call = Builder.CreateCall(LogFunc, {BranchID, Condition});
+            Call->addParamAttr(1, Attribute::ZExt);
+            if (PreserveMost) {
+              Call->setCallingConv(CallingConv::PreserveMost);
+            }
           }
         }
       }
 
+      if (!Batched.empty()) {
+        // logBranchOutcomesBulk(branch ID, outcome words, outcome count)
+        FunctionCallee BulkFunc = F.getParent()->getOrInsertFunction(
+          BulkFuncName, Type::getVoidTy(Ctx), Type::getInt64Ty(Ctx), Type::getInt64PtrTy(Ctx), Type::getInt64Ty(Ctx)
+        );
+        for (const std::pair<BranchInst *, Value *> &B : Batched) {
+          batchLoopExit(F, BatchableExits[B.first], B.first, B.second, BulkFunc);
+        }
+      }
+
       return PreservedAnalyses::none(); // We modified the IR
     }
 
     static bool isRequired() { return true; }
   };
+
+  // branch-history-instrumenter[-<mode>][-preserve-most][-bulk] calls
+  // logBranchOutcome[_<mode>][_preserve_most], the latter with the preserve_most convention;
+  // -bulk batches loop exit tests through logBranchOutcomesBulk[_<mode>]
+  bool parsePassName(StringRef Name, std::string &LogFuncName, bool &PreserveMost, std::string &BulkFuncName) {
+    if (!Name.consume_front("branch-history-instrumenter")) {
+      return false;
+    }
+    bool Bulk = Name.consume_back("-bulk");
+    PreserveMost = Name.consume_back("-preserve-most");
+    LogFuncName = "logBranchOutcome";
+    BulkFuncName = Bulk ? "logBranchOutcomesBulk" : "";
+    if (!Name.empty()) {
+      const char *const *Mode = std::find_if(std::begin(RuntimeModes), std::end(RuntimeModes),
+                                             [&](const char *M) { return Name == std::string("-") + M; });
+      if (Mode == std::end(RuntimeModes)) {
+        return false;
+      }
+      LogFuncName += std::string("_") + *Mode;
+      if (Bulk) {
+        BulkFuncName += std::string("_") + *Mode;
+      }
+    }
+    if (PreserveMost) {
+      LogFuncName += "_preserve_most";
+    }
+    return true;
+  }
 }
 
 // External logging function (to be defined in a runtime library)
@@ -59,8 +217,10 @@ llvmGetPassPluginInfo() {
     [](PassBuilder &PB) {
       PB.registerPipelineParsingCallback(
         [](StringRef Name, FunctionPassManager &FPM, ArrayRef<PassBuilder::PipelineElement>) {
-          if (Name == "branch-history-instrumenter") {
-            FPM.addPass(BranchHistoryInstrumenter());
+          std::string LogFuncName, BulkFuncName;
+          bool PreserveMost;
+          if (parsePassName(Name, LogFuncName, PreserveMost, BulkFuncName)) {
+            FPM.addPass(BranchHistoryInstrumenter(LogFuncName, PreserveMost, BulkFuncName));
             return true;
           }
           return false;
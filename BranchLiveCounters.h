@@ -0,0 +1,62 @@
+#ifndef BRANCH_LIVE_COUNTERS_H
+#define BRANCH_LIVE_COUNTERS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+    - Layout of the live counter segment shared by the runtime (DynamicLog.cpp, with
+      BRANCH_HISTORY_SHM=1) and the BranchTop viewer.
+    - The segment is the POSIX shared memory object "/branch_history_<program>_<pid>"
+      (/dev/shm on Linux). It holds a header, then one LiveBranchCounts slot per branch ID.
+    - The runtime updates the slots in place. They are the same counters that feed the
+      run's profile, so sharing them costs nothing per event. 64-bit aligned loads never
+      tear, so a reader may copy the slots while they change.
+    - The multithreaded shards and atomic modes keep their counts in per-thread or atomic
+      tables that reach the profile only at exit, so they create no segment: the runtime
+      warns and ignores BRANCH_HISTORY_SHM there.
+    - The slot table only moves when a new branch ID outgrows it. The runtime then makes
+      sequence odd, enlarges and remaps the object, updates capacity and makes sequence
+      even again. A reader copies capacity and the slots between two reads of an even
+      sequence and retries if it changed (a seqlock).
+    - exited is set at normal exit, just before the object is unlinked.
+*/
+
+static const char LiveCounterMagic[8] = {'B', 'H', 'T', 'L', 'I', 'V', 'E', '1'};
+
+struct LiveBranchCounts {
+  uint64_t executions;
+  uint64_t taken;
+  uint64_t transitions; // executions whose outcome differs from the previous one
+  uint64_t lastOutcome;
+};
+
+struct LiveCounterHeader {
+  char magic[8];
+  std::atomic<uint64_t> sequence;
+  uint64_t capacity; // LiveBranchCounts slots after the header
+  uint64_t pid;
+  uint64_t startTimeUs; // since the epoch
+  std::atomic<uint64_t> exited;
+  char programName[64];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the header is shared between processes");
+
+inline size_t liveCounterBytes(uint64_t capacity) {
+  return sizeof(LiveCounterHeader) + size_t(capacity) * sizeof(LiveBranchCounts);
+}
+
+inline LiveBranchCounts *liveCounterSlots(LiveCounterHeader *header) {
+  return reinterpret_cast<LiveBranchCounts *>(header + 1);
+}
+
+inline std::string liveCounterName(const std::string &programName, uint64_t pid) {
+  std::string name = "/branch_history_";
+  for (char c : programName) name += c == '/' ? '_' : c;
+  return name + "_" + std::to_string(pid);
+}
+
+#endif // BRANCH_LIVE_COUNTERS_H
@@ -0,0 +1,102 @@
+#include "BranchTrace.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+    - Streams a branch trace and keeps, per branch, (executions, taken) counters indexed by
+      that branch's own last 8 outcomes: one 2^8 table per branch, two increments per event.
+    - Lower orders k < 8 are obtained at the end by summing over the older history bits,
+      so P(taken | last k outcomes) is available for every k in 1..8 without the trace.
+    - Output per branch: accuracy of the ideal order-k predictor for k = 1..8 and the
+      conditional entropy H(outcome | last 8 outcomes).
+    - Usage: BranchMarkovAnalyzer <trace> [markov_out]
+*/
+
+namespace {
+  constexpr unsigned MaxOrder = 8;
+  constexpr unsigned Patterns = 1u << MaxOrder;
+
+  struct BranchMarkov {
+    uint64_t executions = 0;
+    uint8_t history = 0; // newest outcome in bit 0, not-taken before the first execution
+    std::vector<uint64_t> counts; // [2 * pattern + {0: executions, 1: taken}]
+  };
+
+  double entropyBits(uint64_t n, uint64_t taken) {
+    if (n == 0 || taken == 0 || taken == n) return 0.0;
+    double p = double(taken) / n;
+    return -(p * std::log2(p) + (1 - p) * std::log2(1 - p));
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "Usage: " << argv[0] << " <trace> [markov_out]" << std::endl;
+    return 1;
+  }
+
+  std::vector<BranchMarkov> branches;
+  bool ok = forEachBranchEvent(argv[1], [&](uint64_t branchID, bool taken) {
+    if (branchID >= branches.size()) {
+      branches.resize(branchID + 1);
+    }
+    BranchMarkov &B = branches[branchID];
+    if (!B.executions++) B.counts.assign(2 * Patterns, 0);
+    B.counts[2 * B.history]++;
+    B.counts[2 * B.history + 1] += taken;
+    B.history = uint8_t((B.history << 1) | (taken ? 1 : 0));
+  });
+  if (!ok) {
+    std::cerr << "Failed to open " << argv[1] << std::endl;
+    return 1;
+  }
+
+  std::ofstream outFile;
+  if (argc == 3) {
+    outFile.open(argv[2], std::ios::out);
+    if (!outFile) {
+      std::cerr << "Failed to open " << argv[2] << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &out = argc == 3 ? static_cast<std::ostream &>(outFile) : std::cout;
+  out << "branch_id,executions";
+  for (unsigned k = 1; k <= MaxOrder; k++) out << ",markov_acc_" << k;
+  out << ",markov_entropy_" << MaxOrder << "\n";
+
+  for (size_t id = 0; id < branches.size(); id++) {
+    const BranchMarkov &B = branches[id];
+    if (!B.executions) continue;
+    out << id << "," << B.executions;
+
+    // Fold the order-8 table down one history bit at a time; after folding,
+    // the first 2^k patterns of marginal hold the order-k counts.
+    double accuracy[MaxOrder + 1] = {0};
+    double entropy = 0.0;
+    std::vector<uint64_t> marginal(B.counts);
+    for (unsigned p = 0; p < Patterns; p++) {
+      entropy += double(marginal[2 * p]) / B.executions * entropyBits(marginal[2 * p], marginal[2 * p + 1]);
+    }
+    for (unsigned k = MaxOrder; k >= 1; k--) {
+      uint64_t correct = 0;
+      for (unsigned p = 0; p < (1u << k); p++) {
+        uint64_t n = marginal[2 * p], t = marginal[2 * p + 1];
+        correct += t > n - t ? t : n - t;
+      }
+      accuracy[k] = double(correct) / B.executions;
+      for (unsigned p = 0; p < (1u << (k - 1)); p++) {
+        unsigned older = p | (1u << (k - 1)); // same context with the oldest bit set
+        marginal[2 * p] += marginal[2 * older];
+        marginal[2 * p + 1] += marginal[2 * older + 1];
+      }
+    }
+    for (unsigned k = 1; k <= MaxOrder; k++) out << "," << accuracy[k];
+    out << "," << entropy << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,210 @@
+#include "BranchTrace.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+    - Detects periodic outcome patterns on bit-packed per-branch streams.
+    - Autocorrelation: for each lag p, popcount(s ^ (s >> p)) over whole words counts the
+      executions whose outcome differs from the one p executions later; the smallest lag
+      with no mismatches is the exact period, otherwise the best-matching lag is reported.
+    - Run lengths come from the transition mask s ^ (s >> 1), walked with count-trailing-zeros.
+    - A branch is flagged loop_predictable when its dominant outcome always comes in runs of
+      the same length separated by single opposite outcomes (a constant trip count), which
+      is what a loop predictor learns perfectly, however long the trip count.
+    - Usage: BranchPeriodicityAnalyzer [--max-lag P] <trace> [periodicity_out]
+*/
+
+namespace {
+  struct RunStats {
+    uint64_t runs = 0;
+    uint64_t takenRuns = 0, takenRunTotal = 0, maxTakenRun = 0;
+    uint64_t notTakenRuns = 0, notTakenRunTotal = 0, maxNotTakenRun = 0;
+    bool loopPredictable = false;
+    uint64_t tripCount = 0;
+  };
+
+  uint64_t popcount(uint64_t x) { return uint64_t(__builtin_popcountll(x)); }
+
+  uint64_t countTaken(const PackedOutcomes &S) {
+    uint64_t total = 0;
+    for (uint64_t w : S.words) total += popcount(w);
+    return total;
+  }
+
+  // Number of positions i in [0, size - lag) with outcome(i) != outcome(i + lag)
+  uint64_t mismatches(const PackedOutcomes &S, uint64_t lag) {
+    if (lag >= S.size) return 0;
+    uint64_t compared = S.size - lag;
+    uint64_t fullWords = compared >> 6;
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < fullWords; i++) {
+      count += popcount(S.words[i] ^ S.shiftedWord(i, lag));
+    }
+    if (compared & 63) {
+      uint64_t mask = (uint64_t(1) << (compared & 63)) - 1;
+      count += popcount((S.words[fullWords] ^ S.shiftedWord(fullWords, lag)) & mask);
+    }
+    return count;
+  }
+
+  // Streams the runs of S once; each run is classified when the next one ends so
+  // that the last (possibly truncated) run can be told apart from interior runs.
+  RunStats runStats(const PackedOutcomes &S, bool dominant) {
+    RunStats R;
+    if (S.size == 0) return R;
+
+    uint64_t body = 0;
+    bool consistent = true;
+    bool sawInterior = false;
+    uint64_t pendingLength = 0;
+    bool pendingOutcome = false;
+    auto classify = [&](uint64_t length, bool outcome, bool edge) {
+      R.runs++;
+      if (outcome) {
+        R.takenRuns++;
+        R.takenRunTotal += length;
+        if (length > R.maxTakenRun) R.maxTakenRun = length;
+      } else {
+        R.notTakenRuns++;
+        R.notTakenRunTotal += length;
+        if (length > R.maxNotTakenRun) R.maxNotTakenRun = length;
+      }
+      // Loop pattern: interior dominant runs share one length and every minority run is
+      // a single execution. The first and last runs may be cut short by the trace boundaries.
+      if (!consistent) return;
+      if (outcome != dominant) {
+        consistent = length == 1;
+      } else if (!edge) {
+        if (!body) body = length;
+        consistent = length == body;
+        sawInterior = true;
+      } else if (body && length > body) {
+        consistent = false;
+      }
+    };
+
+    // Run boundaries: bit i of the transition mask is set when outcome(i) != outcome(i + 1)
+    uint64_t runStart = 0;
+    auto closeRun = [&](uint64_t end) {
+      if (pendingLength) classify(pendingLength, pendingOutcome, R.runs == 0);
+      pendingLength = end - runStart;
+      pendingOutcome = S.get(runStart);
+      runStart = end;
+    };
+    uint64_t transitions = S.size - 1;
+    for (uint64_t w = 0; w * 64 < transitions; w++) {
+      uint64_t t = S.words[w] ^ S.shiftedWord(w, 1);
+      uint64_t valid = transitions - w * 64;
+      if (valid < 64) t &= (uint64_t(1) << valid) - 1;
+      while (t) {
+        closeRun(w * 64 + uint64_t(__builtin_ctzll(t)) + 1);
+        t &= t - 1;
+      }
+    }
+    closeRun(S.size);
+    classify(pendingLength, pendingOutcome, true);
+
+    if (consistent && sawInterior) {
+      R.loopPredictable = true;
+      R.tripCount = body + 1;
+    }
+    return R;
+  }
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [--max-lag P] <trace> [periodicity_out]" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  uint64_t maxLag = 256;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--max-lag" && i + 1 < argc) {
+      maxLag = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg.compare(0, 2, "--") == 0) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.empty() || positional.size() > 2 || maxLag == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<PackedOutcomes> streams;
+  if (!loadPackedStreams(positional[0], streams)) {
+    std::cerr << "Failed to open " << positional[0] << std::endl;
+    return 1;
+  }
+
+  std::ofstream outFile;
+  if (positional.size() == 2) {
+    outFile.open(positional[1], std::ios::out);
+    if (!outFile) {
+      std::cerr << "Failed to open " << positional[1] << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &out = positional.size() == 2 ? static_cast<std::ostream &>(outFile) : std::cout;
+  out << "branch_id,executions,taken,period,period_exact,period_match,phase,runs,"
+         "mean_taken_run,mean_not_taken_run,max_taken_run,max_not_taken_run,loop_predictable,trip_count\n";
+
+  uint64_t periodic = 0, loopBranches = 0;
+  for (size_t id = 0; id < streams.size(); id++) {
+    const PackedOutcomes &S = streams[id];
+    if (!S.size) continue;
+    uint64_t taken = countTaken(S);
+    bool dominant = 2 * taken >= S.size;
+
+    // Smallest exact period, else the lag with the fewest mismatches. A constant
+    // stream has period 1; a lag must repeat at least once to count.
+    uint64_t bestLag = 0;
+    double bestMatch = -1.0;
+    bool exact = false;
+    for (uint64_t lag = 1; lag <= maxLag && 2 * lag <= S.size; lag++) {
+      uint64_t miss = mismatches(S, lag);
+      double match = 1.0 - double(miss) / double(S.size - lag);
+      if (match > bestMatch) {
+        bestMatch = match;
+        bestLag = lag;
+      }
+      if (miss == 0) {
+        exact = true;
+        break;
+      }
+    }
+
+    // Phase: offset of the first minority outcome within the first period
+    uint64_t phase = 0;
+    if (bestLag) {
+      for (uint64_t i = 0; i < bestLag; i++) {
+        if (S.get(i) != dominant) {
+          phase = i;
+          break;
+        }
+      }
+    }
+
+    RunStats R = runStats(S, dominant);
+    periodic += exact;
+    loopBranches += R.loopPredictable;
+    out << id << "," << S.size << "," << taken << "," << bestLag << "," << (exact ? 1 : 0) << ","
+        << (bestLag ? bestMatch : 0.0) << "," << phase << "," << R.runs << ","
+        << (R.takenRuns ? double(R.takenRunTotal) / R.takenRuns : 0.0) << ","
+        << (R.notTakenRuns ? double(R.notTakenRunTotal) / R.notTakenRuns : 0.0) << ","
+        << R.maxTakenRun << "," << R.maxNotTakenRun << "," << (R.loopPredictable ? 1 : 0) << ","
+        << R.tripCount << "\n";
+  }
+
+  std::cerr << "Analyzed " << streams.size() << " branch streams: " << periodic << " exactly periodic within lag "
+            << maxLag << ", " << loopBranches << " loop-predictable" << std::endl;
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "BranchTrace.h"
+#include "TageSCL.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+    - Replays a branch trace through TAGE-SC-L and records, per branch ID, how often it
+      executed, how often it was taken and how often TAGE-SC-L still mispredicted it.
+    - The residual misprediction counts are the ground-truth "hard to predict" labels.
+    - Usage: BranchPredictorSimulator [--budget-kb N] <trace> [labels_out]
+*/
+
+namespace {
+  struct BranchLabel {
+    uint64_t executions = 0;
+    uint64_t taken = 0;
+    uint64_t mispredictions = 0;
+  };
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [--budget-kb N] <trace> [labels_out]" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned budgetKB = 64;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--budget-kb") == 0 && i + 1 < argc) {
+      budgetKB = unsigned(std::strtoul(argv[++i], nullptr, 10));
+    } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+      usage(argv[0]);
+      return 1;
+    } else {
+      positional.push_back(argv[i]);
+    }
+  }
+  if (positional.empty() || positional.size() > 2 || budgetKB == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  TageSCLConfig cfg = TageSCLConfig::forBudgetKB(budgetKB);
+  TageSCL predictor(cfg);
+  std::vector<BranchLabel> labels;
+  uint64_t events = 0, mispredictions = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  bool ok = forEachBranchEvent(positional[0], [&](uint64_t branchID, bool taken) {
+    if (branchID >= labels.size()) {
+      labels.resize(branchID + 1);
+    }
+    bool miss = predictor.predict(branchID) != taken;
+    predictor.update(branchID, taken);
+    BranchLabel &L = labels[branchID];
+    L.executions++;
+    L.taken += taken;
+    L.mispredictions += miss;
+    events++;
+    mispredictions += miss;
+  });
+  if (!ok) {
+    std::cerr << "Failed to open " << positional[0] << std::endl;
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::ofstream outFile;
+  if (positional.size() == 2) {
+    outFile.open(positional[1], std::ios::out);
+    if (!outFile) {
+      std::cerr << "Failed to open " << positional[1] << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &out = positional.size() == 2 ? static_cast<std::ostream &>(outFile) : std::cout;
+  out << "branch_id,executions,taken,mispredictions,misprediction_rate\n";
+  for (size_t id = 0; id < labels.size(); id++) {
+    const BranchLabel &L = labels[id];
+    if (!L.executions) continue;
+    out << id << "," << L.executions << "," << L.taken << "," << L.mispredictions << ","
+        << double(L.mispredictions) / L.executions << "\n";
+  }
+
+  std::cerr << "TAGE-SC-L " << budgetKB << " KB budget ("
+            << cfg.storageBits() / 8192.0 << " KB used): "
+            << events << " events, " << mispredictions << " mispredictions ("
+            << (events ? 1000.0 * mispredictions / events : 0.0) << " per 1000 branches), "
+            << (seconds > 0 ? events / seconds / 1e6 : 0.0) << " M events/s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include "BranchProfile.h"
+#include "BranchTrace.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    - Merges and shows branch profiles (see BranchProfile.h), modelled on llvm-profdata.
+    - merge sums any number of profiles, each optionally scaled by an integer weight
+      (--weighted-input=W,FILE). Inputs are split across threads, each merging its share
+      of sorted record lists; the partial profiles are merged at the end.
+    - show prints a profile as "branch_id,executions,taken,transitions".
+    - Usage: BranchProfData merge [--threads T] [--input-files LIST] [--weighted-input=W,FILE]... -o OUT [FILE]...
+             BranchProfData show FILE
+*/
+
+namespace {
+  struct WeightedInput {
+    std::string path;
+    uint64_t weight;
+  };
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0
+              << " merge [--threads T] [--input-files LIST] [--weighted-input=W,FILE]... -o OUT [FILE]...\n"
+              << "       " << argv0 << " show FILE" << std::endl;
+  }
+
+  int show(const std::string &path) {
+    BranchProfile profile;
+    if (!readBranchProfile(path, profile)) {
+      std::cerr << "Failed to read profile " << path << std::endl;
+      return 1;
+    }
+    std::cerr << profile.programName << ": " << profile.runs << " runs, " << profile.records.size() << " branches"
+              << std::endl;
+    std::cout << "branch_id,executions,taken,transitions\n";
+    for (const BranchProfileRecord &R : profile.records) {
+      std::cout << R.branchID << "," << R.executions << "," << R.taken << "," << R.transitions << "\n";
+    }
+    return 0;
+  }
+
+  int merge(int argc, char **argv) {
+    std::vector<WeightedInput> inputs;
+    std::string output;
+    unsigned threads = traceDecodeThreads();
+    for (int i = 2; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "-o" && i + 1 < argc) {
+        output = argv[++i];
+      } else if (arg == "--threads" && i + 1 < argc) {
+        threads = unsigned(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--input-files" && i + 1 < argc) {
+        std::ifstream list(argv[++i]);
+        if (!list) {
+          std::cerr << "Failed to open " << argv[i] << std::endl;
+          return 1;
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+          if (!line.empty()) inputs.push_back({line, 1});
+        }
+      } else if (arg.compare(0, 17, "--weighted-input=") == 0) {
+        size_t comma = arg.find(',', 17);
+        uint64_t weight = std::strtoull(arg.c_str() + 17, nullptr, 10);
+        if (comma == std::string::npos || weight == 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        inputs.push_back({arg.substr(comma + 1), weight});
+      } else if (arg.compare(0, 1, "-") == 0) {
+        usage(argv[0]);
+        return 1;
+      } else {
+        inputs.push_back({arg, 1});
+      }
+    }
+    if (output.empty() || inputs.empty() || threads == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+
+    // The first input is read up front; every other one is checked against its program
+    std::vector<BranchProfile> partial(std::min<size_t>(threads, inputs.size()));
+    BranchProfile first;
+    if (!readBranchProfile(inputs[0].path, first)) {
+      std::cerr << "Failed to read profile " << inputs[0].path << std::endl;
+      return 1;
+    }
+    partial[0].merge(first, inputs[0].weight);
+    std::atomic<size_t> next(1);
+    std::atomic<bool> ok(true);
+    std::mutex errorLock;
+    auto work = [&](size_t t) {
+      BranchProfile profile;
+      for (size_t i; (i = next++) < inputs.size();) {
+        if (!readBranchProfile(inputs[i].path, profile)) {
+          std::lock_guard<std::mutex> guard(errorLock);
+          std::cerr << "Failed to read profile " << inputs[i].path << std::endl;
+          ok = false;
+          continue;
+        }
+        if (!first.programName.empty() && !profile.programName.empty() && profile.programName != first.programName) {
+          std::lock_guard<std::mutex> guard(errorLock);
+          std::cerr << "Warning: " << inputs[i].path << " profiles " << profile.programName << ", not "
+                    << first.programName << "; branch IDs are only stable within one program" << std::endl;
+        }
+        partial[t].merge(profile, inputs[i].weight);
+      }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < partial.size(); t++) workers.emplace_back(work, t);
+    work(0);
+    for (std::thread &w : workers) w.join();
+    if (!ok) return 1;
+
+    BranchProfile merged;
+    for (const BranchProfile &P : partial) merged.merge(P);
+    if (!writeBranchProfile(output, merged)) {
+      std::cerr << "Failed to write " << output << std::endl;
+      return 1;
+    }
+    std::cerr << "Merged " << inputs.size() << " profiles (" << merged.runs << " weighted runs, "
+              << merged.records.size() << " branches) into " << output << std::endl;
+    return 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  std::string command = argc > 1 ? argv[1] : "";
+  if (command == "merge") {
+    return merge(argc, argv);
+  }
+  if (command == "show" && argc == 3) {
+    return show(argv[2]);
+  }
+  usage(argv[0]);
+  return 1;
+}
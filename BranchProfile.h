@@ -0,0 +1,137 @@
+#ifndef BRANCH_PROFILE_H
+#define BRANCH_PROFILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+    - Mergeable per-branch counts profile (".bprof"), written by the runtime at exit and
+      combined across runs by BranchProfData, in the spirit of llvm-profdata.
+    - Every count is additive over runs, so profiles merge by summing (optionally with
+      integer weights) and a merged profile is again a valid input.
+    - Layout, all integers uint64 little-endian:
+        "BHTPROF1" runs records nameBytes name (zero-padded to 8 bytes)
+        { branchID executions taken transitions } * records
+      Records are fixed-size and sorted by branch ID, so a branch is found by binary
+      search without decoding the rest of the file. transitions counts executions whose
+      outcome differs from the same branch's previous execution.
+*/
+
+static const char BranchProfileMagic[8] = {'B', 'H', 'T', 'P', 'R', 'O', 'F', '1'};
+
+struct BranchProfileRecord {
+  uint64_t branchID;
+  uint64_t executions;
+  uint64_t taken;
+  uint64_t transitions;
+};
+
+struct BranchProfile {
+  std::string programName;
+  uint64_t runs = 0;
+  std::vector<BranchProfileRecord> records; // sorted by branch ID
+
+  const BranchProfileRecord *find(uint64_t branchID) const {
+    auto it = std::lower_bound(records.begin(), records.end(), branchID,
+                               [](const BranchProfileRecord &R, uint64_t id) { return R.branchID < id; });
+    return it != records.end() && it->branchID == branchID ? &*it : nullptr;
+  }
+
+  // Adds weight * other; both record lists stay sorted
+  void merge(const BranchProfile &other, uint64_t weight = 1) {
+    if (programName.empty()) programName = other.programName;
+    runs += other.runs * weight;
+    std::vector<BranchProfileRecord> merged;
+    merged.reserve(records.size() + other.records.size());
+    size_t i = 0, j = 0;
+    while (i < records.size() || j < other.records.size()) {
+      if (j == other.records.size() || (i < records.size() && records[i].branchID < other.records[j].branchID)) {
+        merged.push_back(records[i++]);
+        continue;
+      }
+      const BranchProfileRecord &O = other.records[j++];
+      BranchProfileRecord R{O.branchID, O.executions * weight, O.taken * weight, O.transitions * weight};
+      if (i < records.size() && records[i].branchID == O.branchID) {
+        R.executions += records[i].executions;
+        R.taken += records[i].taken;
+        R.transitions += records[i].transitions;
+        i++;
+      }
+      merged.push_back(R);
+    }
+    records.swap(merged);
+  }
+};
+
+inline void putProfileWord(std::vector<uint8_t> &out, uint64_t v) {
+  for (unsigned i = 0; i < 8; i++) out.push_back(uint8_t(v >> (8 * i)));
+}
+
+inline uint64_t getProfileWord(const uint8_t *p) {
+  uint64_t v = 0;
+  for (unsigned i = 0; i < 8; i++) v |= uint64_t(p[i]) << (8 * i);
+  return v;
+}
+
+// Writes to path + ".tmp" and renames, so readers never see a partial profile
+inline bool writeBranchProfile(const std::string &path, const BranchProfile &profile) {
+  std::vector<uint8_t> out(BranchProfileMagic, BranchProfileMagic + sizeof(BranchProfileMagic));
+  putProfileWord(out, profile.runs);
+  putProfileWord(out, profile.records.size());
+  putProfileWord(out, profile.programName.size());
+  out.insert(out.end(), profile.programName.begin(), profile.programName.end());
+  out.resize((out.size() + 7) / 8 * 8, 0);
+  for (const BranchProfileRecord &R : profile.records) {
+    putProfileWord(out, R.branchID);
+    putProfileWord(out, R.executions);
+    putProfileWord(out, R.taken);
+    putProfileWord(out, R.transitions);
+  }
+
+  std::string tmp = path + ".tmp";
+  FILE *f = std::fopen(tmp.c_str(), "wb");
+  if (!f) return false;
+  bool ok = std::fwrite(out.data(), 1, out.size(), f) == out.size();
+  ok &= std::fclose(f) == 0;
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Returns false if the file cannot be read or is not a well-formed profile
+inline bool readBranchProfile(const std::string &path, BranchProfile &profile) {
+  FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f) return false;
+  std::vector<uint8_t> data;
+  uint8_t buf[1 << 16];
+  size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+  std::fclose(f);
+
+  if (data.size() < 32 || std::memcmp(data.data(), BranchProfileMagic, sizeof(BranchProfileMagic)) != 0) return false;
+  profile.runs = getProfileWord(&data[8]);
+  uint64_t records = getProfileWord(&data[16]);
+  uint64_t nameBytes = getProfileWord(&data[24]);
+  uint64_t recordsStart = 32 + (nameBytes + 7) / 8 * 8;
+  if (nameBytes > data.size() || recordsStart > data.size() || (data.size() - recordsStart) / 32 != records ||
+      (data.size() - recordsStart) % 32 != 0) {
+    return false;
+  }
+  profile.programName.assign(reinterpret_cast<const char *>(&data[32]), size_t(nameBytes));
+  profile.records.resize(records);
+  const uint8_t *p = &data[recordsStart];
+  for (uint64_t r = 0; r < records; r++, p += 32) {
+    BranchProfileRecord &R = profile.records[r];
+    R = {getProfileWord(p), getProfileWord(p + 8), getProfileWord(p + 16), getProfileWord(p + 24)};
+    if (r && R.branchID <= profile.records[r - 1].branchID) return false;
+  }
+  return true;
+}
+
+#endif // BRANCH_PROFILE_H
@@ -0,0 +1,376 @@
+#include "dynamic_branch_predictor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+    - Microbenchmark of the runtime's hot path: drives logBranchOutcome and every mode,
+      bulk and preserve_most entry point of DynamicLog.o with synthetic branch streams and
+      prints one CSV row per entry, distribution and thread count.
+    - Distributions: hot (one branch), uniform (over 1M branch IDs) and zipf (1M IDs,
+      exponent --zipf-s, ranks scattered over the ID space). Each branch has its own
+      random taken bias. Streams are generated before timing; bulk entries take 64
+      outcomes of one branch per call.
+    - Every configuration runs in a forked child, since the runtime fixes its mode at the
+      first event; the child's exit writes its trace and profile to branch_history_logs/
+      as usual, outside the timing, so run it in a scratch directory.
+    - Threads run 1, 2, 4, ... up to --threads, released together once all exist; the entries that count
+      into one unsynchronized table (all but shards and atomic) only run on one thread.
+    - Batches of --batch events are timed with std::chrono and, on x86, rdtsc (reference
+      cycles at the TSC rate). Per-event percentiles are over the batches of all threads
+      after the first tenth; mevents_per_s is all threads' events over the wall time from
+      the moment all threads exist. hardware_threads is std::thread::hardware_concurrency():
+      rows with more threads than that are oversubscribed and do not show scaling.
+    - Usage: BranchRuntimeBench [--events N] [--batch N] [--threads N] [--zipf-s S]
+                                [--entries NAME,...] [--distributions NAME,...]
+*/
+
+#if defined(__has_attribute)
+#if __has_attribute(preserve_most)
+#define BRANCH_RUNTIME_BENCH_PRESERVE_MOST 1
+extern "C" {
+__attribute__((preserve_most)) void logBranchOutcome_preserve_most(uint64_t branchID, bool taken);
+__attribute__((preserve_most)) void logBranchOutcome_count_preserve_most(uint64_t branchID, bool taken);
+__attribute__((preserve_most)) void logBranchOutcome_trace_preserve_most(uint64_t branchID, bool taken);
+__attribute__((preserve_most)) void logBranchOutcome_pack_preserve_most(uint64_t branchID, bool taken);
+__attribute__((preserve_most)) void logBranchOutcome_sample_preserve_most(uint64_t branchID, bool taken);
+__attribute__((preserve_most)) void logBranchOutcome_predict_preserve_most(uint64_t branchID, bool taken);
+__attribute__((preserve_most)) void logBranchOutcome_shards_preserve_most(uint64_t branchID, bool taken);
+__attribute__((preserve_most)) void logBranchOutcome_atomic_preserve_most(uint64_t branchID, bool taken);
+}
+#endif
+#endif
+
+namespace {
+  constexpr uint64_t StreamEvents = 1 << 20; // a power of two, replayed cyclically
+  constexpr uint64_t BulkOutcomes = 64;
+  constexpr uint64_t SpreadBranches = 1000000;
+
+  struct Options {
+    uint64_t events = 1 << 22; // per thread
+    uint64_t batch = 1024;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    double zipfS = 1.0;
+    std::vector<std::string> entries;
+    std::vector<std::string> distributions = {"hot", "uniform", "zipf"};
+  };
+
+  // events[i] = branchID << 1 | taken; bulk call k logs branch events[64k] >> 1 with the
+  // outcomes of events[64k..64k+63]
+  struct Stream {
+    std::string name;
+    std::vector<uint64_t> events;
+    std::vector<uint64_t> bulkBits;
+  };
+
+  struct Samples {
+    std::vector<double> ns;
+    std::vector<double> cycles;
+  };
+
+  // What one thread runs: batches of the stream from offset on
+  struct Work {
+    const Stream *stream;
+    uint64_t offset;
+    uint64_t batches;
+    uint64_t warmupBatches;
+    uint64_t batch; // events per batch
+  };
+
+  inline uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+  }
+
+  template <typename Record>
+  void timeEvents(Record record, const Work &W, Samples &S) {
+    const uint64_t *events = W.stream->events.data();
+    uint64_t at = W.offset;
+    for (uint64_t b = 0; b < W.warmupBatches + W.batches; b++) {
+      uint64_t cycles = readCycles();
+      auto start = std::chrono::steady_clock::now();
+      for (uint64_t i = 0; i < W.batch; i++) {
+        uint64_t event = events[(at + i) & (StreamEvents - 1)];
+        record(event >> 1, event & 1);
+      }
+      auto end = std::chrono::steady_clock::now();
+      cycles = readCycles() - cycles;
+      at += W.batch;
+      if (b >= W.warmupBatches) {
+        S.ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / W.batch);
+        S.cycles.push_back(double(cycles) / W.batch);
+      }
+    }
+  }
+
+  // W.batch counts events, so a batch is W.batch / 64 calls
+  template <typename Record>
+  void timeBulk(Record record, const Work &W, Samples &S) {
+    const uint64_t *events = W.stream->events.data(), *bits = W.stream->bulkBits.data();
+    const uint64_t calls = std::max<uint64_t>(1, W.batch / BulkOutcomes), mask = StreamEvents / BulkOutcomes - 1;
+    uint64_t at = W.offset / BulkOutcomes;
+    for (uint64_t b = 0; b < W.warmupBatches + W.batches; b++) {
+      uint64_t cycles = readCycles();
+      auto start = std::chrono::steady_clock::now();
+      for (uint64_t i = 0; i < calls; i++) {
+        uint64_t call = (at + i) & mask;
+        record(events[call * BulkOutcomes] >> 1, &bits[call], BulkOutcomes);
+      }
+      auto end = std::chrono::steady_clock::now();
+      cycles = readCycles() - cycles;
+      at += calls;
+      if (b >= W.warmupBatches) {
+        S.ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / (calls * BulkOutcomes));
+        S.cycles.push_back(double(cycles) / (calls * BulkOutcomes));
+      }
+    }
+  }
+
+  struct Entry {
+    const char *name;
+    bool threadSafe;
+    void (*run)(const Work &, Samples &);
+  };
+
+#define BRANCH_RUNTIME_BENCH_ENTRY(name, function, threadSafe)                            \
+  Entry {                                                                                 \
+    name, threadSafe, [](const Work &W, Samples &S) {                                     \
+      timeEvents([](uint64_t branchID, bool taken) { function(branchID, taken); }, W, S); \
+    }                                                                                     \
+  }
+#define BRANCH_RUNTIME_BENCH_BULK_ENTRY(name, function, threadSafe)                                               \
+  Entry {                                                                                                         \
+    name, threadSafe, [](const Work &W, Samples &S) {                                                             \
+      timeBulk([](uint64_t branchID, const uint64_t *bits, uint64_t n) { function(branchID, bits, n); }, W, S); \
+    }                                                                                                             \
+  }
+
+  const std::vector<Entry> &allEntries() {
+    static const std::vector<Entry> entries = {
+        BRANCH_RUNTIME_BENCH_ENTRY("generic", logBranchOutcome, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("count", logBranchOutcome_count, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("trace", logBranchOutcome_trace, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("pack", logBranchOutcome_pack, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("sample", logBranchOutcome_sample, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("predict", logBranchOutcome_predict, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("shards", logBranchOutcome_shards, true),
+        BRANCH_RUNTIME_BENCH_ENTRY("atomic", logBranchOutcome_atomic, true),
+        BRANCH_RUNTIME_BENCH_BULK_ENTRY("generic-bulk", logBranchOutcomesBulk, false),
+        BRANCH_RUNTIME_BENCH_BULK_ENTRY("count-bulk", logBranchOutcomesBulk_count, false),
+        BRANCH_RUNTIME_BENCH_BULK_ENTRY("trace-bulk", logBranchOutcomesBulk_trace, false),
+        BRANCH_RUNTIME_BENCH_BULK_ENTRY("pack-bulk", logBranchOutcomesBulk_pack, false),
+        BRANCH_RUNTIME_BENCH_BULK_ENTRY("sample-bulk", logBranchOutcomesBulk_sample, false),
+        BRANCH_RUNTIME_BENCH_BULK_ENTRY("predict-bulk", logBranchOutcomesBulk_predict, false),
+        BRANCH_RUNTIME_BENCH_BULK_ENTRY("shards-bulk", logBranchOutcomesBulk_shards, true),
+        BRANCH_RUNTIME_BENCH_BULK_ENTRY("atomic-bulk", logBranchOutcomesBulk_atomic, true),
+#ifdef BRANCH_RUNTIME_BENCH_PRESERVE_MOST
+        BRANCH_RUNTIME_BENCH_ENTRY("generic-preserve-most", logBranchOutcome_preserve_most, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("count-preserve-most", logBranchOutcome_count_preserve_most, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("trace-preserve-most", logBranchOutcome_trace_preserve_most, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("pack-preserve-most", logBranchOutcome_pack_preserve_most, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("sample-preserve-most", logBranchOutcome_sample_preserve_most, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("predict-preserve-most", logBranchOutcome_predict_preserve_most, false),
+        BRANCH_RUNTIME_BENCH_ENTRY("shards-preserve-most", logBranchOutcome_shards_preserve_most, true),
+        BRANCH_RUNTIME_BENCH_ENTRY("atomic-preserve-most", logBranchOutcome_atomic_preserve_most, true),
+#endif
+    };
+    return entries;
+  }
+
+  Stream makeStream(const std::string &name, double zipfS) {
+    Stream stream;
+    stream.name = name;
+    std::mt19937_64 rng(42);
+    std::vector<double> zipfCdf;
+    if (name == "zipf") {
+      zipfCdf.resize(SpreadBranches);
+      double sum = 0;
+      for (uint64_t rank = 0; rank < SpreadBranches; rank++) {
+        sum += 1.0 / std::pow(double(rank + 1), zipfS);
+        zipfCdf[rank] = sum;
+      }
+    }
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    stream.events.resize(StreamEvents);
+    for (uint64_t &event : stream.events) {
+      uint64_t branchID = 7;
+      if (name == "uniform") {
+        branchID = rng() % SpreadBranches;
+      } else if (name == "zipf") {
+        uint64_t rank = uint64_t(std::upper_bound(zipfCdf.begin(), zipfCdf.end(), unit(rng) * zipfCdf.back()) -
+                                 zipfCdf.begin());
+        // 2654435761 is coprime with 10^6, so the ranks map to distinct IDs
+        branchID = std::min(rank, SpreadBranches - 1) * 2654435761u % SpreadBranches;
+      }
+      uint64_t bias = (branchID * 0x9E3779B97F4A7C15ull) >> 54; // taken per 1024, fixed per branch
+      event = branchID << 1 | ((rng() & 1023) < bias);
+    }
+    stream.bulkBits.resize(StreamEvents / BulkOutcomes);
+    for (uint64_t i = 0; i < StreamEvents; i++) {
+      stream.bulkBits[i / BulkOutcomes] |= (stream.events[i] & 1) << (i % BulkOutcomes);
+    }
+    return stream;
+  }
+
+  double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() - 1, size_t(p * double(sorted.size())))];
+  }
+
+  // Runs in the forked child
+  void measure(const Entry &E, const Stream &stream, unsigned threads, const Options &options) {
+    uint64_t batches = std::max<uint64_t>(1, options.events / options.batch);
+    std::vector<Samples> samples(threads);
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+      workers.emplace_back([&, t] {
+        Work W = {&stream, t * (StreamEvents / threads), batches, batches / 10, options.batch};
+        ready++;
+        // Yielding, so that waiting threads leave an oversubscribed core to the others
+        while (!go.load()) std::this_thread::yield();
+        E.run(W, samples[t]);
+      });
+    }
+    // The clock starts once every thread exists, so thread creation is not timed
+    while (ready.load() < threads) std::this_thread::yield();
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (std::thread &worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Samples all;
+    for (const Samples &S : samples) {
+      all.ns.insert(all.ns.end(), S.ns.begin(), S.ns.end());
+      all.cycles.insert(all.cycles.end(), S.cycles.begin(), S.cycles.end());
+    }
+    std::sort(all.ns.begin(), all.ns.end());
+    std::sort(all.cycles.begin(), all.cycles.end());
+    uint64_t events = uint64_t(threads) * (batches + batches / 10) * options.batch;
+    std::printf("%s,%s,%u,%u,%llu,%.2f,%.2f,%.2f,%.2f,%.1f,%.1f,%.1f,%.2f\n", E.name, stream.name.c_str(), threads,
+                std::thread::hardware_concurrency(), (unsigned long long)events, percentile(all.ns, 0.5), percentile(all.ns, 0.9),
+                percentile(all.ns, 0.99), all.ns.empty() ? 0.0 : all.ns.back(), percentile(all.cycles, 0.5),
+                percentile(all.cycles, 0.9), percentile(all.cycles, 0.99), events / seconds / 1e6);
+    std::fflush(stdout);
+  }
+
+  std::vector<std::string> splitList(const char *list) {
+    std::vector<std::string> items;
+    std::string item;
+    for (const char *p = list;; p++) {
+      if (*p == ',' || !*p) {
+        if (!item.empty()) items.push_back(item);
+        item.clear();
+        if (!*p) break;
+      } else {
+        item += *p;
+      }
+    }
+    return items;
+  }
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [--events N] [--batch N] [--threads N] [--zipf-s S]"
+              << " [--entries NAME,...] [--distributions NAME,...]" << std::endl;
+    std::cerr << "Entries:";
+    for (const Entry &E : allEntries()) std::cerr << " " << E.name;
+    std::cerr << "\nDistributions: hot uniform zipf" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--events" && i + 1 < argc) {
+      options.events = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--batch" && i + 1 < argc) {
+      options.batch = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      options.threads = unsigned(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--zipf-s" && i + 1 < argc) {
+      options.zipfS = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--entries" && i + 1 < argc) {
+      options.entries = splitList(argv[++i]);
+    } else if (arg == "--distributions" && i + 1 < argc) {
+      options.distributions = splitList(argv[++i]);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (options.batch < BulkOutcomes || options.threads == 0) {
+    std::cerr << "--batch must be at least " << BulkOutcomes << " and --threads at least 1" << std::endl;
+    return 1;
+  }
+
+  std::vector<const Entry *> entries;
+  for (const Entry &E : allEntries()) {
+    if (options.entries.empty() || std::find(options.entries.begin(), options.entries.end(), E.name) != options.entries.end()) {
+      entries.push_back(&E);
+    }
+  }
+  for (const std::string &name : options.entries) {
+    if (std::none_of(entries.begin(), entries.end(), [&](const Entry *E) { return name == E->name; })) {
+      std::cerr << "Unknown entry " << name << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  std::vector<Stream> streams;
+  for (const std::string &name : options.distributions) {
+    if (name != "hot" && name != "uniform" && name != "zipf") {
+      std::cerr << "Unknown distribution " << name << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+    streams.push_back(makeStream(name, options.zipfS));
+  }
+  std::vector<unsigned> threadCounts;
+  for (unsigned threads = 1; threads < options.threads; threads *= 2) threadCounts.push_back(threads);
+  threadCounts.push_back(options.threads);
+
+  std::printf("entry,distribution,threads,hardware_threads,events,ns_p50,ns_p90,ns_p99,ns_max,cycles_p50,cycles_p90,cycles_p99,"
+              "mevents_per_s\n");
+  std::fflush(stdout);
+  for (const Entry *E : entries) {
+    for (const Stream &stream : streams) {
+      for (unsigned threads : threadCounts) {
+        if (threads > 1 && !E->threadSafe) continue;
+        pid_t pid = fork();
+        if (pid == 0) {
+          std::string programName = std::string("runtime_bench_") + E->name + "_" + stream.name;
+          setenv("PROGRAM_NAME", programName.c_str(), 1);
+          measure(*E, stream, threads, options);
+          std::exit(0); // the runtime's exit handler writes the trace
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+          std::cerr << E->name << " on " << stream.name << " with " << threads << " threads failed" << std::endl;
+        }
+      }
+    }
+  }
+  return 0;
+}
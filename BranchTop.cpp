@@ -0,0 +1,258 @@
+#include "BranchLiveCounters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+    - Live "top" for branches: attaches read-only to the counter segment of a program
+      running with BRANCH_HISTORY_SHM=1 (not in the shards or atomic modes, see
+      BranchLiveCounters.h) and redraws the hottest or least predictable branches every
+      interval, until the program exits.
+    - Rates are over the last interval. Estimated mispredictions are the fewer of the
+      interval's outcome transitions (what a last-outcome predictor misses) and minority
+      outcomes (what the best static prediction misses).
+    - The target is a pid, a program name (when exactly one such process is live) or a
+      segment name; without one the live segments are listed.
+    - Usage: BranchTop [--interval MS] [--top N] [--sort hot|unpredictable] [--once] [target]
+*/
+
+namespace {
+  struct Options {
+    unsigned intervalMs = 1000;
+    size_t top = 20;
+    bool byMispredictions = false;
+    bool once = false;
+  };
+
+  struct Segment {
+    std::string name; // without the leading '/'
+    uint64_t pid;
+  };
+
+  struct Row {
+    uint64_t branchID;
+    uint64_t executions;   // in the interval
+    uint64_t taken;
+    uint64_t mispredictions;
+    uint64_t total;        // since the start
+  };
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [--interval MS] [--top N] [--sort hot|unpredictable] [--once] [target]"
+              << std::endl;
+  }
+
+  // Segments are named branch_history_<program>_<pid> in /dev/shm
+  std::vector<Segment> listSegments() {
+    std::vector<Segment> segments;
+    DIR *dir = opendir("/dev/shm");
+    if (!dir) return segments;
+    while (dirent *entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      size_t underscore = name.rfind('_');
+      if (name.compare(0, 15, "branch_history_") != 0 || underscore == std::string::npos) continue;
+      segments.push_back({name, std::strtoull(name.c_str() + underscore + 1, nullptr, 10)});
+    }
+    closedir(dir);
+    std::sort(segments.begin(), segments.end(), [](const Segment &a, const Segment &b) { return a.pid < b.pid; });
+    return segments;
+  }
+
+  std::string programOf(const Segment &S) {
+    return S.name.substr(15, S.name.rfind('_') - 15);
+  }
+
+  // Read-only view of a segment that follows the runtime's remaps
+  class LiveCounterView {
+  public:
+    ~LiveCounterView() {
+      if (Map) munmap(Map, Mapped);
+      if (Fd >= 0) close(Fd);
+    }
+
+    bool open(const std::string &name) {
+      Fd = shm_open(name.c_str(), O_RDONLY, 0);
+      if (Fd < 0 || !remap()) return false;
+      return Mapped >= sizeof(LiveCounterHeader) &&
+             std::memcmp(header()->magic, LiveCounterMagic, sizeof(LiveCounterMagic)) == 0;
+    }
+
+    const LiveCounterHeader *header() const { return static_cast<const LiveCounterHeader *>(Map); }
+
+    // Copies the slots under the seqlock; false if the runtime kept resizing
+    bool snapshot(std::vector<LiveBranchCounts> &slots) {
+      for (unsigned attempt = 0; attempt < 1000; attempt++) {
+        uint64_t before = header()->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+          continue;
+        }
+        uint64_t capacity = header()->capacity;
+        if (liveCounterBytes(capacity) > Mapped) {
+          if (!remap()) return false;
+          continue;
+        }
+        const LiveBranchCounts *first = reinterpret_cast<const LiveBranchCounts *>(header() + 1);
+        slots.assign(first, first + capacity);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header()->sequence.load(std::memory_order_relaxed) == before) return true;
+      }
+      return false;
+    }
+
+  private:
+    int Fd = -1;
+    void *Map = nullptr;
+    size_t Mapped = 0;
+
+    bool remap() {
+      struct stat st;
+      if (fstat(Fd, &st) != 0 || st.st_size <= 0) return false;
+      if (Map) munmap(Map, Mapped);
+      Mapped = size_t(st.st_size);
+      Map = mmap(nullptr, Mapped, PROT_READ, MAP_SHARED, Fd, 0);
+      if (Map == MAP_FAILED) {
+        Map = nullptr;
+        Mapped = 0;
+        return false;
+      }
+      return true;
+    }
+  };
+
+  void draw(const LiveCounterHeader *H, const std::vector<LiveBranchCounts> &now,
+            const std::vector<LiveBranchCounts> &before, double seconds, const Options &options) {
+    std::vector<Row> rows;
+    uint64_t total = 0, interval = 0;
+    for (size_t id = 0; id < now.size(); id++) {
+      const LiveBranchCounts &N = now[id];
+      if (!N.executions) continue;
+      LiveBranchCounts B = id < before.size() ? before[id] : LiveBranchCounts{0, 0, 0, 0};
+      uint64_t executions = N.executions - B.executions, taken = N.taken - B.taken;
+      uint64_t minority = std::min(taken, executions - taken);
+      rows.push_back({id, executions, taken, std::min(N.transitions - B.transitions, minority), N.executions});
+      total += N.executions;
+      interval += executions;
+    }
+    auto key = [&](const Row &R) { return options.byMispredictions ? R.mispredictions : R.executions; };
+    size_t shown = std::min(options.top, rows.size());
+    std::partial_sort(rows.begin(), rows.begin() + shown, rows.end(), [&](const Row &a, const Row &b) {
+      return key(a) != key(b) ? key(a) > key(b) : a.total > b.total;
+    });
+
+    double uptime = double(std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::system_clock::now().time_since_epoch()).count() - int64_t(H->startTimeUs)) /
+                    1e6;
+    if (!options.once) std::cout << "\033[H\033[2J";
+    std::cout << H->programName << " (pid " << H->pid << ")  up " << std::fixed << std::setprecision(1) << uptime
+              << " s  branches " << rows.size() << "  events " << total << "  events/s "
+              << std::setprecision(0) << (seconds > 0 ? interval / seconds : 0.0) << "\n\n";
+    std::cout << std::setw(10) << "branch_id" << std::setw(14) << "exec/s" << std::setw(16) << "executions"
+              << std::setw(9) << "taken%" << std::setw(14) << "mispred/s" << std::setw(10) << "mispred%" << "\n";
+    for (size_t i = 0; i < shown; i++) {
+      const Row &R = rows[i];
+      double rate = seconds > 0 ? 1.0 / seconds : 0.0;
+      std::cout << std::setw(10) << R.branchID << std::setw(14) << std::setprecision(0) << R.executions * rate
+                << std::setw(16) << R.total << std::setw(9) << std::setprecision(1)
+                << (R.executions ? 100.0 * R.taken / R.executions : 0.0) << std::setw(14) << std::setprecision(0)
+                << R.mispredictions * rate << std::setw(10) << std::setprecision(1)
+                << (R.executions ? 100.0 * R.mispredictions / R.executions : 0.0) << "\n";
+    }
+    std::cout << std::flush;
+  }
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  std::string target;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--interval" && i + 1 < argc) {
+      options.intervalMs = unsigned(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--top" && i + 1 < argc) {
+      options.top = size_t(std::strtoull(argv[++i], nullptr, 10));
+    } else if (arg == "--sort" && i + 1 < argc) {
+      std::string key = argv[++i];
+      if (key != "hot" && key != "unpredictable") {
+        usage(argv[0]);
+        return 1;
+      }
+      options.byMispredictions = key == "unpredictable";
+    } else if (arg == "--once") {
+      options.once = true;
+    } else if (arg.compare(0, 2, "--") == 0 || !target.empty()) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      target = arg;
+    }
+  }
+  if (options.intervalMs == 0) options.intervalMs = 1;
+
+  std::vector<Segment> segments = listSegments();
+  if (target.empty()) {
+    std::cout << "pid,program,segment\n";
+    for (const Segment &S : segments) std::cout << S.pid << "," << programOf(S) << ",/" << S.name << "\n";
+    return 0;
+  }
+
+  std::string name;
+  if (target[0] == '/') {
+    name = target;
+  } else {
+    bool isPid = target.find_first_not_of("0123456789") == std::string::npos;
+    std::vector<const Segment *> matches;
+    for (const Segment &S : segments) {
+      if (isPid ? std::to_string(S.pid) == target : programOf(S) == target) matches.push_back(&S);
+    }
+    if (matches.size() != 1) {
+      std::cerr << (matches.empty() ? "No live counters for " : "Several processes match ") << target
+                << "; run " << argv[0] << " without a target to list them" << std::endl;
+      return 1;
+    }
+    name = "/" + matches[0]->name;
+  }
+
+  LiveCounterView view;
+  if (!view.open(name)) {
+    std::cerr << "Failed to attach to " << name << std::endl;
+    return 1;
+  }
+
+  // The first frame is measured from the start of the program
+  std::vector<LiveBranchCounts> before, now;
+  auto previous = std::chrono::system_clock::time_point(std::chrono::microseconds(view.header()->startTimeUs));
+  while (true) {
+    if (!options.once) std::this_thread::sleep_for(std::chrono::milliseconds(options.intervalMs));
+    bool exited = view.header()->exited.load(std::memory_order_acquire) != 0 ||
+                  kill(pid_t(view.header()->pid), 0) != 0;
+    if (!view.snapshot(now)) {
+      std::cerr << "Failed to read " << name << std::endl;
+      return 1;
+    }
+    auto current = std::chrono::system_clock::now();
+    draw(view.header(), now, before, std::chrono::duration<double>(current - previous).count(), options);
+    if (options.once) return 0;
+    if (exited) {
+      std::cout << "\nProcess " << view.header()->pid << " exited" << std::endl;
+      return 0;
+    }
+    before.swap(now);
+    previous = current;
+  }
+}
@@ -0,0 +1,856 @@
+#ifndef BRANCH_TRACE_H
+#define BRANCH_TRACE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "BranchTraceFormat.h"
+
+/*
+    - Shared trace reading for the offline C++ tools.
+    - Text logs are the "<branch_id>,<taken>" lines written by DynamicLog.cpp; binary
+      traces (see BranchTraceFormat.h) are recognised by their magic and decoded transparently.
+    - An optional leading header line (anything not starting with a digit) is skipped,
+      matching the next(f) in combine_properties.py without dropping a real event.
+    - Text logs are memory-mapped and split at newline boundaries across threads. Each
+      thread finds newlines 64 bytes at a time with SSE2 compares and converts IDs of up
+      to 8 digits with SWAR arithmetic on one 8-byte load; any line that is not a plain
+      "<id>,<digit>" record goes through TextEventParser, so results match the streaming
+      parser exactly.
+    - TraceReader gives random access through the trace index (embedded in binary traces,
+      a "<trace>.idx" sidecar for text logs): seek to an event, decode blocks on worker
+      threads in order, or count a range of events from the per-block summaries.
+    - A segment manifest (a trace rotated by the runtime) reads as the concatenation of
+      its remaining segments; forEachTraceSegment runs per-segment work in parallel.
+    - PackedOutcomes holds one branch's outcome stream, 64 executions per word
+      (execution i is bit i % 64 of word i / 64). Packed (branch-major) traces store
+      exactly these words, so PackedTraceReader loads one branch with a single read.
+*/
+
+struct BranchEvent {
+  uint64_t branchID;
+  bool taken;
+};
+
+// Incremental parser for text logs; feed() may split the input anywhere
+class TextEventParser {
+public:
+  // atFileStart: the input begins at the start of the file, where a header may sit
+  explicit TextEventParser(bool atFileStart = true) : AtFileStart(atFileStart) {}
+
+  // File offset just past the line of the event being reported
+  uint64_t lineEnd() const { return LineEnd; }
+
+  // Parses [p, end), which starts at file offset base
+  template <typename Callback>
+  void feed(const char *p, const char *end, uint64_t base, Callback &&cb) {
+    for (const char *c = p; c < end; c++) {
+      char ch = *c;
+      if (AtFileStart) {
+        AtFileStart = false;
+        SkipLine = !(ch >= '0' && ch <= '9');
+      }
+      if (ch == '\n') {
+        if (!SkipLine && Field >= 1 && HaveDigits) {
+          LineEnd = base + uint64_t(c - p) + 1;
+          cb(ID, Taken);
+        }
+        ID = 0;
+        Field = 0;
+        HaveDigits = false;
+        Taken = false;
+        SkipLine = false;
+        continue;
+      }
+      if (SkipLine) continue;
+      if (Field == 0) {
+        if (ch >= '0' && ch <= '9') {
+          ID = ID * 10 + uint64_t(ch - '0');
+        } else if (ch == ',') {
+          Field = 1;
+          HaveDigits = false;
+        }
+      } else if (Field == 1) {
+        if (ch >= '0' && ch <= '9') {
+          Taken = ch != '0';
+          HaveDigits = true;
+        } else if (ch != '\r' && ch != ' ') {
+          Field = 2; // extra columns are ignored
+        }
+      }
+    }
+  }
+
+  // Reports a last line without a trailing newline; the input ended at file offset end
+  template <typename Callback>
+  void finish(uint64_t end, Callback &&cb) {
+    if (!SkipLine && Field >= 1 && HaveDigits) {
+      LineEnd = end;
+      cb(ID, Taken);
+    }
+    Field = 0;
+    HaveDigits = false;
+  }
+
+private:
+  uint64_t ID = 0;
+  uint64_t LineEnd = 0;
+  int Field = 0; // 0 = branch ID, 1 = taken, 2 = skipping rest of line
+  bool HaveDigits = false;
+  bool Taken = false;
+  bool AtFileStart;
+  bool SkipLine = false;
+};
+
+inline unsigned traceDecodeThreads() {
+  const char *env = std::getenv("BRANCH_TRACE_THREADS");
+  if (env && std::atoi(env) > 0) return unsigned(std::atoi(env));
+  unsigned n = std::thread::hardware_concurrency();
+  return n ? n : 1;
+}
+
+// Bit i set where p[i] == c, for the 64 bytes at p
+inline uint64_t byteMask64(const char *p, char c) {
+#if defined(__SSE2__)
+  const __m128i needle = _mm_set1_epi8(c);
+  uint64_t mask = 0;
+  for (unsigned i = 0; i < 4; i++) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+    mask |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)))) << (16 * i);
+  }
+  return mask;
+#else
+  uint64_t mask = 0;
+  for (unsigned i = 0; i < 64; i++) mask |= uint64_t(p[i] == c) << i;
+  return mask;
+#endif
+}
+
+// Parses the 1..8 ASCII digits at p, with at least 8 readable bytes; false if any
+// of the first len bytes is not a digit
+inline bool parseDigitsSwar(const char *p, unsigned len, uint64_t &value) {
+  uint64_t chunk;
+  std::memcpy(&chunk, p, sizeof(chunk));
+  // Right-align the digits (first digit lands in byte 8 - len); the freed low bytes
+  // become zero digits after the subtraction below
+  unsigned shift = 8 * (8 - len);
+  uint64_t keep = ~uint64_t(0) >> shift;
+  chunk = ((chunk & keep) << shift) | (0x3030303030303030ull & ~(~uint64_t(0) << shift));
+  if (((chunk + 0x4646464646464646ull) | (chunk - 0x3030303030303030ull)) & 0x8080808080808080ull) return false;
+  uint64_t v = chunk - 0x3030303030303030ull;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+       (((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+  value = v;
+  return true;
+}
+
+// Parses the text in [begin, end) of a mapped log, calling cb(branchID, taken) per event.
+// The range must start at a line boundary; atFileStart allows a header line.
+template <typename Callback>
+void parseTextRange(const char *begin, const char *end, bool atFileStart, Callback &&cb) {
+  const char *lineStart = begin;
+  if (atFileStart && begin < end && !(*begin >= '0' && *begin <= '9')) {
+    const char *nl = static_cast<const char *>(std::memchr(begin, '\n', size_t(end - begin)));
+    lineStart = nl ? nl + 1 : end;
+  }
+
+  const char *p = lineStart;
+  for (; end - p >= 64; p += 64) {
+    uint64_t newlines = byteMask64(p, '\n');
+    while (newlines) {
+      const char *nl = p + __builtin_ctzll(newlines);
+      newlines &= newlines - 1;
+      // Fast path: "<1-8 digits>,<digit>\n", checked backwards from the newline so
+      // that consecutive lines do not depend on each other
+      uint64_t id;
+      ptrdiff_t idLen = nl - 2 - lineStart;
+      if (idLen >= 1 && idLen <= 8 && nl[-2] == ',' && nl[-1] >= '0' && nl[-1] <= '9' && end - lineStart >= 8 &&
+          parseDigitsSwar(lineStart, unsigned(idLen), id)) {
+        cb(id, nl[-1] != '0');
+        lineStart = nl + 1;
+        continue;
+      }
+      // Anything else (long IDs, extra columns, '\r', blank lines) takes the scalar parser
+      TextEventParser parser(false);
+      parser.feed(lineStart, nl + 1, 0, cb);
+      lineStart = nl + 1;
+    }
+  }
+  // Tail shorter than one SIMD block, including a last line without a newline
+  TextEventParser parser(false);
+  parser.feed(lineStart, end, 0, cb);
+  parser.finish(0, cb);
+}
+
+// Memory-maps a text log and calls cb(branchID, taken) for every event in order,
+// parsing windows of the file on up to `threads` workers. Returns false if the file
+// cannot be mapped (callers fall back to reading it).
+template <typename Callback>
+bool forEachMappedTextEvent(const std::string &path, unsigned threads, Callback &&cb) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+  size_t size = size_t(st.st_size);
+  if (size == 0) {
+    ::close(fd);
+    return true;
+  }
+  void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) return false;
+  madvise(map, size, MADV_SEQUENTIAL);
+  const char *data = static_cast<const char *>(map), *end = data + size;
+
+  if (threads <= 1) {
+    parseTextRange(data, end, true, cb);
+    munmap(map, size);
+    return true;
+  }
+
+  // Windows of threads * SliceBytes, each slice cut just after a newline
+  const size_t SliceBytes = size_t(8) << 20;
+  std::vector<std::vector<BranchEvent>> decoded(threads);
+  const char *p = data;
+  while (p < end) {
+    std::vector<const char *> cuts{p};
+    for (unsigned t = 0; t < threads && cuts.back() < end; t++) {
+      const char *cut = cuts.back() + std::min(SliceBytes, size_t(end - cuts.back()));
+      if (cut < end) {
+        const char *nl = static_cast<const char *>(std::memchr(cut, '\n', size_t(end - cut)));
+        cut = nl ? nl + 1 : end;
+      }
+      cuts.push_back(cut);
+    }
+    size_t count = cuts.size() - 1;
+    auto work = [&](size_t i) {
+      decoded[i].clear();
+      parseTextRange(cuts[i], cuts[i + 1], cuts[i] == data,
+                     [&](uint64_t id, bool taken) { decoded[i].push_back({id, taken}); });
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < count; i++) workers.emplace_back(work, i);
+    work(0);
+    for (std::thread &t : workers) t.join();
+    for (size_t i = 0; i < count; i++) {
+      for (const BranchEvent &E : decoded[i]) cb(E.branchID, E.taken);
+    }
+    p = cuts.back();
+  }
+  munmap(map, size);
+  return true;
+}
+
+// Reads the chunks of an RLE trace whose magic has already been consumed,
+// calling decode(begin, end) on each payload up to the index terminator
+template <typename Decoder>
+bool forEachRleChunk(FILE *f, Decoder &&decode) {
+  std::vector<uint8_t> payload;
+  while (true) {
+    uint64_t bytes = 0;
+    int c = 0;
+    unsigned shift = 0;
+    bool any = false;
+    while ((c = std::fgetc(f)) != EOF) {
+      any = true;
+      bytes |= uint64_t(c & 0x7F) << shift;
+      shift += 7;
+      if (!(c & 0x80)) break;
+    }
+    if (!any) return true;
+    if (c == EOF) return false;
+    if (bytes == 0) return true; // the trace index follows
+    payload.resize(bytes);
+    if (std::fread(payload.data(), 1, bytes, f) != bytes) return false;
+    if (!decode(payload.data(), payload.data() + bytes)) return false;
+  }
+}
+
+struct TraceBranchCount {
+  uint64_t branchID;
+  uint64_t executions;
+  uint64_t taken;
+};
+
+struct TraceBlockInfo {
+  uint64_t eventOffset; // events before this block
+  uint64_t byteOffset;  // file offset of the block (its length prefix in binary traces)
+  uint64_t events;
+  uint64_t bytes;
+  std::vector<TraceBranchCount> branches; // sorted by ID
+};
+
+// Parses a trace index (see BranchTraceFormat.h) including its 16-byte trailer
+inline bool parseTraceIndex(const uint8_t *p, const uint8_t *end, std::vector<TraceBlockInfo> &blocks) {
+  uint64_t byteOffset, count;
+  if (!getVarint(p, end, byteOffset) || !getVarint(p, end, count)) return false;
+  blocks.clear();
+  uint64_t eventOffset = 0;
+  for (uint64_t b = 0; b < count; b++) {
+    TraceBlockInfo B{eventOffset, byteOffset, 0, 0, {}};
+    uint64_t branches;
+    if (!getVarint(p, end, B.events) || !getVarint(p, end, B.bytes) || !getVarint(p, end, branches) ||
+        branches > uint64_t(end - p)) {
+      return false;
+    }
+    uint64_t id = 0;
+    B.branches.resize(branches);
+    for (TraceBranchCount &C : B.branches) {
+      uint64_t delta;
+      if (!getVarint(p, end, delta) || !getVarint(p, end, C.executions) || !getVarint(p, end, C.taken)) {
+        return false;
+      }
+      id += delta;
+      C.branchID = id;
+    }
+    eventOffset += B.events;
+    byteOffset += B.bytes;
+    blocks.push_back(std::move(B));
+  }
+  return end - p == 16;
+}
+
+// Loads the index whose trailer ends file f; false if there is none
+inline bool loadTraceIndex(FILE *f, std::vector<TraceBlockInfo> &blocks) {
+  uint8_t trailer[16];
+  if (fseeko(f, -off_t(sizeof(trailer)), SEEK_END) != 0 ||
+      std::fread(trailer, 1, sizeof(trailer), f) != sizeof(trailer) ||
+      std::memcmp(trailer + 8, TraceIndexMagic, sizeof(TraceIndexMagic)) != 0) {
+    return false;
+  }
+  uint64_t indexOffset = 0;
+  for (unsigned i = 0; i < 8; i++) indexOffset |= uint64_t(trailer[i]) << (8 * i);
+  off_t size = ftello(f);
+  if (size < 0 || indexOffset > uint64_t(size)) return false;
+  std::vector<uint8_t> index(size_t(uint64_t(size) - indexOffset));
+  if (fseeko(f, off_t(indexOffset), SEEK_SET) != 0 || std::fread(index.data(), 1, index.size(), f) != index.size()) {
+    return false;
+  }
+  return parseTraceIndex(index.data(), index.data() + index.size(), blocks);
+}
+
+// Reads the runtime's statistics footer (see BranchTraceFormat.h) from a binary trace or
+// a text log's sidecar. Returns false if there is none.
+inline bool loadTraceStats(const std::string &path, std::string &stats) {
+  FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f) return false;
+  uint8_t magic[8];
+  size_t magicBytes = std::fread(magic, 1, sizeof(magic), f);
+  if (!isRleTrace(magic, magicBytes) && !isBlockTrace(magic, magicBytes)) {
+    std::fclose(f);
+    f = std::fopen((path + ".idx").c_str(), "rb");
+    if (!f) return false;
+  }
+  uint8_t trailer[16];
+  uint64_t indexOffset = 0, statsBytes = 0;
+  bool ok = fseeko(f, -off_t(sizeof(trailer)), SEEK_END) == 0 &&
+            std::fread(trailer, 1, sizeof(trailer), f) == sizeof(trailer) &&
+            std::memcmp(trailer + 8, TraceIndexMagic, sizeof(TraceIndexMagic)) == 0;
+  for (unsigned i = 0; ok && i < 8; i++) indexOffset |= uint64_t(trailer[i]) << (8 * i);
+  ok = ok && indexOffset >= sizeof(trailer) && fseeko(f, off_t(indexOffset - sizeof(trailer)), SEEK_SET) == 0 &&
+       std::fread(trailer, 1, sizeof(trailer), f) == sizeof(trailer) &&
+       std::memcmp(trailer + 8, TraceStatsMagic, sizeof(TraceStatsMagic)) == 0;
+  for (unsigned i = 0; ok && i < 8; i++) statsBytes |= uint64_t(trailer[i]) << (8 * i);
+  ok = ok && statsBytes <= indexOffset - sizeof(trailer) &&
+       fseeko(f, off_t(indexOffset - sizeof(trailer) - statsBytes), SEEK_SET) == 0;
+  if (ok) {
+    stats.resize(statsBytes);
+    ok = std::fread(&stats[0], 1, statsBytes, f) == statsBytes;
+  }
+  std::fclose(f);
+  return ok;
+}
+
+// Random access to any trace format through its block index
+class TraceReader {
+public:
+  enum class Format { Text, Rle, Block };
+
+  ~TraceReader() {
+    if (File) std::fclose(File);
+  }
+
+  // Opens the trace and loads its index: the embedded one, else a "<path>.idx" sidecar
+  // that matches the file, else (binary traces only) one rebuilt from the length
+  // prefixes without branch summaries. Returns false if the file cannot be opened.
+  bool open(const std::string &path) {
+    File = std::fopen(path.c_str(), "rb");
+    if (!File) return false;
+    uint8_t header[TextTraceHeaderBytes];
+    size_t headerBytes = std::fread(header, 1, sizeof(header), File);
+    if (isRleTrace(header, headerBytes)) {
+      Fmt = Format::Rle;
+    } else if (isBlockTrace(header, headerBytes)) {
+      Fmt = Format::Block;
+    }
+    Truncated = isTruncatedTrace(header, headerBytes);
+    if (fseeko(File, 0, SEEK_END) != 0) return false;
+    FileSize = uint64_t(ftello(File));
+
+    if (Fmt != Format::Text && loadTraceIndex(File, Blocks)) return true;
+    FILE *sidecar = std::fopen((path + ".idx").c_str(), "rb");
+    if (sidecar) {
+      bool ok = loadTraceIndex(sidecar, Blocks) && matchesFile();
+      std::fclose(sidecar);
+      if (ok) return true;
+      Blocks.clear();
+    }
+    Summarized = false;
+    if (Fmt != Format::Text) scanBlocks();
+    return true;
+  }
+
+  Format format() const { return Fmt; }
+
+  // The runtime flushed this trace from a fatal signal handler (see BranchTraceFormat.h)
+  bool truncated() const { return Truncated; }
+
+  // False when the index lacks per-branch summaries (rebuilt by scanning, or a text
+  // log without a sidecar, which has no blocks at all)
+  bool summarized() const { return Summarized; }
+
+  const std::vector<TraceBlockInfo> &blocks() const { return Blocks; }
+
+  uint64_t events() const { return Blocks.empty() ? 0 : Blocks.back().eventOffset + Blocks.back().events; }
+
+  // Index of the block holding event, or blocks().size() past the end
+  size_t blockContaining(uint64_t event) const {
+    size_t lo = 0, hi = Blocks.size();
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (Blocks[mid].eventOffset + Blocks[mid].events <= event) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  // Decodes blocks [first, last) on up to `threads` workers, calling cb(branchID, taken)
+  // in event order
+  template <typename Callback>
+  bool decode(size_t first, size_t last, unsigned threads, Callback &&cb) {
+    if (threads == 0) threads = 1;
+    std::vector<std::vector<uint8_t>> raw(threads);
+    std::vector<std::vector<BranchEvent>> decoded(threads);
+    std::vector<char> ok(threads);
+    for (size_t batch = first; batch < last; batch += threads) {
+      size_t count = std::min<size_t>(threads, last - batch);
+      for (size_t i = 0; i < count; i++) {
+        if (!readBlock(batch + i, raw[i])) return false;
+      }
+      auto work = [&](size_t i) { ok[i] = decodeRaw(batch + i, raw[i], decoded[i]); };
+      std::vector<std::thread> workers;
+      for (size_t i = 1; i < count; i++) workers.emplace_back(work, i);
+      work(0);
+      for (std::thread &t : workers) t.join();
+      for (size_t i = 0; i < count; i++) {
+        if (!ok[i]) return false;
+        for (const BranchEvent &E : decoded[i]) cb(E.branchID, E.taken);
+      }
+    }
+    return true;
+  }
+
+  // Calls cb(branchID, taken) for events [firstEvent, lastEvent), decoding only the
+  // blocks that overlap the range
+  template <typename Callback>
+  bool decodeRange(uint64_t firstEvent, uint64_t lastEvent, unsigned threads, Callback &&cb) {
+    lastEvent = std::min(lastEvent, events());
+    if (firstEvent >= lastEvent) return true;
+    size_t first = blockContaining(firstEvent), last = blockContaining(lastEvent - 1) + 1;
+    uint64_t event = Blocks[first].eventOffset;
+    return decode(first, last, threads, [&](uint64_t id, bool taken) {
+      if (event >= firstEvent && event < lastEvent) cb(id, taken);
+      event++;
+    });
+  }
+
+  // Per-branch (executions, taken) over events [firstEvent, lastEvent), indexed by
+  // branch ID. Whole blocks come from the index summaries; only the partial blocks
+  // at either end (or every block, without summaries) are decoded.
+  bool countRange(uint64_t firstEvent, uint64_t lastEvent, unsigned threads, std::vector<TraceBranchCount> &counts) {
+    counts.clear();
+    auto add = [&](uint64_t id, uint64_t executions, uint64_t taken) {
+      while (id >= counts.size()) counts.push_back({counts.size(), 0, 0});
+      counts[id].executions += executions;
+      counts[id].taken += taken;
+    };
+    lastEvent = std::min(lastEvent, events());
+    uint64_t event = firstEvent;
+    while (event < lastEvent) {
+      const TraceBlockInfo &B = Blocks[blockContaining(event)];
+      uint64_t blockEnd = std::min(B.eventOffset + B.events, lastEvent);
+      if (Summarized && event == B.eventOffset && blockEnd == B.eventOffset + B.events) {
+        for (const TraceBranchCount &C : B.branches) add(C.branchID, C.executions, C.taken);
+      } else if (!decodeRange(event, blockEnd, threads, [&](uint64_t id, bool taken) { add(id, 1, taken); })) {
+        return false;
+      }
+      event = blockEnd;
+    }
+    return true;
+  }
+
+private:
+  FILE *File = nullptr;
+  Format Fmt = Format::Text;
+  uint64_t FileSize = 0;
+  bool Summarized = true;
+  bool Truncated = false;
+  std::vector<TraceBlockInfo> Blocks;
+
+  bool matchesFile() const {
+    if (Blocks.empty()) return FileSize == 0;
+    const TraceBlockInfo &B = Blocks.back();
+    // Binary traces are followed by their index; text blocks run to the end of the file
+    return Fmt == Format::Text ? B.byteOffset + B.bytes == FileSize : B.byteOffset + B.bytes <= FileSize;
+  }
+
+  bool readVarint(uint64_t &v) {
+    v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      int c = std::fgetc(File);
+      if (c == EOF) return false;
+      v |= uint64_t(c & 0x7F) << shift;
+      if (!(c & 0x80)) return true;
+    }
+    return false;
+  }
+
+  // Fallback for binary traces without an index (e.g. a run that did not reach exit).
+  // Chunk and block payloads both start with their event count.
+  void scanBlocks() {
+    uint64_t eventOffset = 0, byteOffset = sizeof(RleTraceMagic);
+    while (fseeko(File, off_t(byteOffset), SEEK_SET) == 0) {
+      uint64_t bytes, events;
+      if (!readVarint(bytes) || bytes == 0) break;
+      uint64_t payloadStart = uint64_t(ftello(File));
+      if (payloadStart + bytes > FileSize || !readVarint(events)) break;
+      Blocks.push_back({eventOffset, byteOffset, events, payloadStart + bytes - byteOffset, {}});
+      eventOffset += events;
+      byteOffset = payloadStart + bytes;
+    }
+  }
+
+  bool readBlock(size_t block, std::vector<uint8_t> &raw) {
+    const TraceBlockInfo &B = Blocks[block];
+    raw.resize(B.bytes);
+    return fseeko(File, off_t(B.byteOffset), SEEK_SET) == 0 && std::fread(raw.data(), 1, B.bytes, File) == B.bytes;
+  }
+
+  // Safe to run concurrently: reads only the index and its arguments
+  bool decodeRaw(size_t block, const std::vector<uint8_t> &raw, std::vector<BranchEvent> &events) const {
+    const TraceBlockInfo &B = Blocks[block];
+    events.clear();
+    events.reserve(B.events);
+    auto push = [&](uint64_t id, bool taken) { events.push_back({id, taken}); };
+    if (Fmt == Format::Text) {
+      // Only the first block can start with a header line
+      const char *text = reinterpret_cast<const char *>(raw.data());
+      parseTextRange(text, text + raw.size(), B.byteOffset == 0, push);
+      return events.size() == B.events;
+    }
+    const uint8_t *p = raw.data(), *end = p + raw.size();
+    uint64_t bytes;
+    if (!getVarint(p, end, bytes) || bytes != uint64_t(end - p)) return false;
+    bool ok = Fmt == Format::Rle ? decodeRleChunk(p, end, push) : decodeTraceBlock(p, end, push);
+    return ok && events.size() == B.events;
+  }
+};
+
+struct TraceSegmentInfo {
+  uint64_t firstEvent;
+  uint64_t events; // 0 for a segment still open when the manifest was written
+  uint64_t bytes;
+  bool open;
+  bool dropped;
+  std::string path; // resolved against the manifest's directory
+};
+
+// Reads a segment manifest (see BranchTraceFormat.h). Returns false if path is not one.
+inline bool loadTraceManifest(const std::string &path, std::vector<TraceSegmentInfo> &segments) {
+  FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f) return false;
+  char line[4096];
+  if (!std::fgets(line, sizeof(line), f) ||
+      std::strncmp(line, TraceManifestHeader, sizeof(TraceManifestHeader) - 1) != 0) {
+    std::fclose(f);
+    return false;
+  }
+  std::string directory = path.substr(0, path.rfind('/') + 1);
+  segments.clear();
+  while (std::fgets(line, sizeof(line), f)) {
+    unsigned long long segment, firstEvent, events, bytes;
+    char state[16], file[4000];
+    if (!std::strchr(line, '\n') ||
+        std::sscanf(line, "%llu,%llu,%llu,%llu,%15[^,],%3999[^\n]", &segment, &firstEvent, &events, &bytes, state,
+                    file) != 6 ||
+        segment > segments.size()) {
+      continue; // column header, or a row still being appended
+    }
+    TraceSegmentInfo info = {firstEvent, events, bytes, std::strcmp(state, "open") == 0,
+                             std::strcmp(state, "dropped") == 0, directory + file};
+    // A segment's later rows replace its earlier ones
+    if (segment == segments.size()) {
+      segments.push_back(info);
+    } else {
+      segments[segment] = info;
+    }
+  }
+  std::fclose(f);
+  return true;
+}
+
+// Runs fn(segment) for every segment that still exists, on up to `threads` workers.
+// Segments are complete traces, so per-segment work needs no coordination.
+template <typename Fn>
+void forEachTraceSegment(const std::vector<TraceSegmentInfo> &segments, unsigned threads, Fn &&fn) {
+  std::vector<size_t> live;
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (!segments[i].dropped) live.push_back(i);
+  }
+  threads = std::max(1u, std::min<unsigned>(threads, unsigned(live.size())));
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      for (size_t i = t; i < live.size(); i += threads) fn(live[i]);
+    });
+  }
+  for (std::thread &w : workers) w.join();
+}
+
+// Calls cb(branchID, taken) for every event in the trace, or in every remaining
+// segment of a manifest, in order. Returns false if the file cannot be opened or a
+// binary trace is corrupt.
+template <typename Callback>
+bool forEachBranchEvent(const std::string &path, Callback &&cb) {
+  std::vector<TraceSegmentInfo> segments;
+  if (loadTraceManifest(path, segments)) {
+    uint64_t dropped = 0;
+    for (const TraceSegmentInfo &S : segments) {
+      if (S.dropped) {
+        dropped += S.events;
+      } else if (!forEachBranchEvent(S.path, cb)) {
+        return false;
+      }
+    }
+    if (dropped) {
+      std::fprintf(stderr, "Warning: %s: %llu events in dropped segments are missing\n", path.c_str(),
+                   (unsigned long long)dropped);
+    }
+    return true;
+  }
+
+  FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f) {
+    return false;
+  }
+
+  uint8_t magic[8];
+  size_t magicBytes = std::fread(magic, 1, sizeof(magic), f);
+  if (isRleTrace(magic, magicBytes)) {
+    bool ok = forEachRleChunk(f, [&](const uint8_t *begin, const uint8_t *end) {
+      return decodeRleChunk(begin, end, cb);
+    });
+    std::fclose(f);
+    if (!ok) std::fprintf(stderr, "Corrupt RLE trace %s\n", path.c_str());
+    return ok;
+  }
+  if (isPackedTrace(magic, magicBytes)) {
+    std::fclose(f);
+    std::fprintf(stderr, "%s is branch-major and has no event order; use loadPackedStreams\n", path.c_str());
+    return false;
+  }
+  if (isBlockTrace(magic, magicBytes)) {
+    std::fclose(f);
+    TraceReader reader;
+    bool ok = reader.open(path) && reader.decode(0, reader.blocks().size(), traceDecodeThreads(), cb);
+    if (!ok) std::fprintf(stderr, "Corrupt block trace %s\n", path.c_str());
+    return ok;
+  }
+  std::fclose(f);
+  if (forEachMappedTextEvent(path, traceDecodeThreads(), cb)) {
+    return true;
+  }
+
+  // Not mappable (e.g. a pipe): stream it
+  f = std::fopen(path.c_str(), "rb");
+  if (!f) {
+    return false;
+  }
+  std::vector<char> buf(1 << 20);
+  TextEventParser parser;
+  uint64_t offset = 0;
+  size_t n;
+  while ((n = std::fread(buf.data(), 1, buf.size(), f)) > 0) {
+    parser.feed(buf.data(), buf.data() + n, offset, cb);
+    offset += n;
+  }
+  parser.finish(offset, cb); // last line without a trailing newline
+
+  std::fclose(f);
+  return true;
+}
+
+struct PackedOutcomes {
+  std::vector<uint64_t> words;
+  uint64_t size = 0;
+
+  void push(bool taken) {
+    if ((size & 63) == 0) words.push_back(0);
+    words.back() |= uint64_t(taken ? 1 : 0) << (size & 63);
+    size++;
+  }
+
+  // Appends length copies of one outcome, a word at a time
+  void pushRun(bool taken, uint64_t length) {
+    while (length) {
+      if ((size & 63) == 0) words.push_back(0);
+      unsigned offset = unsigned(size & 63);
+      uint64_t n = length < 64 - offset ? length : 64 - offset;
+      if (taken) words.back() |= (n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1) << offset;
+      size += n;
+      length -= n;
+    }
+  }
+
+  bool get(uint64_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+
+  // Bits [64 * word + shift, 64 * word + shift + 64) of the stream, zero past the end
+  uint64_t shiftedWord(uint64_t word, uint64_t shift) const {
+    uint64_t w = word + (shift >> 6);
+    unsigned bits = unsigned(shift & 63);
+    uint64_t lo = w < words.size() ? words[w] >> bits : 0;
+    uint64_t hi = bits && w + 1 < words.size() ? words[w + 1] << (64 - bits) : 0;
+    return lo | hi;
+  }
+};
+
+struct PackedBranchInfo {
+  uint64_t branchID;
+  uint64_t executions;
+  uint64_t taken;
+  uint64_t byteOffset;
+};
+
+// Per-branch access to a packed (branch-major) trace
+class PackedTraceReader {
+public:
+  ~PackedTraceReader() {
+    if (File) std::fclose(File);
+  }
+
+  // Returns false if the file cannot be opened or is not a complete packed trace
+  bool open(const std::string &path) {
+    File = std::fopen(path.c_str(), "rb");
+    if (!File) return false;
+    uint8_t magic[8], trailer[16];
+    if (std::fread(magic, 1, sizeof(magic), File) != sizeof(magic) || !isPackedTrace(magic, sizeof(magic)) ||
+        fseeko(File, -off_t(sizeof(trailer)), SEEK_END) != 0 ||
+        std::fread(trailer, 1, sizeof(trailer), File) != sizeof(trailer) ||
+        std::memcmp(trailer + 8, PackedDirectoryMagic, sizeof(PackedDirectoryMagic)) != 0) {
+      return false;
+    }
+    uint64_t directoryOffset = 0;
+    for (unsigned i = 0; i < 8; i++) directoryOffset |= uint64_t(trailer[i]) << (8 * i);
+    uint64_t size = uint64_t(ftello(File));
+    if (directoryOffset > size - sizeof(trailer)) return false;
+    std::vector<uint8_t> directory(size - sizeof(trailer) - directoryOffset);
+    if (fseeko(File, off_t(directoryOffset), SEEK_SET) != 0 ||
+        std::fread(directory.data(), 1, directory.size(), File) != directory.size()) {
+      return false;
+    }
+    const uint8_t *p = directory.data(), *end = p + directory.size();
+    uint64_t count;
+    if (!getVarint(p, end, count) || count > directory.size()) return false;
+    Branches.resize(count);
+    for (PackedBranchInfo &B : Branches) {
+      if (!getVarint(p, end, B.branchID) || !getVarint(p, end, B.executions) || !getVarint(p, end, B.taken) ||
+          !getVarint(p, end, B.byteOffset) || B.byteOffset + (B.executions + 63) / 64 * 8 > directoryOffset) {
+        return false;
+      }
+    }
+    return p == end;
+  }
+
+  // Sorted by branch ID
+  const std::vector<PackedBranchInfo> &branches() const { return Branches; }
+
+  bool load(const PackedBranchInfo &B, PackedOutcomes &stream) {
+    stream.size = B.executions;
+    stream.words.resize((B.executions + 63) / 64);
+    return fseeko(File, off_t(B.byteOffset), SEEK_SET) == 0 &&
+           std::fread(stream.words.data(), sizeof(uint64_t), stream.words.size(), File) == stream.words.size();
+  }
+
+private:
+  FILE *File = nullptr;
+  std::vector<PackedBranchInfo> Branches;
+};
+
+// Calls cb(branchID, taken, runLength) for every outcome run of every branch.
+// Runs of one branch arrive in execution order, but branches are not interleaved
+// in event order. RLE traces are served straight from their run streams; other
+// formats report one event per call.
+template <typename Callback>
+bool forEachBranchRun(const std::string &path, Callback &&cb) {
+  FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f) {
+    return false;
+  }
+  uint8_t magic[8];
+  size_t magicBytes = std::fread(magic, 1, sizeof(magic), f);
+  if (isRleTrace(magic, magicBytes)) {
+    bool ok = forEachRleChunk(f, [&](const uint8_t *begin, const uint8_t *end) {
+      return decodeRleChunkRuns(begin, end, cb);
+    });
+    std::fclose(f);
+    if (!ok) std::fprintf(stderr, "Corrupt RLE trace %s\n", path.c_str());
+    return ok;
+  }
+  std::fclose(f);
+  return forEachBranchEvent(path, [&](uint64_t branchID, bool taken) { cb(branchID, taken, 1); });
+}
+
+// Splits a trace into one packed outcome stream per branch ID, in memory.
+// Returns false if the file cannot be opened.
+inline bool loadPackedStreams(const std::string &path, std::vector<PackedOutcomes> &streams) {
+  PackedTraceReader packed;
+  if (packed.open(path)) {
+    for (const PackedBranchInfo &B : packed.branches()) {
+      if (B.branchID >= streams.size()) {
+        streams.resize(B.branchID + 1);
+      }
+      if (!packed.load(B, streams[B.branchID])) return false;
+    }
+    return true;
+  }
+  return forEachBranchRun(path, [&](uint64_t branchID, bool taken, uint64_t length) {
+    if (branchID >= streams.size()) {
+      streams.resize(branchID + 1);
+    }
+    streams[branchID].pushRun(taken, length);
+  });
+}
+
+#endif // BRANCH_TRACE_H
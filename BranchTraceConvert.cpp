@@ -0,0 +1,140 @@
+#include "BranchTrace.h"
+#include "BranchTraceFormat.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+    - Converts branch traces between formats. The input format is detected from the file
+      itself (text or any binary format in BranchTraceFormat.h).
+    - Output formats: text ("<branch_id>,<taken>" lines), rle (per-branch run lengths
+      plus a successor-predicted interleaving stream) and block (move-to-front symbols,
+      order-1 rANS, seekable and decoded in parallel).
+    - Text input is parsed from a memory map on BRANCH_TRACE_THREADS workers (default: all
+      cores), so legacy logs convert at memory speed.
+    - Every output carries a trace index; text output gets it as an "<output>.idx" sidecar,
+      and the runtime's "# branch_history status=complete" header line.
+    - Usage: BranchTraceConvert --format text|rle|block <input> <output>
+*/
+
+namespace {
+  constexpr uint64_t RleChunkEvents = 1 << 20;
+  constexpr uint64_t BlockEvents = 1 << 20;
+  constexpr uint64_t TextIndexEvents = 1 << 20;
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " --format text|rle|block <input> <output>" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  std::string format;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--format" && i + 1 < argc) {
+      format = argv[++i];
+    } else if (arg.compare(0, 2, "--") == 0) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 2 || (format != "text" && format != "rle" && format != "block")) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  FILE *out = std::fopen(positional[1].c_str(), "wb");
+  if (!out) {
+    std::cerr << "Failed to open " << positional[1] << std::endl;
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t events = 0;
+  bool ok;
+  if (format == "text") {
+    std::vector<char> buf;
+    buf.reserve(1 << 20);
+    char line[32];
+    TraceIndexBuilder index;
+    // The runtime's header, so readers that skip a first line lose no event
+    std::string header = std::string(TextTraceHeaderPrefix) + TextTraceStatus[1] + "\n";
+    buf.insert(buf.end(), header.begin(), header.end());
+    uint64_t written = header.size(), blockStart = 0;
+    ok = forEachBranchEvent(positional[0], [&](uint64_t branchID, bool taken) {
+      int n = std::snprintf(line, sizeof(line), "%llu,%d\n", (unsigned long long)branchID, taken ? 1 : 0);
+      buf.insert(buf.end(), line, line + n);
+      written += uint64_t(n);
+      index.add(branchID, taken);
+      if (index.blockEvents() == TextIndexEvents) {
+        index.finishBlock(written - blockStart);
+        blockStart = written;
+      }
+      if (buf.size() >= (1 << 20) - 32) {
+        std::fwrite(buf.data(), 1, buf.size(), out);
+        buf.clear();
+      }
+      events++;
+    });
+    std::fwrite(buf.data(), 1, buf.size(), out);
+    index.finishBlock(written - blockStart);
+
+    std::vector<uint8_t> sidecar;
+    index.write(sidecar, 0, 0);
+    std::string indexPath = positional[1] + ".idx";
+    FILE *indexFile = std::fopen(indexPath.c_str(), "wb");
+    if (!indexFile || std::fwrite(sidecar.data(), 1, sidecar.size(), indexFile) != sidecar.size()) {
+      std::cerr << "Failed to write " << indexPath << std::endl;
+      ok = false;
+    }
+    if (indexFile) std::fclose(indexFile);
+  } else if (format == "block") {
+    BlockTraceEncoder encoder;
+    std::vector<uint8_t> buf;
+    encoder.start(buf);
+    ok = forEachBranchEvent(positional[0], [&](uint64_t branchID, bool taken) {
+      encoder.add(branchID, taken);
+      if (encoder.events() == BlockEvents) {
+        encoder.finishBlock(buf);
+        std::fwrite(buf.data(), 1, buf.size(), out);
+        buf.clear();
+      }
+      events++;
+    });
+    encoder.finish(buf);
+    std::fwrite(buf.data(), 1, buf.size(), out);
+  } else {
+    RleTraceEncoder encoder;
+    std::vector<uint8_t> buf;
+    encoder.start(buf);
+    ok = forEachBranchEvent(positional[0], [&](uint64_t branchID, bool taken) {
+      encoder.add(branchID, taken);
+      if (encoder.events() == RleChunkEvents) {
+        encoder.finishChunk(buf);
+        std::fwrite(buf.data(), 1, buf.size(), out);
+        buf.clear();
+      }
+      events++;
+    });
+    encoder.finish(buf);
+    std::fwrite(buf.data(), 1, buf.size(), out);
+  }
+
+  long bytes = std::ftell(out);
+  if (std::ferror(out)) ok = false;
+  if (std::fclose(out) != 0) ok = false;
+  if (!ok) {
+    std::cerr << "Failed to convert " << positional[0] << std::endl;
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << "Converted " << events << " events to " << format << ": " << bytes << " bytes ("
+            << (events ? double(bytes) / events : 0.0) << " bytes/event) in " << seconds << " s" << std::endl;
+  return 0;
+}
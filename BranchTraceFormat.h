@@ -0,0 +1,774 @@
+#ifndef BRANCH_TRACE_FORMAT_H
+#define BRANCH_TRACE_FORMAT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+    - Binary trace encodings shared by the runtime writer (DynamicLog.cpp) and the offline tools.
+    - Varints are LEB128: 7 bits per byte, low bits first, high bit set on all but the last byte.
+    - RLE format (".rle"): an 8-byte magic followed by self-contained chunks. Each chunk holds
+        * one run-length stream per branch: varint((firstRunLength << 1) | firstOutcome), then
+          varint(runLength) for every following run (outcomes alternate between runs);
+        * a global interleaving stream giving the branch ID of every event. The next branch ID
+          is predicted from (previous ID, previous outcome), which is almost always the same
+          CFG successor, so the stream stores varint(correctly predicted events) followed by
+          varint(explicit branch ID) whenever the prediction misses.
+      File layout: 8-byte magic, { varint(payloadBytes) payload } * chunks, 0x00, trace index.
+      Chunk payload = varint(events) varint(branches) varint(interleaveBytes) interleave
+        { varint(branchID) varint(runBytes) runs } * branches
+    - Block format (".blk"): exact event order in independently decodable blocks. Every
+      event becomes one byte (moveToFrontIndex << 1) | taken; index 127 escapes to a
+      varint branch ID in a side stream. The bytes are entropy coded with an order-1 rANS
+      coder (context = previous byte), which captures the short cycles of IDs that
+      dominate real traces.
+      File layout: 8-byte magic, { varint(payloadBytes) payload } * blocks, 0x00, trace index.
+      Block payload = varint(events) varint(escapeBytes) escapes contextBitmap[32]
+        { varint(symbols) { symbol varint(freq - 1) } * symbols } * contexts
+        varint(ransBytes) rans
+      An all-zero context bitmap marks a stored block, whose symbols follow uncoded
+      (one byte per event); the runtime writes these when flushing from a signal handler.
+    - Status: the last magic byte of a binary trace is '1', or 'T' when the runtime flushed
+      it from a fatal signal handler (no index follows, and events logged after the signal
+      are missing). Text logs written by the runtime start with a fixed-width header line
+      "# branch_history status=<running|complete|truncated>" that is rewritten in place;
+      "running" is left behind by runs killed without a chance to flush (e.g. SIGKILL).
+    - Segment manifest ("<trace>.manifest"): a rotated trace is a sequence of complete
+      traces "<trace>.<NNNNNN>.<ext>" in the same directory, listed in event order:
+        # branch_history manifest status=<running |complete|stopped >
+        segment,first_event,events,bytes,state,file
+        { <n>,<first event>,<events>,<bytes>,<open|complete|dropped>,<file name> } * rows
+      A row is appended whenever a segment opens, completes or is dropped, so a segment
+      has up to three rows and its last one holds; the fixed-width status is rewritten in
+      place. A last line without its '\n' is still being written. An "open" segment was
+      still being written (its own header tells whether it was flushed); "dropped"
+      segments were deleted by the size cap and their events are gone.
+    - Trace index: one entry per chunk/block (text logs: per 2^20 lines) with its event
+      count, its size in bytes and per-branch (executions, taken) counts, so readers can
+      seek to an event, split work by block or aggregate ranges without decoding.
+        varint(firstByteOffset) varint(blocks)
+        { varint(events) varint(bytes) varint(branches)
+          { varint(branchIDDelta) varint(executions) varint(taken) } * branches } * blocks
+        uint64le(indexOffset) "BHTBIDX2"
+      Binary traces end with their index; text logs get a "<trace>.idx" sidecar holding just
+      the index and trailer.
+    - Writer statistics: the runtime places a footer right before the index (after the
+      0x00 terminator, or at the start of a text log's sidecar), which readers that follow
+      the chunk/block stream or the index trailer never see:
+        "key=value\n" lines, uint64le(lineBytes) "BHTSTAT1" A trace cut short before its index is still readable by walking
+      the chunk/block length prefixes.
+    - Packed format (".pack"): branch-major, written by BranchTraceTranspose. Each branch's
+      outcomes are bit-packed into little-endian 64-bit words (execution i is bit i % 64
+      of word i / 64); event order across branches is not kept.
+        8-byte magic { words } * branches
+        varint(branches) { varint(branchID) varint(executions) varint(taken) varint(byteOffset) } * branches
+        uint64le(directoryOffset) "BHTPKDIR"
+      Directory entries are sorted by branch ID; streams may appear in any order.
+*/
+
+static const char RleTraceMagic[8] = {'B', 'H', 'T', 'R', 'L', 'E', '0', '1'};
+static const char TraceIndexMagic[8] = {'B', 'H', 'T', 'B', 'I', 'D', 'X', '2'};
+static const char PackedTraceMagic[8] = {'B', 'H', 'T', 'P', 'A', 'C', 'K', '1'};
+static const char PackedDirectoryMagic[8] = {'B', 'H', 'T', 'P', 'K', 'D', 'I', 'R'};
+static const char TruncatedTraceMark = 'T';
+static const char TraceStatsMagic[8] = {'B', 'H', 'T', 'S', 'T', 'A', 'T', '1'};
+static const char TraceManifestHeader[] = "# branch_history manifest";
+static const char TextTraceHeaderPrefix[] = "# branch_history status=";
+static const char *const TextTraceStatus[] = {"running  ", "complete ", "truncated"};
+static const char *const TraceManifestStatus[] = {"running ", "complete", "stopped "};
+enum : size_t {
+  TraceStatusByte = 7,                                            // in binary magics
+  TextTraceStatusOffset = sizeof(TextTraceHeaderPrefix) - 1,      // in text logs
+  TextTraceHeaderBytes = TextTraceStatusOffset + 9 + 1,           // prefix, status, '\n'
+  TraceManifestStatusOffset = sizeof(TraceManifestHeader) - 1 + 8, // after " status=" in manifests
+};
+
+inline void putVarint(std::vector<uint8_t> &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(uint8_t(v) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(uint8_t(v));
+}
+
+// Allocation-free form for signal handlers; out must hold 10 bytes. Returns the length.
+inline size_t putVarint(uint8_t *out, uint64_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = uint8_t(v) | 0x80;
+    v >>= 7;
+  }
+  out[n++] = uint8_t(v);
+  return n;
+}
+
+inline size_t varintBytes(uint64_t v) {
+  size_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+// Returns false on truncated input
+inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+  v = 0;
+  for (unsigned shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t b = *p++;
+    v |= uint64_t(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+// Appends a statistics footer (nothing if stats is empty); the index follows it
+inline void putTraceStats(std::vector<uint8_t> &out, const std::string &stats) {
+  if (stats.empty()) return;
+  out.insert(out.end(), stats.begin(), stats.end());
+  for (unsigned i = 0; i < 8; i++) out.push_back(uint8_t(uint64_t(stats.size()) >> (8 * i)));
+  for (char c : TraceStatsMagic) out.push_back(uint8_t(c));
+}
+
+// Accumulates the trace index while a trace is written
+class TraceIndexBuilder {
+public:
+  uint64_t blockEvents() const { return BlockEvents; }
+
+  void add(uint64_t id, bool taken) {
+    if (id >= Counts.size()) Counts.resize(id + 1);
+    Count &C = Counts[id];
+    if (!C.executions) Touched.push_back(id);
+    C.executions++;
+    C.taken += taken;
+    BlockEvents++;
+  }
+
+  // Closes the current block (nothing if empty), which occupies bytes in the file
+  void finishBlock(uint64_t bytes) {
+    if (!BlockEvents) return;
+    std::sort(Touched.begin(), Touched.end());
+    putVarint(Body, BlockEvents);
+    putVarint(Body, bytes);
+    putVarint(Body, Touched.size());
+    uint64_t prev = 0;
+    for (uint64_t id : Touched) {
+      Count &C = Counts[id];
+      putVarint(Body, id - prev);
+      putVarint(Body, C.executions);
+      putVarint(Body, C.taken);
+      C = Count();
+      prev = id;
+    }
+    Touched.clear();
+    BlockEvents = 0;
+    Blocks++;
+  }
+
+  // Appends the index and trailer; indexOffset is the file offset they start at
+  void write(std::vector<uint8_t> &out, uint64_t firstByteOffset, uint64_t indexOffset) {
+    putVarint(out, firstByteOffset);
+    putVarint(out, Blocks);
+    out.insert(out.end(), Body.begin(), Body.end());
+    for (unsigned i = 0; i < 8; i++) out.push_back(uint8_t(indexOffset >> (8 * i)));
+    for (char c : TraceIndexMagic) out.push_back(uint8_t(c));
+    Body.clear();
+    Blocks = 0;
+  }
+
+private:
+  struct Count {
+    uint64_t executions = 0, taken = 0;
+  };
+
+  std::vector<Count> Counts;
+  std::vector<uint64_t> Touched;
+  std::vector<uint8_t> Body; // encoded entries of the finished blocks
+  uint64_t BlockEvents = 0;
+  uint64_t Blocks = 0;
+};
+
+// Successor prediction table shared by the RLE encoder and decoder. It is reset at
+// every chunk so chunks decode independently.
+class SuccessorPredictor {
+public:
+  SuccessorPredictor() : Table(TableSize, 0) {}
+
+  void reset() { std::fill(Table.begin(), Table.end(), 0); }
+
+  // Predicted ID + 1, or 0 when nothing has been seen for this (id, outcome)
+  uint64_t predict(uint64_t id, bool taken) const { return Table[slot(id, taken)]; }
+
+  void learn(uint64_t id, bool taken, uint64_t next) { Table[slot(id, taken)] = next + 1; }
+
+private:
+  enum : size_t { TableSize = 1 << 16 };
+  std::vector<uint64_t> Table;
+
+  static size_t slot(uint64_t id, bool taken) {
+    uint64_t key = (id << 1) | (taken ? 1 : 0);
+    return size_t((key * 0x9E3779B97F4A7C15ull) >> 48);
+  }
+};
+
+class RleTraceEncoder {
+public:
+  uint64_t events() const { return Events; }
+
+  // Appends the file magic; Offset tracks absolute positions for the index
+  void start(std::vector<uint8_t> &out) {
+    for (char c : RleTraceMagic) out.push_back(uint8_t(c));
+    Offset = sizeof(RleTraceMagic);
+  }
+
+  void add(uint64_t id, bool taken) {
+    Index.add(id, taken);
+
+    // Interleaving stream
+    if (HavePrev && Successors.predict(PrevID, PrevTaken) == id + 1) {
+      HitRun++;
+    } else {
+      putVarint(Interleave, HitRun);
+      putVarint(Interleave, id);
+      HitRun = 0;
+      if (HavePrev) Successors.learn(PrevID, PrevTaken, id);
+    }
+    HavePrev = true;
+    PrevID = id;
+    PrevTaken = taken;
+
+    // Per-branch run lengths
+    if (id >= Branches.size()) Branches.resize(id + 1);
+    BranchRuns &B = Branches[id];
+    if (!B.active) {
+      B.active = true;
+      B.firstRun = true;
+      B.outcome = taken;
+      B.runLength = 1;
+      Touched.push_back(id);
+    } else if (B.outcome == taken) {
+      B.runLength++;
+    } else {
+      emitRun(B);
+      B.outcome = taken;
+      B.runLength = 1;
+    }
+    Events++;
+  }
+
+  // Appends the current chunk to out (nothing if empty) and starts a new one
+  void finishChunk(std::vector<uint8_t> &out) {
+    if (!Events) return;
+    putVarint(Interleave, HitRun); // trailing predicted events
+
+    std::vector<uint8_t> payload;
+    putVarint(payload, Events);
+    putVarint(payload, Touched.size());
+    putVarint(payload, Interleave.size());
+    payload.insert(payload.end(), Interleave.begin(), Interleave.end());
+    for (uint64_t id : Touched) {
+      BranchRuns &B = Branches[id];
+      emitRun(B);
+      putVarint(payload, id);
+      putVarint(payload, B.bytes.size());
+      payload.insert(payload.end(), B.bytes.begin(), B.bytes.end());
+      B.bytes.clear();
+      B.active = false;
+    }
+    size_t before = out.size();
+    putVarint(out, payload.size());
+    out.insert(out.end(), payload.begin(), payload.end());
+    Index.finishBlock(out.size() - before);
+    Offset += out.size() - before;
+
+    Interleave.clear();
+    Touched.clear();
+    Successors.reset();
+    HavePrev = false;
+    HitRun = 0;
+    Events = 0;
+  }
+
+  // Flushes the last chunk and appends the terminator, the statistics footer and the trace index
+  void finish(std::vector<uint8_t> &out, const std::string &stats = std::string()) {
+    finishChunk(out);
+    out.push_back(0);
+    size_t before = out.size();
+    putTraceStats(out, stats);
+    Index.write(out, sizeof(RleTraceMagic), Offset + 1 + (out.size() - before));
+  }
+
+  // Emits the pending events as the chunk finishChunk would, through
+  // write(const uint8_t *, size_t), without allocating or changing the encoder, so
+  // that a signal handler can save them
+  template <typename Write>
+  void writePending(Write &&write) const {
+    if (!Events) return;
+    uint8_t v[10];
+    uint64_t interleaveBytes = Interleave.size() + varintBytes(HitRun);
+    uint64_t payloadBytes = varintBytes(Events) + varintBytes(Touched.size()) + varintBytes(interleaveBytes) +
+                            interleaveBytes;
+    for (uint64_t id : Touched) {
+      uint64_t runBytes = Branches[id].bytes.size() + varintBytes(pendingRun(Branches[id]));
+      payloadBytes += varintBytes(id) + varintBytes(runBytes) + runBytes;
+    }
+    write(v, putVarint(v, payloadBytes));
+    write(v, putVarint(v, Events));
+    write(v, putVarint(v, Touched.size()));
+    write(v, putVarint(v, interleaveBytes));
+    write(Interleave.data(), Interleave.size());
+    write(v, putVarint(v, HitRun));
+    for (uint64_t id : Touched) {
+      const BranchRuns &B = Branches[id];
+      uint64_t run = pendingRun(B);
+      write(v, putVarint(v, id));
+      write(v, putVarint(v, B.bytes.size() + varintBytes(run)));
+      write(B.bytes.data(), B.bytes.size());
+      write(v, putVarint(v, run));
+    }
+  }
+
+private:
+  struct BranchRuns {
+    std::vector<uint8_t> bytes;
+    uint64_t runLength = 0;
+    bool outcome = false;
+    bool active = false;   // seen in the current chunk
+    bool firstRun = false; // next emitted run carries the outcome bit
+  };
+
+  std::vector<BranchRuns> Branches;
+  std::vector<uint64_t> Touched;
+  std::vector<uint8_t> Interleave;
+  SuccessorPredictor Successors;
+  TraceIndexBuilder Index;
+  uint64_t Offset = 0;
+  uint64_t Events = 0;
+  uint64_t HitRun = 0;
+  uint64_t PrevID = 0;
+  bool PrevTaken = false;
+  bool HavePrev = false;
+
+  static uint64_t pendingRun(const BranchRuns &B) {
+    return B.firstRun ? (B.runLength << 1) | (B.outcome ? 1 : 0) : B.runLength;
+  }
+
+  void emitRun(BranchRuns &B) {
+    putVarint(B.bytes, pendingRun(B));
+    B.firstRun = false;
+  }
+};
+
+// Decodes one RLE chunk payload, calling cb(branchID, taken) per event in order.
+// Returns false on malformed input.
+template <typename Callback>
+bool decodeRleChunk(const uint8_t *p, const uint8_t *end, Callback &&cb) {
+  struct Cursor {
+    const uint8_t *p = nullptr;
+    const uint8_t *end = nullptr;
+    uint64_t remaining = 0;
+    bool outcome = false;
+    bool first = true;
+  };
+
+  uint64_t events, branches, interleaveBytes;
+  if (!getVarint(p, end, events) || !getVarint(p, end, branches) || !getVarint(p, end, interleaveBytes) ||
+      interleaveBytes > uint64_t(end - p)) {
+    return false;
+  }
+  const uint8_t *ip = p, *iend = p + interleaveBytes;
+  p = iend;
+
+  std::vector<Cursor> cursors;
+  for (uint64_t b = 0; b < branches; b++) {
+    uint64_t id, bytes;
+    if (!getVarint(p, end, id) || !getVarint(p, end, bytes) || bytes > uint64_t(end - p)) return false;
+    if (id >= cursors.size()) cursors.resize(id + 1);
+    cursors[id].p = p;
+    cursors[id].end = p + bytes;
+    p += bytes;
+  }
+
+  SuccessorPredictor successors;
+  uint64_t produced = 0, prevID = 0;
+  bool prevTaken = false;
+  auto emit = [&](uint64_t id) -> bool {
+    if (id >= cursors.size() || !cursors[id].p) return false;
+    Cursor &C = cursors[id];
+    if (!C.remaining) {
+      uint64_t v;
+      if (!getVarint(C.p, C.end, v)) return false;
+      if (C.first) {
+        C.outcome = v & 1;
+        C.remaining = v >> 1;
+        C.first = false;
+      } else {
+        C.outcome = !C.outcome;
+        C.remaining = v;
+      }
+      if (!C.remaining) return false;
+    }
+    C.remaining--;
+    cb(id, C.outcome);
+    prevID = id;
+    prevTaken = C.outcome;
+    produced++;
+    return true;
+  };
+
+  while (produced < events) {
+    uint64_t hits;
+    if (!getVarint(ip, iend, hits) || hits > events - produced) return false;
+    for (uint64_t h = 0; h < hits; h++) {
+      uint64_t predicted = successors.predict(prevID, prevTaken);
+      if (!predicted || !emit(predicted - 1)) return false;
+    }
+    if (produced == events) break;
+    uint64_t id;
+    if (!getVarint(ip, iend, id)) return false;
+    if (produced) successors.learn(prevID, prevTaken, id);
+    if (!emit(id)) return false;
+  }
+  return true;
+}
+
+// Walks only the per-branch run streams of one RLE chunk, calling
+// cb(branchID, taken, runLength) per run; the interleaving stream is skipped, so
+// branch-major consumers never pay for event order.
+template <typename Callback>
+bool decodeRleChunkRuns(const uint8_t *p, const uint8_t *end, Callback &&cb) {
+  uint64_t events, branches, interleaveBytes;
+  if (!getVarint(p, end, events) || !getVarint(p, end, branches) || !getVarint(p, end, interleaveBytes) ||
+      interleaveBytes > uint64_t(end - p)) {
+    return false;
+  }
+  p += interleaveBytes;
+  for (uint64_t b = 0; b < branches; b++) {
+    uint64_t id, bytes, v;
+    if (!getVarint(p, end, id) || !getVarint(p, end, bytes) || bytes > uint64_t(end - p)) return false;
+    const uint8_t *rp = p, *rend = p + bytes;
+    p = rend;
+    if (!getVarint(rp, rend, v)) return false;
+    bool outcome = v & 1;
+    cb(id, outcome, v >> 1);
+    while (rp < rend) {
+      if (!getVarint(rp, rend, v)) return false;
+      outcome = !outcome;
+      cb(id, outcome, v);
+    }
+  }
+  return true;
+}
+
+inline bool isPackedTrace(const uint8_t *data, size_t size) {
+  return size >= sizeof(PackedTraceMagic) && std::memcmp(data, PackedTraceMagic, sizeof(PackedTraceMagic)) == 0;
+}
+
+// Magic checks ignore the status byte
+inline bool isRleTrace(const uint8_t *data, size_t size) {
+  return size >= sizeof(RleTraceMagic) && std::memcmp(data, RleTraceMagic, TraceStatusByte) == 0;
+}
+
+static const char BlockTraceMagic[8] = {'B', 'H', 'T', 'B', 'L', 'K', '0', '1'};
+
+inline bool isBlockTrace(const uint8_t *data, size_t size) {
+  return size >= sizeof(BlockTraceMagic) && std::memcmp(data, BlockTraceMagic, TraceStatusByte) == 0;
+}
+
+// True for traces the runtime flushed from a fatal signal handler; data holds the
+// start of the file (TextTraceHeaderBytes suffice)
+inline bool isTruncatedTrace(const uint8_t *data, size_t size) {
+  if (isRleTrace(data, size) || isBlockTrace(data, size)) return data[TraceStatusByte] == TruncatedTraceMark;
+  return size >= TextTraceHeaderBytes && std::memcmp(data, TextTraceHeaderPrefix, TextTraceStatusOffset) == 0 &&
+         std::memcmp(data + TextTraceStatusOffset, TextTraceStatus[2], 9) == 0;
+}
+
+// Constants shared by the block encoder and decoder
+struct BlockCodec {
+  enum : unsigned {
+    EscapeIndex = 127,            // move-to-front positions >= this are sent as explicit IDs
+    ScaleBits = 12,               // rANS frequencies sum to 1 << ScaleBits per context
+    Contexts = 256,
+    RansLow = 1u << 23,           // lower bound of the normalized rANS state
+  };
+
+  // Move-to-front list of recent branch IDs, at most EscapeIndex entries
+  struct RecentIDs {
+    uint64_t ids[EscapeIndex];
+    unsigned size = 0;
+
+    // Position of id, or EscapeIndex if absent; moves it to the front either way
+    unsigned touch(uint64_t id) {
+      unsigned i = 0;
+      while (i < size && ids[i] != id) i++;
+      unsigned position = i < size ? i : unsigned(EscapeIndex);
+      if (i == size) {
+        if (size < EscapeIndex) size++;
+        i = size - 1;
+      }
+      std::memmove(ids + 1, ids, i * sizeof(uint64_t));
+      ids[0] = id;
+      return position;
+    }
+
+    uint64_t take(unsigned position) {
+      uint64_t id = ids[position];
+      std::memmove(ids + 1, ids, position * sizeof(uint64_t));
+      ids[0] = id;
+      return id;
+    }
+  };
+};
+
+class BlockTraceEncoder {
+public:
+  BlockTraceEncoder() { Symbols.reserve(1 << 20); }
+
+  uint64_t events() const { return Symbols.size(); }
+
+  void add(uint64_t id, bool taken) {
+    Index.add(id, taken);
+    unsigned position = Recent.touch(id);
+    if (position == BlockCodec::EscapeIndex) putVarint(Escapes, id);
+    Symbols.push_back(uint8_t((position << 1) | (taken ? 1 : 0)));
+  }
+
+  // Appends the file magic; Offset tracks absolute positions for the index
+  void start(std::vector<uint8_t> &out) {
+    for (char c : BlockTraceMagic) out.push_back(uint8_t(c));
+    Offset = sizeof(BlockTraceMagic);
+  }
+
+  // Appends the current block to out (nothing if empty) and starts a new one
+  void finishBlock(std::vector<uint8_t> &out) {
+    if (Symbols.empty()) return;
+    std::vector<uint8_t> payload;
+    putVarint(payload, Symbols.size());
+    putVarint(payload, Escapes.size());
+    payload.insert(payload.end(), Escapes.begin(), Escapes.end());
+    encodeSymbols(payload);
+
+    size_t before = out.size();
+    putVarint(out, payload.size());
+    out.insert(out.end(), payload.begin(), payload.end());
+    Index.finishBlock(out.size() - before);
+    Offset += out.size() - before;
+
+    Symbols.clear();
+    Escapes.clear();
+    Recent.size = 0;
+  }
+
+  // Flushes the last block and appends the terminator, the statistics footer and the trace index
+  void finish(std::vector<uint8_t> &out, const std::string &stats = std::string()) {
+    finishBlock(out);
+    out.push_back(0);
+    size_t before = out.size();
+    putTraceStats(out, stats);
+    Index.write(out, sizeof(BlockTraceMagic), Offset + 1 + (out.size() - before));
+  }
+
+  // Emits the pending events as a stored block through write(const uint8_t *, size_t),
+  // without allocating or changing the encoder, so that a signal handler can save them
+  template <typename Write>
+  void writePending(Write &&write) const {
+    if (Symbols.empty()) return;
+    uint8_t v[10];
+    const uint8_t bitmap[BlockCodec::Contexts / 8] = {0};
+    uint64_t payloadBytes = varintBytes(Symbols.size()) + varintBytes(Escapes.size()) + Escapes.size() +
+                            sizeof(bitmap) + Symbols.size();
+    write(v, putVarint(v, payloadBytes));
+    write(v, putVarint(v, Symbols.size()));
+    write(v, putVarint(v, Escapes.size()));
+    write(Escapes.data(), Escapes.size());
+    write(bitmap, sizeof(bitmap));
+    write(Symbols.data(), Symbols.size());
+  }
+
+private:
+  std::vector<uint8_t> Symbols;
+  std::vector<uint8_t> Escapes;
+  TraceIndexBuilder Index;
+  BlockCodec::RecentIDs Recent;
+  uint64_t Offset = 0;
+
+  // Scales counts so they sum to 1 << ScaleBits, keeping every seen symbol >= 1
+  static void normalize(const uint32_t *counts, uint32_t *freqs) {
+    uint64_t total = 0;
+    for (unsigned s = 0; s < 256; s++) total += counts[s];
+    const uint32_t target = 1u << BlockCodec::ScaleBits;
+    uint32_t sum = 0;
+    unsigned largest = 0;
+    for (unsigned s = 0; s < 256; s++) {
+      freqs[s] = 0;
+      if (!counts[s]) continue;
+      freqs[s] = std::max<uint32_t>(1, uint32_t(uint64_t(counts[s]) * target / total));
+      sum += freqs[s];
+      if (counts[s] > counts[largest]) largest = s;
+    }
+    if (sum < target) {
+      freqs[largest] += target - sum;
+      return;
+    }
+    // Rounding small symbols up can overshoot; take the excess from the largest ones
+    while (sum > target) {
+      unsigned best = largest;
+      for (unsigned s = 0; s < 256; s++) {
+        if (freqs[s] > freqs[best]) best = s;
+      }
+      uint32_t cut = std::min(sum - target, freqs[best] - 1);
+      freqs[best] -= cut;
+      sum -= cut;
+    }
+  }
+
+  void encodeSymbols(std::vector<uint8_t> &payload) {
+    const unsigned C = BlockCodec::Contexts;
+    std::vector<uint32_t> counts(C * 256, 0), freqs(C * 256, 0), starts(C * 256, 0);
+    uint8_t ctx = 0;
+    for (uint8_t s : Symbols) {
+      counts[ctx * 256 + s]++;
+      ctx = s;
+    }
+
+    uint8_t bitmap[C / 8] = {0};
+    std::vector<uint8_t> tables;
+    for (unsigned c = 0; c < C; c++) {
+      uint32_t *f = &freqs[c * 256];
+      unsigned used = 0;
+      for (unsigned s = 0; s < 256; s++) used += counts[c * 256 + s] != 0;
+      if (!used) continue;
+      bitmap[c / 8] |= uint8_t(1 << (c % 8));
+      normalize(&counts[c * 256], f);
+      putVarint(tables, used);
+      uint32_t start = 0;
+      for (unsigned s = 0; s < 256; s++) {
+        starts[c * 256 + s] = start;
+        start += f[s];
+        if (!f[s]) continue;
+        tables.push_back(uint8_t(s));
+        putVarint(tables, f[s] - 1);
+      }
+    }
+    payload.insert(payload.end(), bitmap, bitmap + sizeof(bitmap));
+    payload.insert(payload.end(), tables.begin(), tables.end());
+
+    // rANS encodes in reverse; bytes are emitted back to front and flipped at the end
+    std::vector<uint8_t> rans;
+    rans.reserve(Symbols.size() / 2 + 16);
+    uint32_t x = BlockCodec::RansLow;
+    for (size_t i = Symbols.size(); i-- > 0;) {
+      unsigned c = i ? Symbols[i - 1] : 0;
+      unsigned s = Symbols[i];
+      uint32_t freq = freqs[c * 256 + s], start = starts[c * 256 + s];
+      uint32_t xMax = ((BlockCodec::RansLow >> BlockCodec::ScaleBits) << 8) * freq;
+      while (x >= xMax) {
+        rans.push_back(uint8_t(x));
+        x >>= 8;
+      }
+      x = ((x / freq) << BlockCodec::ScaleBits) + (x % freq) + start;
+    }
+    for (int shift = 24; shift >= 0; shift -= 8) rans.push_back(uint8_t(x >> shift));
+    std::reverse(rans.begin(), rans.end());
+
+    putVarint(payload, rans.size());
+    payload.insert(payload.end(), rans.begin(), rans.end());
+  }
+};
+
+// Decodes one block payload, calling cb(branchID, taken) per event in order.
+// Returns false on malformed input.
+template <typename Callback>
+bool decodeTraceBlock(const uint8_t *p, const uint8_t *end, Callback &&cb) {
+  const unsigned C = BlockCodec::Contexts;
+  const uint32_t mask = (1u << BlockCodec::ScaleBits) - 1;
+  uint64_t events, escapeBytes, ransBytes;
+  if (!getVarint(p, end, events) || !getVarint(p, end, escapeBytes) || escapeBytes > uint64_t(end - p)) {
+    return false;
+  }
+  const uint8_t *ep = p, *eend = p + escapeBytes;
+  p = eend;
+  if (end - p < ptrdiff_t(C / 8)) return false;
+  const uint8_t *bitmap = p;
+  p += C / 8;
+  bool stored = true;
+  for (unsigned i = 0; i < C / 8; i++) stored &= bitmap[i] == 0;
+
+  // Per context: slot -> symbol, plus each symbol's (start, freq)
+  struct Table {
+    uint8_t slotSymbol[1u << BlockCodec::ScaleBits];
+    uint16_t start[256];
+    uint16_t freq[256];
+  };
+  std::vector<Table> tables;
+  int16_t tableOf[C];
+  for (unsigned c = 0; c < C; c++) {
+    tableOf[c] = -1;
+    if (!(bitmap[c / 8] >> (c % 8) & 1)) continue;
+    tableOf[c] = int16_t(tables.size());
+    tables.emplace_back();
+    Table &T = tables.back();
+    uint64_t used;
+    if (!getVarint(p, end, used) || used == 0 || used > 256) return false;
+    uint32_t start = 0;
+    for (uint64_t u = 0; u < used; u++) {
+      uint64_t freq;
+      if (p >= end) return false;
+      uint8_t s = *p++;
+      if (!getVarint(p, end, freq) || start + freq + 1 > mask + 1) return false;
+      T.start[s] = uint16_t(start);
+      T.freq[s] = uint16_t(freq + 1);
+      std::memset(T.slotSymbol + start, s, freq + 1);
+      start += uint32_t(freq + 1);
+    }
+    if (start != mask + 1) return false;
+  }
+
+  const uint8_t *rp, *rend;
+  uint32_t x = 0;
+  if (stored) {
+    if (events > uint64_t(end - p)) return false;
+    rp = p;
+    rend = p + events;
+  } else {
+    if (!getVarint(p, end, ransBytes) || ransBytes < 4 || ransBytes > uint64_t(end - p)) return false;
+    rp = p + 4;
+    rend = p + ransBytes;
+    x = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+  }
+
+  BlockCodec::RecentIDs recent;
+  unsigned ctx = 0;
+  for (uint64_t i = 0; i < events; i++) {
+    uint8_t s;
+    if (stored) {
+      s = *rp++;
+    } else {
+      if (tableOf[ctx] < 0) return false;
+      const Table &T = tables[size_t(tableOf[ctx])];
+      uint32_t slot = x & mask;
+      s = T.slotSymbol[slot];
+      x = T.freq[s] * (x >> BlockCodec::ScaleBits) + slot - T.start[s];
+      while (x < BlockCodec::RansLow && rp < rend) x = (x << 8) | *rp++;
+      ctx = s;
+    }
+
+    unsigned position = s >> 1;
+    uint64_t id;
+    if (position == BlockCodec::EscapeIndex) {
+      if (!getVarint(ep, eend, id)) return false;
+      recent.touch(id);
+    } else {
+      if (position >= recent.size) return false;
+      id = recent.take(position);
+    }
+    cb(id, (s & 1) != 0);
+  }
+  return true;
+}
+
+#endif // BRANCH_TRACE_FORMAT_H
@@ -0,0 +1,256 @@
+#include "BranchTrace.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+    - Builds and queries trace indexes (see BranchTraceFormat.h).
+    - Default mode writes "<trace>.idx" for traces that lack an embedded index: legacy text
+      logs (blocks of 2^20 lines) and binary traces cut short before their index.
+    - --info lists the blocks; --range FIRST LAST prints per-branch executions and taken
+      counts for events [FIRST, LAST), summing block summaries and decoding only the
+      partial blocks at the ends.
+    - A segment manifest stands for its whole rotated trace: segments are indexed and
+      counted in parallel, --info lists the segments and --range takes global event numbers.
+    - --stats prints the writer statistics the runtime stored with the trace (the latest
+      segment's for a manifest; each segment holds the totals up to its close).
+    - Usage: BranchTraceIndex [--info | --stats | --range FIRST LAST] <trace | manifest>
+*/
+
+namespace {
+  constexpr uint64_t TextIndexEvents = 1 << 20;
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [--info | --stats | --range FIRST LAST] <trace | manifest>" << std::endl;
+  }
+
+  bool writeFile(const std::string &path, const std::vector<uint8_t> &bytes) {
+    FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    return std::fclose(f) == 0 && ok;
+  }
+
+  // Text logs: a block ends after every TextIndexEvents-th event line
+  bool buildTextIndex(const std::string &path, TraceIndexBuilder &index) {
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    std::vector<char> buf(1 << 20);
+    TextEventParser parser;
+    uint64_t offset = 0, blockStart = 0;
+    auto add = [&](uint64_t branchID, bool taken) {
+      index.add(branchID, taken);
+      if (index.blockEvents() == TextIndexEvents) {
+        index.finishBlock(parser.lineEnd() - blockStart);
+        blockStart = parser.lineEnd();
+      }
+    };
+    size_t n;
+    while ((n = std::fread(buf.data(), 1, buf.size(), f)) > 0) {
+      parser.feed(buf.data(), buf.data() + n, offset, add);
+      offset += n;
+    }
+    parser.finish(offset, add);
+    index.finishBlock(offset - blockStart);
+    std::fclose(f);
+    return true;
+  }
+
+  // Binary traces without an index: one entry per chunk/block found by scanning
+  bool buildBinaryIndex(TraceReader &reader, TraceIndexBuilder &index) {
+    for (size_t b = 0; b < reader.blocks().size(); b++) {
+      if (!reader.decode(b, b + 1, 1, [&](uint64_t branchID, bool taken) { index.add(branchID, taken); })) {
+        return false;
+      }
+      index.finishBlock(reader.blocks()[b].bytes);
+    }
+    return true;
+  }
+
+  // Writes "<path>.idx" unless the trace already has an index
+  bool buildIndex(const std::string &path, TraceReader &reader, std::string &message) {
+    if (reader.summarized()) {
+      message = path + " already has an index (" + std::to_string(reader.blocks().size()) + " blocks)";
+      return true;
+    }
+    TraceIndexBuilder index;
+    bool text = reader.format() == TraceReader::Format::Text;
+    bool ok = text ? buildTextIndex(path, index) : buildBinaryIndex(reader, index);
+    if (!ok) {
+      message = "Failed to read " + path;
+      return false;
+    }
+    std::vector<uint8_t> bytes;
+    index.write(bytes, text ? 0 : sizeof(RleTraceMagic), 0);
+    if (!writeFile(path + ".idx", bytes)) {
+      message = "Failed to write " + path + ".idx";
+      return false;
+    }
+    message = "Wrote " + path + ".idx (" + std::to_string(bytes.size()) + " bytes)";
+    return true;
+  }
+
+  void printCounts(const std::vector<TraceBranchCount> &counts) {
+    std::cout << "branch_id,executions,taken\n";
+    for (const TraceBranchCount &C : counts) {
+      if (C.executions) std::cout << C.branchID << "," << C.executions << "," << C.taken << "\n";
+    }
+  }
+
+  // Rotated traces: every mode works segment by segment, segments in parallel. Event
+  // numbers are global; events of dropped segments count as absent.
+  int runOnManifest(const std::string &mode, const std::string &path, const std::vector<TraceSegmentInfo> &segments,
+                    uint64_t first, uint64_t last, const char *argv0) {
+    unsigned threads = traceDecodeThreads();
+    std::vector<TraceReader> readers(segments.size());
+    std::vector<std::string> messages(segments.size());
+    std::vector<char> ok(segments.size(), 1);
+
+    if (mode == "build") {
+      forEachTraceSegment(segments, threads, [&](size_t i) {
+        ok[i] = readers[i].open(segments[i].path) && buildIndex(segments[i].path, readers[i], messages[i]);
+        if (!ok[i] && messages[i].empty()) messages[i] = "Failed to open " + segments[i].path;
+      });
+      bool all = true;
+      for (size_t i = 0; i < segments.size(); i++) {
+        if (!messages[i].empty()) std::cerr << messages[i] << std::endl;
+        all = all && ok[i];
+      }
+      return all ? 0 : 1;
+    }
+
+    for (size_t i = 0; i < segments.size(); i++) {
+      if (segments[i].dropped) continue;
+      if (!readers[i].open(segments[i].path) || !readers[i].summarized()) {
+        std::cerr << segments[i].path << " is missing or has no index; run " << argv0 << " " << path << " first"
+                  << std::endl;
+        return 1;
+      }
+      if (readers[i].truncated()) {
+        std::cerr << "Warning: " << segments[i].path << " was flushed by a signal handler; the run ended early"
+                  << std::endl;
+      }
+    }
+
+    if (mode == "info") {
+      std::cout << "segment,first_event,events,blocks,state,file\n";
+      for (size_t i = 0; i < segments.size(); i++) {
+        const TraceSegmentInfo &S = segments[i];
+        uint64_t events = S.dropped ? S.events : readers[i].events();
+        std::cout << i << "," << S.firstEvent << "," << events << "," << readers[i].blocks().size() << ","
+                  << (S.dropped ? "dropped" : S.open ? "open" : "complete") << "," << S.path << "\n";
+      }
+      return 0;
+    }
+
+    std::vector<std::vector<TraceBranchCount>> partial(segments.size());
+    forEachTraceSegment(segments, threads, [&](size_t i) {
+      uint64_t begin = segments[i].firstEvent, end = begin + readers[i].events();
+      if (end <= first || begin >= last) return;
+      ok[i] = readers[i].countRange(std::max(first, begin) - begin, std::min(last, end) - begin, 1, partial[i]);
+    });
+    std::vector<TraceBranchCount> counts;
+    for (size_t i = 0; i < segments.size(); i++) {
+      if (!ok[i]) {
+        std::cerr << "Failed to decode " << segments[i].path << std::endl;
+        return 1;
+      }
+      for (const TraceBranchCount &C : partial[i]) {
+        while (C.branchID >= counts.size()) counts.push_back({counts.size(), 0, 0});
+        counts[C.branchID].executions += C.executions;
+        counts[C.branchID].taken += C.taken;
+      }
+    }
+    printCounts(counts);
+    return 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  std::string mode = "build";
+  uint64_t first = 0, last = 0;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--info") {
+      mode = "info";
+    } else if (arg == "--stats") {
+      mode = "stats";
+    } else if (arg == "--range" && i + 2 < argc) {
+      mode = "range";
+      first = std::strtoull(argv[++i], nullptr, 10);
+      last = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg.compare(0, 2, "--") == 0) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  const std::string &path = positional[0];
+
+  std::vector<TraceSegmentInfo> segments;
+  bool manifest = loadTraceManifest(path, segments);
+  if (mode == "stats") {
+    std::string stats;
+    bool found = false;
+    for (size_t i = segments.size(); !found && i-- > 0;) {
+      found = !segments[i].dropped && loadTraceStats(segments[i].path, stats);
+    }
+    if (!manifest) found = loadTraceStats(path, stats);
+    if (!found) {
+      std::cerr << path << " has no writer statistics" << std::endl;
+      return 1;
+    }
+    std::cout << stats;
+    return 0;
+  }
+  if (manifest) {
+    return runOnManifest(mode, path, segments, first, last, argv[0]);
+  }
+
+  TraceReader reader;
+  if (!reader.open(path)) {
+    std::cerr << "Failed to open " << path << std::endl;
+    return 1;
+  }
+  if (reader.truncated()) {
+    std::cerr << "Warning: " << path << " was flushed by a signal handler; the run ended early" << std::endl;
+  }
+
+  if (mode == "build") {
+    std::string message;
+    bool ok = buildIndex(path, reader, message);
+    std::cerr << message << std::endl;
+    return ok ? 0 : 1;
+  }
+
+  if (!reader.summarized()) {
+    std::cerr << path << " has no index; run " << argv[0] << " " << path << " first" << std::endl;
+    return 1;
+  }
+
+  if (mode == "info") {
+    std::cout << "block,event_offset,byte_offset,events,bytes,branches\n";
+    for (size_t b = 0; b < reader.blocks().size(); b++) {
+      const TraceBlockInfo &B = reader.blocks()[b];
+      std::cout << b << "," << B.eventOffset << "," << B.byteOffset << "," << B.events << "," << B.bytes << ","
+                << B.branches.size() << "\n";
+    }
+    return 0;
+  }
+
+  std::vector<TraceBranchCount> counts;
+  if (!reader.countRange(first, last, traceDecodeThreads(), counts)) {
+    std::cerr << "Failed to decode " << path << std::endl;
+    return 1;
+  }
+  printCounts(counts);
+  return 0;
+}
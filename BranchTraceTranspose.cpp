@@ -0,0 +1,298 @@
+#include "BranchTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+    - Transposes an event-major trace (any format) into a packed branch-major trace
+      (see BranchTraceFormat.h) using memory bounded by --memory-mb (besides decoding one
+      chunk/block of the input), however long the trace and however skewed its branches.
+    - Pass 1 streams the trace once, appends each event, as varint((id << 1) | taken), to
+      bucket file id % B and counts every branch's executions. Appends keep every
+      branch's events in execution order; the counts give every branch its place in the
+      output, in branch ID order.
+    - Pass 2 bit-packs the buckets on worker threads. A worker holds a fixed number of
+      words per branch of its bucket and writes them to the branch's place whenever they
+      fill, so a hot branch takes no more memory than any other.
+    - The budget goes a quarter to the bucket buffers, a quarter to 24 bytes per branch
+      ID and half to the workers' branch buffers. A trace or --buckets that does not fit
+      is an error, not a run over budget; more buckets mean fewer branches per buffer set.
+    - Usage: BranchTraceTranspose [--memory-mb M] [--buckets B] [--threads T] <trace> <output>
+*/
+
+namespace {
+  constexpr uint64_t MaxBuckets = 512; // bucket files stay open during pass 1
+  constexpr uint64_t MinBufferBytes = 4096;
+  constexpr uint64_t BytesPerBranchID = 24; // executions, taken, output offset
+  constexpr uint64_t BranchBufferOverhead = 64; // a BranchBuffer and its allocation
+  constexpr uint64_t MaxBranchBufferWords = 1 << 16;
+
+  struct Bucket {
+    FILE *file = nullptr;
+    std::vector<uint8_t> buffer;
+    std::string path;
+  };
+
+  // A branch's outcomes since its last write to the output
+  struct BranchBuffer {
+    std::vector<uint64_t> words;
+    uint64_t bits = 0;
+    uint64_t written = 0; // words already in the output
+  };
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [--memory-mb M] [--buckets B] [--threads T] <trace> <output>" << std::endl;
+  }
+
+  bool flush(Bucket &B) {
+    bool ok = std::fwrite(B.buffer.data(), 1, B.buffer.size(), B.file) == B.buffer.size();
+    B.buffer.clear();
+    return ok;
+  }
+
+  bool writeAt(int fd, const void *data, size_t bytes, uint64_t offset) {
+    const char *p = static_cast<const char *>(data);
+    while (bytes) {
+      ssize_t n = pwrite(fd, p, bytes, off_t(offset));
+      if (n <= 0) return false;
+      p += n;
+      bytes -= size_t(n);
+      offset += uint64_t(n);
+    }
+    return true;
+  }
+
+  struct Layout {
+    std::vector<uint64_t> executions; // per branch ID
+    std::vector<uint64_t> taken;
+    std::vector<uint64_t> offsets;
+  };
+
+  // Writes out a branch's buffered words at its place in the output
+  bool writeBranch(int fd, uint64_t id, BranchBuffer &S, Layout &L) {
+    for (uint64_t w : S.words) L.taken[id] += uint64_t(__builtin_popcountll(w));
+    bool ok = writeAt(fd, S.words.data(), S.words.size() * sizeof(uint64_t),
+                      L.offsets[id] + S.written * sizeof(uint64_t));
+    S.written += S.words.size();
+    S.words.clear();
+    return ok;
+  }
+
+  // Reads one bucket file back, bucket b holding IDs b, b + B, ..., and writes its
+  // branches' packed words out in pieces of at most wordsPerBranch
+  bool packBucket(const std::string &path, uint64_t bucket, uint64_t buckets, uint64_t wordsPerBranch, int fd,
+                  Layout &L) {
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    uint64_t slots = L.executions.size() > bucket ? (L.executions.size() - bucket + buckets - 1) / buckets : 0;
+    std::vector<BranchBuffer> branches(slots);
+    std::vector<uint8_t> buf(1 << 20);
+    uint64_t value = 0;
+    unsigned shift = 0;
+    bool ok = true;
+    size_t n;
+    while ((n = std::fread(buf.data(), 1, buf.size(), f)) > 0) {
+      for (size_t i = 0; i < n; i++) {
+        value |= uint64_t(buf[i] & 0x7F) << shift;
+        if (buf[i] & 0x80) {
+          shift += 7;
+          continue;
+        }
+        uint64_t id = value >> 1;
+        uint64_t local = (id - bucket) / buckets;
+        if (local >= slots) {
+          std::fclose(f);
+          return false;
+        }
+        BranchBuffer &S = branches[local];
+        if ((S.bits & 63) == 0) {
+          if (S.words.size() == wordsPerBranch) ok &= writeBranch(fd, id, S, L);
+          if (!S.words.capacity()) S.words.reserve(size_t(wordsPerBranch));
+          S.words.push_back(0);
+        }
+        S.words.back() |= (value & 1) << (S.bits & 63);
+        S.bits++;
+        value = 0;
+        shift = 0;
+      }
+    }
+    std::fclose(f);
+    for (uint64_t local = 0; local < slots; local++) {
+      BranchBuffer &S = branches[local];
+      if (S.bits) ok &= writeBranch(fd, bucket + local * buckets, S, L);
+    }
+    return ok && shift == 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  uint64_t memoryMB = 1024;
+  uint64_t buckets = 0;
+  unsigned threads = traceDecodeThreads();
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--memory-mb" && i + 1 < argc) {
+      memoryMB = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--buckets" && i + 1 < argc) {
+      buckets = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = unsigned(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg.compare(0, 2, "--") == 0) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 2 || memoryMB == 0 || threads == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  const std::string &input = positional[0], &output = positional[1];
+  auto start = std::chrono::steady_clock::now();
+
+  // Buckets only spread the branches (and the work) now; memory does not grow with events
+  uint64_t budget = memoryMB << 20;
+  if (!buckets) buckets = std::min<uint64_t>(MaxBuckets, 4 * uint64_t(threads));
+  if (buckets > MaxBuckets) {
+    std::cerr << buckets << " buckets requested, at most " << MaxBuckets << " are supported" << std::endl;
+    return 1;
+  }
+  if (buckets * MinBufferBytes > budget / 4) {
+    std::cerr << "--memory-mb " << memoryMB << " cannot hold the buffers of " << buckets << " buckets" << std::endl;
+    return 1;
+  }
+  size_t bufferBytes = size_t(std::min<uint64_t>(budget / (4 * buckets), 1 << 20));
+  uint64_t maxBranchIDs = budget / 4 / BytesPerBranchID;
+
+  // Pass 1: scatter events into bucket files and count them per branch
+  std::vector<Bucket> bucketFiles(buckets);
+  for (uint64_t b = 0; b < buckets; b++) {
+    Bucket &B = bucketFiles[b];
+    B.path = output + ".bucket" + std::to_string(b);
+    B.file = std::fopen(B.path.c_str(), "wb");
+    if (!B.file) {
+      std::cerr << "Failed to open " << B.path << std::endl;
+      return 1;
+    }
+    B.buffer.reserve(bufferBytes + 10);
+  }
+  Layout L;
+  uint64_t events = 0;
+  bool ok = true, fits = true;
+  bool read = forEachBranchEvent(input, [&](uint64_t branchID, bool taken) {
+    if (branchID >= L.executions.size()) {
+      if (branchID >= maxBranchIDs) {
+        fits = false;
+        return;
+      }
+      L.executions.resize(std::min<uint64_t>(maxBranchIDs, std::max<uint64_t>(branchID + 1, 2 * L.executions.size())));
+    }
+    L.executions[branchID]++;
+    Bucket &B = bucketFiles[branchID % buckets];
+    putVarint(B.buffer, (branchID << 1) | (taken ? 1 : 0));
+    if (B.buffer.size() >= bufferBytes) ok &= flush(B);
+    events++;
+  });
+  for (Bucket &B : bucketFiles) {
+    ok &= flush(B);
+    ok &= std::fclose(B.file) == 0;
+    std::vector<uint8_t>().swap(B.buffer);
+  }
+  auto cleanup = [&]() {
+    for (Bucket &B : bucketFiles) std::remove(B.path.c_str());
+  };
+  if (!read || !ok || !fits) {
+    if (!fits) {
+      std::cerr << "--memory-mb " << memoryMB << " cannot count branch IDs of " << input << " beyond " << maxBranchIDs
+                << std::endl;
+    } else {
+      std::cerr << (read ? "Failed to write bucket files for " : "Failed to read ") << input << std::endl;
+    }
+    cleanup();
+    return 1;
+  }
+
+  // Every worker's buffers hold the same number of words for each branch slot of its
+  // bucket; the bucket with the most slots sets it
+  uint64_t workers = std::min<uint64_t>(threads, buckets);
+  uint64_t slots = (L.executions.size() + buckets - 1) / buckets;
+  uint64_t workerBytes = budget / 2 / workers;
+  uint64_t slotBytes = slots ? workerBytes / slots : workerBytes;
+  if (slotBytes < BranchBufferOverhead + sizeof(uint64_t)) {
+    std::cerr << "--memory-mb " << memoryMB << " cannot buffer " << slots << " branches per bucket on " << workers
+              << " threads; use more --buckets or memory" << std::endl;
+    cleanup();
+    return 1;
+  }
+  uint64_t wordsPerBranch = std::min<uint64_t>(MaxBranchBufferWords, (slotBytes - BranchBufferOverhead) / sizeof(uint64_t));
+
+  // Branches are laid out in ID order after the magic
+  uint64_t offset = sizeof(PackedTraceMagic);
+  L.taken.assign(L.executions.size(), 0);
+  L.offsets.resize(L.executions.size());
+  for (uint64_t id = 0; id < L.executions.size(); id++) {
+    L.offsets[id] = offset;
+    offset += (L.executions[id] + 63) / 64 * sizeof(uint64_t);
+  }
+
+  // Pass 2: pack buckets in parallel, each branch written in place
+  int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << output << std::endl;
+    cleanup();
+    return 1;
+  }
+  std::atomic<uint64_t> nextBucket(0);
+  std::atomic<bool> workersOk(writeAt(fd, PackedTraceMagic, sizeof(PackedTraceMagic), 0));
+  auto work = [&]() {
+    for (uint64_t b; (b = nextBucket++) < buckets;) {
+      if (!packBucket(bucketFiles[b].path, b, buckets, wordsPerBranch, fd, L)) {
+        workersOk = false;
+        return;
+      }
+      std::remove(bucketFiles[b].path.c_str());
+    }
+  };
+  std::vector<std::thread> workerThreads;
+  for (uint64_t t = 1; t < workers; t++) workerThreads.emplace_back(work);
+  work();
+  for (std::thread &t : workerThreads) t.join();
+
+  std::vector<uint8_t> tail;
+  uint64_t branches = 0;
+  for (uint64_t id = 0; id < L.executions.size(); id++) branches += L.executions[id] != 0;
+  putVarint(tail, branches);
+  for (uint64_t id = 0; id < L.executions.size(); id++) {
+    if (!L.executions[id]) continue;
+    putVarint(tail, id);
+    putVarint(tail, L.executions[id]);
+    putVarint(tail, L.taken[id]);
+    putVarint(tail, L.offsets[id]);
+  }
+  for (unsigned i = 0; i < 8; i++) tail.push_back(uint8_t(offset >> (8 * i)));
+  tail.insert(tail.end(), PackedDirectoryMagic, PackedDirectoryMagic + sizeof(PackedDirectoryMagic));
+  bool written = writeAt(fd, tail.data(), tail.size(), offset);
+  written &= close(fd) == 0;
+  cleanup();
+  if (!workersOk || !written) {
+    std::cerr << "Failed to write " << output << std::endl;
+    std::remove(output.c_str());
+    return 1;
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << "Transposed " << events << " events of " << branches << " branches through " << buckets
+            << " buckets in " << seconds << " s" << std::endl;
+  return 0;
+}
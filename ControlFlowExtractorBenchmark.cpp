@@ -0,0 +1,219 @@
+#include "SyntheticIR.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+    - Measures how ControlFlowExtractor scales: for each size (instructions per function)
+      it writes a synthetic module (see SyntheticIR.h) to synthetic_<size>.ll and runs
+      opt -passes=control-flow-extractor on it TRIALS times, with the features discarded.
+    - opt -passes=verify on the same file is the baseline: parsing and printing cost the
+      same in both, so the extractor's own cost is the difference.
+    - Prints CSV on stdout: the module's counts, the median wall time and peak RSS of both
+      runs, and the growth exponents of the extractor's own time and memory against the
+      previous size (1 is linear, 2 quadratic). Exponents above 1.2 are warned about on
+      stderr, as super-linear behaviour will not survive 10^5-instruction functions.
+    - Usage: ControlFlowExtractorBenchmark [--sizes N,N,...] [--trials N] [--keep]
+                                           [generator options] --opt PATH --plugin PATH
+      with the generator options of SyntheticIRGenerator except --instructions.
+*/
+
+namespace {
+  const double SuperLinearExponent = 1.2;
+
+  struct Run {
+    double seconds;
+    long maxRssKb;
+    bool ok;
+  };
+
+  struct Measurement {
+    SyntheticIRStats stats;
+    Run extract;
+    Run verify;
+  };
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0
+              << " [--sizes N,N,...] [--trials N] [--keep] [generator options] --opt PATH --plugin PATH"
+              << std::endl;
+  }
+
+  std::vector<uint64_t> parseSizes(const std::string &list) {
+    std::vector<uint64_t> sizes;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      uint64_t size = std::strtoull(item.c_str(), nullptr, 10);
+      if (size == 0) return {};
+      sizes.push_back(size);
+    }
+    return sizes;
+  }
+
+  // Runs opt with its output discarded
+  Run runOnce(const std::vector<std::string> &args) {
+    Run run = {0, 0, false};
+    std::vector<char *> argv;
+    for (const std::string &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+      int devNull = open("/dev/null", O_WRONLY);
+      dup2(devNull, STDOUT_FILENO);
+      dup2(devNull, STDERR_FILENO);
+      execv(argv[0], argv.data());
+      _exit(127);
+    }
+    if (pid < 0) return run;
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) return run;
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    run.maxRssKb = usage.ru_maxrss;
+    run.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return run;
+  }
+
+  // Median time and peak RSS over the trials; not ok if any trial failed
+  Run runTrials(const std::vector<std::string> &args, unsigned trials) {
+    std::vector<double> seconds;
+    Run result = {0, 0, true};
+    for (unsigned t = 0; t < trials; t++) {
+      Run run = runOnce(args);
+      if (!run.ok) return run;
+      seconds.push_back(run.seconds);
+      result.maxRssKb = std::max(result.maxRssKb, run.maxRssKb);
+    }
+    std::sort(seconds.begin(), seconds.end());
+    result.seconds = seconds[seconds.size() / 2];
+    return result;
+  }
+
+  bool writeModule(const llvm::Module &M, const std::string &path) {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(path, EC, llvm::sys::fs::OF_None);
+    if (EC) {
+      std::cerr << "Failed to open " << path << ": " << EC.message() << std::endl;
+      return false;
+    }
+    M.print(OS, nullptr);
+    return true;
+  }
+
+  // log(b / a) / log(nb / na), or NAN when either cost is lost in the noise
+  double exponent(double a, double b, double na, double nb) {
+    if (a <= 0 || b <= 0 || nb <= na) return NAN;
+    return std::log(b / a) / std::log(nb / na);
+  }
+
+  void printExponent(double e) {
+    if (!std::isnan(e)) std::cout << e;
+  }
+}
+
+int main(int argc, char **argv) {
+  SyntheticIROptions options;
+  std::vector<uint64_t> sizes = {1000, 3000, 10000, 30000, 100000};
+  unsigned trials = 3;
+  bool keep = false;
+  std::string opt, plugin;
+  bool ok = true;
+  for (int i = 1; i < argc && ok; i++) {
+    std::string arg = argv[i];
+    if (arg == "--instructions") {
+      ok = false;
+    } else if (parseSyntheticIROption(argc, argv, i, options, ok)) {
+      continue;
+    } else if (arg == "--sizes" && i + 1 < argc) {
+      sizes = parseSizes(argv[++i]);
+      ok = !sizes.empty();
+    } else if (arg == "--trials" && i + 1 < argc) {
+      trials = unsigned(std::strtoul(argv[++i], nullptr, 10));
+      ok = trials > 0;
+    } else if (arg == "--keep") {
+      keep = true;
+    } else if (arg == "--opt" && i + 1 < argc) {
+      opt = argv[++i];
+    } else if (arg == "--plugin" && i + 1 < argc) {
+      plugin = argv[++i];
+    } else {
+      ok = false;
+    }
+  }
+  if (!ok || opt.empty() || plugin.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::sort(sizes.begin(), sizes.end());
+
+  std::cout << "instructions_per_function,functions,blocks,instructions,conditional_branches,"
+               "extract_s,extract_max_rss_kb,verify_s,verify_max_rss_kb,time_exponent,memory_exponent"
+            << std::endl;
+
+  std::vector<Measurement> measurements;
+  bool superLinear = false;
+  for (uint64_t size : sizes) {
+    std::string path = "synthetic_" + std::to_string(size) + ".ll";
+    Measurement m;
+    {
+      llvm::LLVMContext Ctx;
+      SyntheticIROptions sized = options;
+      sized.instructions = size;
+      SyntheticIRGenerator Generator(Ctx, sized);
+      std::unique_ptr<llvm::Module> M = Generator.generate(path);
+      m.stats = syntheticIRStats(*M);
+      if (!writeModule(*M, path)) return 1;
+    }
+
+    m.extract = runTrials({opt, "-load-pass-plugin=" + plugin, "-passes=control-flow-extractor", path, "-o",
+                           "/dev/null"},
+                          trials);
+    m.verify = runTrials({opt, "-passes=verify", path, "-o", "/dev/null"}, trials);
+    if (!keep) std::remove(path.c_str());
+    if (!m.extract.ok || !m.verify.ok) {
+      std::cerr << "opt failed on " << path << (keep ? "" : " (rerun with --keep to inspect it)") << std::endl;
+      return 1;
+    }
+
+    std::cout << size << "," << m.stats.functions << "," << m.stats.blocks << "," << m.stats.instructions << ","
+              << m.stats.branches << "," << m.extract.seconds << "," << m.extract.maxRssKb << ","
+              << m.verify.seconds << "," << m.verify.maxRssKb << ",";
+    double timeExponent = NAN, memoryExponent = NAN;
+    if (!measurements.empty()) {
+      const Measurement &p = measurements.back();
+      double na = double(p.stats.instructions), nb = double(m.stats.instructions);
+      timeExponent = exponent(p.extract.seconds - p.verify.seconds, m.extract.seconds - m.verify.seconds, na, nb);
+      memoryExponent = exponent(double(p.extract.maxRssKb - p.verify.maxRssKb),
+                                double(m.extract.maxRssKb - m.verify.maxRssKb), na, nb);
+    }
+    printExponent(timeExponent);
+    std::cout << ",";
+    printExponent(memoryExponent);
+    std::cout << std::endl;
+    if (timeExponent > SuperLinearExponent || memoryExponent > SuperLinearExponent) {
+      std::cerr << "Warning: super-linear growth from " << measurements.back().stats.instructions << " to "
+                << m.stats.instructions << " instructions (time exponent " << timeExponent << ", memory exponent "
+                << memoryExponent << ")" << std::endl;
+      superLinear = true;
+    }
+    measurements.push_back(m);
+  }
+  return superLinear ? 2 : 0;
+}
@@ -1,20 +1,252 @@
+#include <algorithm>
+#include <atomic> // For std::atomic_signal_fence
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <cerrno>
+#include <csignal>
 #include <cstdint>
+#include <cstdio> // For std::snprintf
+#include <cstdlib>
 #include <cstring> // For std::strcmp
+#include <string>
+#include <vector>
+
+#include <fcntl.h> // For open
+#include <pthread.h> // For pthread_atfork
+#include <sys/mman.h> // For shm_open, mmap
+#include <time.h> // For clock_gettime
+#include <unistd.h> // For getpid, write
+
+#include "BranchLiveCounters.h"
+#include "BranchProfile.h"
+#include "BranchTraceFormat.h"
+#include "dynamic_branch_predictor.h"
 
 namespace {
-  std::ofstream logFile;
+  // The trace goes through one preallocated buffer and plain write() calls, so that
+  // a fatal signal handler can still save it (see flushOnSignal). The buffer is
+  // BRANCH_HISTORY_BUFFER_BYTES large (default 4 MiB; 0 writes every event at once).
+  int logFd = -1;
+  size_t outputBufferBytes = 4 << 20;
+  std::vector<char> outBuffer; // sized once when the trace is opened, never reallocated
+  volatile size_t outUsed = 0;
+  volatile size_t outFlushed = 0; // prefix of outBuffer already written by the current flush
+  volatile sig_atomic_t inDirectWrite = 0; // a write bypassing outBuffer is in progress
+  volatile sig_atomic_t bufferResetting = 0; // outFlushed and outUsed are being zeroed after a flush
+  volatile sig_atomic_t signalFlushed = 0;
+  // Encoder calls change std::vector state (and a finished chunk waits in encodedBuffer
+  // until it is copied out), which a signal handler cannot read consistently. They run
+  // with encoderBusy set; a SIGTERM arriving then is held in deferredSignal and raised
+  // again once the encoder is consistent.
+  volatile sig_atomic_t encoderBusy = 0;
+  volatile sig_atomic_t deferredSignal = 0;
+  uint64_t outFileBytes = 0; // bytes written to logFd
+  bool writeFailed = false;
+
+  // Self-instrumentation of the trace writer, kept off the per-event path except for
+  // the two event counters. It goes into every trace's statistics footer (see
+  // BranchTraceFormat.h) and, with BRANCH_HISTORY_STATS=1, to stderr at exit. The
+  // writer runs on the program's own thread, so writer time is the time spent in
+  // flushes plus chunk/block encoding.
+  struct RuntimeStats {
+    uint64_t events = 0;
+    uint64_t eventsDropped = 0;  // not traced: tracing stopped at the size cap, failed or a signal froze it
+    uint64_t bytesWritten = 0;
+    uint64_t flushes = 0;
+    uint64_t flushNanos = 0;
+    uint64_t flushLatency[32] = {}; // flushes by floor(log2(nanoseconds))
+    uint64_t bufferHighWater = 0;   // fullest outBuffer got
+    uint64_t encodeNanos = 0;
+    uint64_t encodedHighWater = 0;  // largest encoded chunk/block
+    uint64_t startNanos = 0;
+  };
+  RuntimeStats stats;
+  bool printStats = false;
+  bool traceDisabled = false; // the requested trace stopped; later events count as dropped
+
+  // CLOCK_MONOTONIC goes through the vDSO, so sampling it costs no system call
+  uint64_t monotonicNanos() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+  }
+
+  void recordFlush(uint64_t startNanos, uint64_t bytes) {
+    uint64_t nanos = monotonicNanos() - startNanos;
+    unsigned bucket = 0;
+    while (bucket < 31 && (nanos >> (bucket + 1))) {
+      bucket++;
+    }
+    stats.flushes++;
+    stats.flushNanos += nanos;
+    stats.flushLatency[bucket]++;
+    stats.bytesWritten += bytes;
+  }
   const char* programName = nullptr; // Will be set via env or initialization
-}
 
-// Function to initialize the program name (called from main or elsewhere)
-extern "C" void setProgramName(const char* name) {
-  programName = name;
-}
+  // BRANCH_TRACE_FORMAT=rle|block writes <program>_branch_history.{rle,blk}
+  // (see BranchTraceFormat.h) instead of the "<id>,<taken>" text log (after its
+  // status header line); =none writes no trace, only the run's profile
+  enum class TraceFormat { Text, Rle, Block, None };
+  TraceFormat traceFormat = TraceFormat::Text;
+  const uint64_t rleChunkEvents = 1 << 20;
+  RleTraceEncoder rleEncoder;
+  const uint64_t blockEvents = 1 << 20;
+  BlockTraceEncoder blockEncoder;
+  std::vector<uint8_t> encodedBuffer; // binary output waiting to be written
 
-extern "C" void logBranchOutcome(uint64_t branchID, bool taken) {
-  if (!logFile.is_open()) {
+  // Text logs get their trace index as a "<log>.idx" sidecar written at exit
+  const uint64_t textIndexEvents = 1 << 20;
+  TraceIndexBuilder textIndex;
+  uint64_t textBlockStart = 0;
+  std::string logPath;
+
+  // BRANCH_HISTORY_SEGMENT_BYTES=<n> rotates the trace into numbered segments of at most
+  // about n bytes each (binary segments end on a chunk/block boundary), every one a complete
+  // trace, listed in <program>_branch_history.manifest (see BranchTraceFormat.h).
+  // BRANCH_HISTORY_TOTAL_BYTES=<n> caps the segments together: the oldest are deleted
+  // (BRANCH_HISTORY_CAP_POLICY=drop-oldest, the default) or tracing stops (=stop).
+  enum class SegmentState { Open, Complete, Dropped };
+  const char* const segmentStateNames[] = {"open", "complete", "dropped"};
+  struct TraceSegment {
+    uint64_t firstEvent;
+    uint64_t events;
+    uint64_t bytes;
+    SegmentState state;
+    std::string file;
+  };
+  uint64_t segmentBytesLimit = 0;
+  uint64_t totalBytesLimit = 0;
+  bool stopAtLimit = false;
+  std::vector<TraceSegment> segments;
+  int manifestFd = -1;
+  uint64_t segmentEvents = 0; // events in the open segment
+  // Binary segments end their chunks/blocks early to stay under the limit: a chunk holds
+  // as many events as the bytes per event seen so far leave room for, after the space
+  // the last segment's closing chunk, statistics and index took and a small margin.
+  // Text segments end before a record could cross the limit.
+  const uint64_t minSegmentChunkEvents = 4096;
+  const uint64_t maxTextRecordBytes = 64;
+  uint64_t chunkEventsLimit = 1 << 20;
+  uint64_t chunkedEvents = 0; // over the run, for the bytes per event
+  uint64_t chunkedBytes = 0;
+  uint64_t segmentTrailerBytes = 0;
+  bool segmentFull = false;
+
+  // Global history register (newest outcome in bit 0) and a hash of the most
+  // recent branch IDs; both describe the path that led to the current branch.
+  uint64_t globalHistory = 0;
+  uint64_t pathHistory = 0;
+
+  // BRANCH_HISTORY_RECORD_HISTORY=1 appends ",<ghr>,<path>" to every text record
+  bool recordHistory = false;
+
+  // Fatal signals whose handler saves the trace; BRANCH_HISTORY_SIGNAL_HANDLERS=0 skips them
+  const int flushSignals[] = {SIGSEGV, SIGABRT, SIGBUS, SIGTERM};
+  struct sigaction previousActions[sizeof(flushSignals) / sizeof(flushSignals[0])];
+  bool signalHandlersInstalled = false;
+
+  // The handlers run on an alternate signal stack, so that a stack overflow still gets
+  // its trace saved. The thread that initializes the runtime (the tracing one) gets
+  // one, as does every thread of the shards mode on its first event; a thread that
+  // already has its own keeps it. Released when the thread ends.
+  const size_t signalStackBytes = 64 << 10;
+  struct SignalStack {
+    void* memory = nullptr;
+    ~SignalStack();
+  };
+
+  // BRANCH_HISTORY_GHR_COUNTERS=<bits> keeps per-branch (executions, taken)
+  // counters indexed by the last <bits> global outcomes, dumped at exit.
+  unsigned ghrCounterBits = 0;
+  std::vector<std::vector<uint64_t>> ghrCounters; // branchID -> [2 * pattern + {0: executions, 1: taken}]
+
+  // BRANCH_HISTORY_SAMPLE_PERIOD=<n>: the sample mode traces every n-th event (default 1024)
+  uint64_t samplePeriod = 1024;
+  uint64_t sampleCountdown = 1;
+
+  // The predict mode runs a gshare predictor inline (2-bit counters indexed by branch
+  // ID xor global history, starting strongly not-taken) and counts its mispredictions
+  // per branch, written at exit to
+  // branch_history_logs/<program_name>_branch_mispredictions[_<pid>].log as
+  // "<branch_id>,<executions>,<mispredictions>"
+  const unsigned gshareBits = 16;
+  uint8_t gshareCounters[1 << gshareBits];
+  std::vector<uint64_t> mispredictions;
+  bool initialized = false;
+  bool finalized = false;
+
+  // "" or "_<pid>": set in children created by fork() (each traces to its own files),
+  // and from the start with BRANCH_HISTORY_PER_PROCESS=1 for programs run in parallel
+  std::string processSuffix;
+
+  // Per-branch counts for this run's profile (see BranchProfile.h), written at exit to
+  // branch_history_logs/<program_name>_branch_profile_<pid>_<timestamp>.bprof so that
+  // concurrent or repeated runs never overwrite each other's profiles
+  // The counts live in profileSlots[0, profileCapacity): profileCounts' storage, or with
+  // BRANCH_HISTORY_SHM=1 a shared memory segment that BranchTop can watch while the
+  // program runs (see BranchLiveCounters.h); both cost the same per event. The shards
+  // and atomic modes count elsewhere and fill profileSlots only at exit, so they refuse
+  // BRANCH_HISTORY_SHM rather than show a segment that stays empty.
+  using ProfileCounts = LiveBranchCounts;
+  std::vector<ProfileCounts> profileCounts;
+  ProfileCounts* profileSlots = nullptr;
+  uint64_t profileCapacity = 0;
+  bool liveCountersEnabled = false;
+  LiveCounterHeader* liveHeader = nullptr;
+  size_t liveMappedBytes = 0;
+  std::string liveName;
+
+  // Counter layouts of the multithreaded counting modes (shards, atomic; see
+  // recordBranch). profileSlots is written without synchronization, which is right for
+  // one thread only; these layouts are summed into it at exit.
+  enum class CounterLayout { Flat, Sharded, Atomic };
+  CounterLayout counterLayout = CounterLayout::Flat;
+
+  // Sharded: every thread counts into its own cache-line aligned table, so no two
+  // threads ever write the same line and counting scales with the thread count.
+  // transitions are against the same thread's previous execution of the branch.
+  struct alignas(64) CounterLine {
+    ProfileCounts slots[2];
+  };
+  struct CounterShard {
+    std::vector<CounterLine> lines;
+    CounterShard();
+    ~CounterShard(); // a finishing thread hands its counts to lockedCounts
+  };
+  std::mutex shardMutex; // guards liveShards, shard resizing and lockedCounts
+  std::vector<CounterShard*> liveShards;
+  std::vector<ProfileCounts> lockedCounts; // finished threads' counts, and events no table could take
+  thread_local CounterLine* shardLines = nullptr;
+  thread_local uint64_t shardCapacity = 0; // slots
+  thread_local bool shardFinished = false;
+
+  // Atomic: one table for all threads, updated with relaxed atomic adds, so memory does
+  // not grow with the thread count. The BRANCH_HISTORY_HOT_BRANCHES (default 64) most
+  // executed branches of a prior profile (BRANCH_HISTORY_HOT_PROFILE=<bprof>) get a
+  // cache line each, so threads busy in different hot branches never share a line; the
+  // rest are packed two per line. Threads in the same branch still share its line,
+  // which only the shards avoid. The table covers branch IDs below
+  // BRANCH_HISTORY_BRANCH_CAPACITY (default 65536, at least the profile's largest ID
+  // + 1); other IDs are counted under shardMutex.
+  struct AtomicCounts {
+    std::atomic<uint64_t> executions;
+    std::atomic<uint64_t> taken;
+    std::atomic<uint64_t> transitions;
+    std::atomic<uint64_t> lastOutcome; // noOutcome before the first execution
+  };
+  struct alignas(64) AtomicCountLine {
+    AtomicCounts slots[2];
+  };
+  const uint64_t noOutcome = 2;
+  std::vector<AtomicCountLine> atomicLines;    // two branches per line
+  std::vector<AtomicCountLine> atomicHotLines; // one hot branch per line, in slots[0]
+  std::vector<AtomicCounts*> atomicSlots;      // branchID -> its slot in either
+  uint64_t atomicCapacity = 0;
+
+  const char* getProgramName() {
     // Fallback to environment variable if not set explicitly
     if (!programName) {
       programName = std::getenv("PROGRAM_NAME");
@@ -22,11 +254,303 @@ extern "C" void logBranchOutcome(uint64_t branchID, bool taken) {
         programName = "unknown"; // Default if neither is set
       }
     }
+    return programName;
+  }
+
+  void readTraceFormat() {
+    const char* format = std::getenv("BRANCH_TRACE_FORMAT");
+    if (format && std::strcmp(format, "rle") == 0) {
+      traceFormat = TraceFormat::Rle;
+    } else if (format && std::strcmp(format, "block") == 0) {
+      traceFormat = TraceFormat::Block;
+    } else if (format && std::strcmp(format, "none") == 0) {
+      traceFormat = TraceFormat::None;
+    } else if (format && std::strcmp(format, "text") != 0) {
+      std::cerr << "Warning: unknown BRANCH_TRACE_FORMAT " << format << ", using text" << std::endl;
+    }
+  }
+
+  // write() until done; async-signal-safe
+  bool writeAll(const char* data, size_t n) {
+    while (n) {
+      ssize_t written = write(logFd, data, n);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        return false;
+      }
+      data += written;
+      n -= size_t(written);
+    }
+    return true;
+  }
+
+  void reportWriteFailure() {
+    if (!writeFailed) {
+      writeFailed = true;
+      std::cerr << "Failed to write " << logPath << std::endl;
+    }
+  }
+
+  // Writes out the buffer. outFlushed advances with every write() so that a signal
+  // handler interrupting this flush writes only the rest.
+  void flushOutput() {
+    if (!outUsed) {
+      return;
+    }
+    uint64_t start = monotonicNanos();
+    stats.bufferHighWater = std::max(stats.bufferHighWater, uint64_t(outUsed));
+    while (outFlushed < outUsed) {
+      ssize_t written = write(logFd, outBuffer.data() + outFlushed, outUsed - outFlushed);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        reportWriteFailure();
+        break;
+      }
+      outFlushed = outFlushed + size_t(written);
+    }
+    outFileBytes += outUsed;
+    recordFlush(start, outUsed);
+    // The signal handler writes nothing while both are being zeroed, as the bytes are out
+    bufferResetting = 1;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    outFlushed = 0;
+    outUsed = 0;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    bufferResetting = 0;
+  }
+
+  void writeOutput(const char* data, size_t n) {
+    if (signalFlushed) {
+      return;
+    }
+    if (outUsed + n > outBuffer.size()) {
+      flushOutput();
+      if (n > outBuffer.size()) {
+        uint64_t start = monotonicNanos();
+        inDirectWrite = 1;
+        if (!writeAll(data, n)) {
+          reportWriteFailure();
+        }
+        inDirectWrite = 0;
+        outFileBytes += n;
+        recordFlush(start, n);
+        return;
+      }
+    }
+    std::memcpy(outBuffer.data() + outUsed, data, n);
+    std::atomic_signal_fence(std::memory_order_release); // bytes first, then the length covering them
+    outUsed = outUsed + n;
+  }
+
+  uint64_t outputPosition() {
+    return outFileBytes + outUsed;
+  }
+
+  char* appendDecimal(char* p, uint64_t v) {
+    char digits[20];
+    int n = 0;
+    do {
+      digits[n++] = char('0' + v % 10);
+      v /= 10;
+    } while (v);
+    while (n) {
+      *p++ = digits[--n];
+    }
+    return p;
+  }
+
+  // "key=value" lines for the footer and stderr; counts are for the whole run so far
+  std::string formatStats() {
+    double seconds = double(monotonicNanos() - stats.startNanos) / 1e9;
+    std::string text;
+    auto put = [&](const char* key, const std::string& value) {
+      text += key;
+      text += "=" + value + "\n";
+    };
+    put("events", std::to_string(stats.events));
+    put("events_dropped", std::to_string(stats.eventsDropped));
+    put("elapsed_s", std::to_string(seconds));
+    put("events_per_s", std::to_string(seconds > 0 ? double(stats.events) / seconds : 0.0));
+    put("bytes_written", std::to_string(stats.bytesWritten));
+    put("flushes", std::to_string(stats.flushes));
+    put("flush_ns", std::to_string(stats.flushNanos));
+    std::string histogram;
+    for (unsigned bucket = 0; bucket < 32; bucket++) {
+      if (stats.flushLatency[bucket]) {
+        histogram += (histogram.empty() ? "" : " ") + std::to_string(uint64_t(1) << bucket) + ":" +
+                     std::to_string(stats.flushLatency[bucket]);
+      }
+    }
+    put("flush_latency_ns_log2", histogram);
+    put("encode_ns", std::to_string(stats.encodeNanos));
+    put("writer_ns", std::to_string(stats.flushNanos + stats.encodeNanos));
+    put("buffer_bytes", std::to_string(outBuffer.size()));
+    put("buffer_high_water_bytes", std::to_string(stats.bufferHighWater));
+    put("encoded_high_water_bytes", std::to_string(stats.encodedHighWater));
+    return text;
+  }
+
+  void recordEncode(uint64_t startNanos) {
+    stats.encodeNanos += monotonicNanos() - startNanos;
+    stats.encodedHighWater = std::max<uint64_t>(stats.encodedHighWater, encodedBuffer.size());
+  }
+
+  inline void beginEncoding() {
+    encoderBusy = 1;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  }
+
+  // A SIGTERM held during the encoder call is delivered now, and finds the encoder consistent
+  inline void endEncoding() {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    encoderBusy = 0;
+    if (deferredSignal) {
+      int sig = deferredSignal;
+      deferredSignal = 0;
+      raise(sig);
+    }
+  }
+
+  // Sizes the next chunk/block to the space the open segment has left
+  void planChunk(uint64_t fullChunkEvents) {
+    // A 1/64 margin absorbs chunks compressing worse than the estimate
+    uint64_t position = outputPosition() + segmentTrailerBytes + segmentBytesLimit / 64;
+    uint64_t left = position < segmentBytesLimit ? segmentBytesLimit - position : 0;
+    if (!chunkedEvents) {
+      // No bytes per event yet: a small chunk measures them
+      chunkEventsLimit = minSegmentChunkEvents;
+      segmentFull = false;
+      return;
+    }
+    double fits = double(left) * chunkedEvents / std::max<uint64_t>(chunkedBytes, 1);
+    segmentFull = fits < double(minSegmentChunkEvents) && segmentEvents > 0;
+    chunkEventsLimit = std::min<uint64_t>(fullChunkEvents, std::max<uint64_t>(minSegmentChunkEvents, uint64_t(fits)));
+  }
+
+  void writeChunk(uint64_t events, bool last) {
+    uint64_t bytes = encodedBuffer.size();
+    writeOutput(reinterpret_cast<const char*>(encodedBuffer.data()), bytes);
+    encodedBuffer.clear();
+    if (!segmentBytesLimit) return;
+    if (last) {
+      // What the closing write took beyond its events' share is reserved in later segments
+      uint64_t share = chunkedEvents ? uint64_t(double(events) * chunkedBytes / chunkedEvents) : 0;
+      segmentTrailerBytes = bytes > share ? bytes - share : 0;
+      return;
+    }
+    if (events) {
+      chunkedEvents += events;
+      chunkedBytes += bytes;
+    }
+    planChunk(traceFormat == TraceFormat::Rle ? rleChunkEvents : blockEvents);
+  }
+
+  // Writes the pending chunk; the last one is followed by the statistics and the trace index
+  void writeRleChunk(bool last) {
+    uint64_t start = monotonicNanos();
+    uint64_t events = rleEncoder.events();
+    std::string footer = last ? formatStats() : std::string();
+    beginEncoding();
+    if (last) {
+      rleEncoder.finish(encodedBuffer, footer);
+    } else {
+      rleEncoder.finishChunk(encodedBuffer);
+    }
+    recordEncode(start);
+    writeChunk(events, last);
+    endEncoding();
+  }
+
+  // Writes the pending block; the last one is followed by the statistics and the trace index
+  void writeBlock(bool last) {
+    uint64_t start = monotonicNanos();
+    uint64_t events = blockEncoder.events();
+    std::string footer = last ? formatStats() : std::string();
+    beginEncoding();
+    if (last) {
+      blockEncoder.finish(encodedBuffer, footer);
+    } else {
+      blockEncoder.finishBlock(encodedBuffer);
+    }
+    recordEncode(start);
+    writeChunk(events, last);
+    endEncoding();
+  }
+
+  void writeTextIndex() {
+    textIndex.finishBlock(outputPosition() - textBlockStart);
+    encodedBuffer.clear();
+    putTraceStats(encodedBuffer, formatStats());
+    textIndex.write(encodedBuffer, 0, encodedBuffer.size());
+    std::ofstream indexFile(logPath + ".idx", std::ios::out | std::ios::binary);
+    indexFile.write(reinterpret_cast<const char*>(encodedBuffer.data()), encodedBuffer.size());
+    if (!indexFile) {
+      std::cerr << "Failed to write " << logPath << ".idx" << std::endl;
+    }
+    encodedBuffer.clear();
+  }
+
+  std::string traceBasePath() {
+    std::string path = "branch_history_logs/";
+    path += programName;
+    path += "_branch_history" + processSuffix;
+    return path;
+  }
+
+  std::string manifestPath() {
+    return traceBasePath() + ".manifest";
+  }
+
+  // The manifest gets a row appended whenever a segment opens, completes or is dropped,
+  // and its status rewritten in place, so a long run writes every row only once
+  void appendManifest(const std::string& text) {
+    if (manifestFd >= 0 && write(manifestFd, text.data(), text.size()) != ssize_t(text.size())) {
+      std::cerr << "Failed to write " << manifestPath() << std::endl;
+    }
+  }
+
+  void openManifest() {
+    manifestFd = open(manifestPath().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (manifestFd < 0) {
+      std::cerr << "Failed to open " << manifestPath() << std::endl;
+      return;
+    }
+    appendManifest(std::string(TraceManifestHeader) + " status=" + TraceManifestStatus[0] + "\n" +
+                   "segment,first_event,events,bytes,state,file\n");
+  }
+
+  void writeManifestRow(size_t i) {
+    const TraceSegment& S = segments[i];
+    appendManifest(std::to_string(i) + "," + std::to_string(S.firstEvent) + "," + std::to_string(S.events) + "," +
+                   std::to_string(S.bytes) + "," + segmentStateNames[int(S.state)] + "," + S.file + "\n");
+  }
+
+  // status indexes TraceManifestStatus
+  void writeManifestStatus(int status) {
+    if (manifestFd >= 0 && pwrite(manifestFd, TraceManifestStatus[status], 8, TraceManifestStatusOffset) != 8) {
+      std::cerr << "Failed to write " << manifestPath() << std::endl;
+    }
+  }
 
-    // Construct log file path: branch_history_logs/<program_name>_branch_history.log
-    std::string logPath = "branch_history_logs/";
-    logPath += programName;
-    logPath += "_branch_history.log";
+  void openTrace() {
+    // Construct log file path: branch_history_logs/<program_name>_branch_history[_<pid>][.<segment>].{log,rle,blk}
+    logPath = traceBasePath();
+    if (segmentBytesLimit) {
+      char number[16];
+      std::snprintf(number, sizeof(number), ".%06zu", segments.size());
+      logPath += number;
+    }
+    if (traceFormat == TraceFormat::Rle) {
+      logPath += ".rle";
+    } else if (traceFormat == TraceFormat::Block) {
+      logPath += ".blk";
+    } else {
+      logPath += ".log";
+    }
 
     // Ensure the directory exists (rudimentary check, Bash will handle creation)
     std::ofstream dirCheck("branch_history_logs/.test", std::ios::out);
@@ -37,12 +561,1133 @@ extern "C" void logBranchOutcome(uint64_t branchID, bool taken) {
       std::cerr << "Warning: branch_history_logs directory may not exist" << std::endl;
     }
 
-    logFile.open(logPath, std::ios::out);
-    if (!logFile) {
+    logFd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (logFd < 0) {
       std::cerr << "Failed to open " << logPath << std::endl;
+      traceFormat = TraceFormat::None; // keep profiling without a trace
+      traceDisabled = true;
+      return;
+    }
+    outBuffer.resize(outputBufferBytes);
+    std::remove((logPath + ".idx").c_str()); // a previous run's sidecar no longer applies
+    if (traceFormat == TraceFormat::Rle) {
+      beginEncoding();
+      rleEncoder.start(encodedBuffer);
+      endEncoding();
+      writeRleChunk(false);
+    } else if (traceFormat == TraceFormat::Block) {
+      beginEncoding();
+      blockEncoder.start(encodedBuffer);
+      endEncoding();
+      writeBlock(false);
+    } else {
+      std::string header = TextTraceHeaderPrefix;
+      header += TextTraceStatus[0];
+      header += "\n";
+      writeOutput(header.data(), header.size());
+    }
+
+    if (segmentBytesLimit) {
+      uint64_t firstEvent = segments.empty() ? 0 : segments.back().firstEvent + segments.back().events;
+      segments.push_back({firstEvent, 0, 0, SegmentState::Open, logPath.substr(logPath.rfind('/') + 1)});
+      segmentEvents = 0;
+      if (traceFormat == TraceFormat::Rle || traceFormat == TraceFormat::Block) {
+        planChunk(traceFormat == TraceFormat::Rle ? rleChunkEvents : blockEvents);
+      }
+      if (manifestFd < 0) {
+        openManifest();
+      }
+      writeManifestRow(segments.size() - 1);
+    }
+  }
+
+  // Completes the open trace file: the last chunk/block and the index, or the text
+  // log's status and sidecar
+  void closeTrace() {
+    if (traceFormat == TraceFormat::Rle) {
+      writeRleChunk(true);
+    } else if (traceFormat == TraceFormat::Block) {
+      writeBlock(true);
+    } else {
+      writeTextIndex();
+    }
+    flushOutput();
+    if (traceFormat == TraceFormat::Text &&
+        pwrite(logFd, TextTraceStatus[1], 9, TextTraceStatusOffset) != 9) {
+      reportWriteFailure();
+    }
+    close(logFd);
+    logFd = -1;
+
+    if (segmentBytesLimit) {
+      TraceSegment& S = segments.back();
+      S.events = segmentEvents;
+      S.bytes = outFileBytes;
+      S.state = SegmentState::Complete;
+      writeManifestRow(segments.size() - 1);
+    }
+  }
+
+  void resetTraceWriter() {
+    beginEncoding();
+    rleEncoder = RleTraceEncoder();
+    blockEncoder = BlockTraceEncoder();
+    textIndex = TraceIndexBuilder();
+    textBlockStart = 0;
+    encodedBuffer.clear();
+    endEncoding();
+    bufferResetting = 1;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    outFlushed = 0;
+    outUsed = 0;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    bufferResetting = 0;
+    outFileBytes = 0;
+  }
+
+  // Closes the full segment and opens the next, unless the total cap forbids it
+  void rotateTrace() {
+    closeTrace();
+    resetTraceWriter();
+    if (totalBytesLimit) {
+      // The next segment is expected to be as large as the largest so far, which the
+      // limits above keep about at segmentBytesLimit
+      uint64_t kept = 0, next = 0;
+      for (const TraceSegment& S : segments) {
+        if (S.state != SegmentState::Dropped) kept += S.bytes;
+        next = std::max(next, S.bytes);
+      }
+      if (stopAtLimit && kept + next > totalBytesLimit) {
+        traceFormat = TraceFormat::None;
+        traceDisabled = true;
+        writeManifestStatus(2);
+        std::cerr << "Branch trace stopped at BRANCH_HISTORY_TOTAL_BYTES=" << totalBytesLimit << std::endl;
+        return;
+      }
+      for (size_t i = 0; i < segments.size() && kept + next > totalBytesLimit; i++) {
+        TraceSegment& S = segments[i];
+        if (S.state == SegmentState::Dropped) continue;
+        std::string path = "branch_history_logs/" + S.file;
+        std::remove(path.c_str());
+        std::remove((path + ".idx").c_str());
+        S.state = SegmentState::Dropped;
+        kept -= S.bytes;
+        writeManifestRow(i);
+      }
+    }
+    openTrace();
+  }
+
+  // Fatal signal handler. Saves everything logged so far using only async-signal-safe
+  // calls (write, pwrite; no allocation or locks): the buffer, then the events still
+  // held by the encoder as one more chunk/block. The trace is then marked truncated
+  // in its header and the signal goes on to the previous handler, or to the default
+  // action. Events logged after this point are not traced.
+  // SIGTERM comes from outside, so one arriving inside an encoder call waits for its
+  // end (see endEncoding). The other signals are raised by the faulting code itself and
+  // cannot wait: inside an encoder call (e.g. an abort on a failed allocation) only the
+  // buffer is saved and the encoder's pending events are lost.
+  void flushOnSignal(int sig, siginfo_t* info, void* context) {
+    if (sig == SIGTERM && encoderBusy && logFd >= 0 && !signalFlushed) {
+      deferredSignal = sig;
+      return;
+    }
+    if (logFd >= 0 && !signalFlushed) {
+      signalFlushed = 1;
+      TraceFormat format = traceFormat;
+      traceFormat = TraceFormat::None;
+      traceDisabled = true;
+      // Output cut off inside a direct write cannot be continued
+      if (!inDirectWrite) {
+        size_t flushed = outFlushed, used = outUsed;
+        if (!bufferResetting && flushed < used) {
+          writeAll(outBuffer.data() + flushed, used - flushed);
+        }
+        auto write = [](const uint8_t* data, size_t n) { writeAll(reinterpret_cast<const char*>(data), n); };
+        if (encoderBusy) {
+          // Inconsistent encoder state is not read
+        } else if (format == TraceFormat::Rle) {
+          rleEncoder.writePending(write);
+        } else if (format == TraceFormat::Block) {
+          blockEncoder.writePending(write);
+        }
+      }
+      if (format == TraceFormat::Text) {
+        ssize_t ignored = pwrite(logFd, TextTraceStatus[2], 9, TextTraceStatusOffset);
+        (void)ignored;
+      } else if (format != TraceFormat::None) {
+        ssize_t ignored = pwrite(logFd, &TruncatedTraceMark, 1, TraceStatusByte);
+        (void)ignored;
+      }
+    }
+
+    for (size_t i = 0; i < sizeof(flushSignals) / sizeof(flushSignals[0]); i++) {
+      if (flushSignals[i] != sig) {
+        continue;
+      }
+      struct sigaction& previous = previousActions[i];
+      if (previous.sa_flags & SA_SIGINFO) {
+        previous.sa_sigaction(sig, info, context);
+      } else if (previous.sa_handler != SIG_IGN && previous.sa_handler != SIG_DFL) {
+        previous.sa_handler(sig);
+      } else if (previous.sa_handler == SIG_DFL) {
+        // Delivered with the default action once this handler returns
+        sigaction(sig, &previous, nullptr);
+        raise(sig);
+      }
+      return;
+    }
+  }
+
+  thread_local SignalStack signalStack;
+
+  SignalStack::~SignalStack() {
+    if (memory) {
+      stack_t disabled;
+      std::memset(&disabled, 0, sizeof(disabled));
+      disabled.ss_flags = SS_DISABLE;
+      sigaltstack(&disabled, nullptr);
+      std::free(memory);
+    }
+  }
+
+  void installSignalStack() {
+    stack_t current;
+    if (signalStack.memory || (sigaltstack(nullptr, &current) == 0 && !(current.ss_flags & SS_DISABLE))) {
+      return;
+    }
+    stack_t stack;
+    std::memset(&stack, 0, sizeof(stack));
+    stack.ss_size = std::max<size_t>(signalStackBytes, SIGSTKSZ);
+    stack.ss_sp = std::malloc(stack.ss_size);
+    if (!stack.ss_sp || sigaltstack(&stack, nullptr) != 0) {
+      std::free(stack.ss_sp);
+      std::cerr << "Warning: failed to set up a signal stack; a stack overflow will lose the trace" << std::endl;
+      return;
+    }
+    signalStack.memory = stack.ss_sp;
+  }
+
+  void installSignalHandlers() {
+    const char* enabled = std::getenv("BRANCH_HISTORY_SIGNAL_HANDLERS");
+    if (enabled && std::strcmp(enabled, "0") == 0) {
+      return;
+    }
+    installSignalStack();
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = flushOnSignal;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < sizeof(flushSignals) / sizeof(flushSignals[0]); i++) {
+      sigaction(flushSignals[i], &action, &previousActions[i]);
+    }
+    signalHandlersInstalled = true;
+  }
+
+  // Creates this process's segment; on failure the counts stay on the heap
+  void openLiveCounters() {
+    const uint64_t capacity = 1024;
+    liveName = liveCounterName(getProgramName(), uint64_t(getpid()));
+    int fd = shm_open(liveName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+      std::cerr << "Warning: failed to create shared memory " << liveName << std::endl;
+      return;
+    }
+    size_t bytes = liveCounterBytes(capacity);
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, off_t(bytes)) == 0) {
+      map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+      std::cerr << "Warning: failed to map shared memory " << liveName << std::endl;
+      shm_unlink(liveName.c_str());
+      return;
+    }
+    liveHeader = static_cast<LiveCounterHeader*>(map);
+    liveMappedBytes = bytes;
+    liveHeader->capacity = capacity;
+    liveHeader->pid = uint64_t(getpid());
+    liveHeader->startTimeUs = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                                           std::chrono::system_clock::now().time_since_epoch()).count());
+    std::strncpy(liveHeader->programName, getProgramName(), sizeof(liveHeader->programName) - 1);
+    std::memcpy(liveHeader->magic, LiveCounterMagic, sizeof(LiveCounterMagic)); // last: the header is ready
+    profileSlots = liveCounterSlots(liveHeader);
+    profileCapacity = capacity;
+  }
+
+  // Seqlock writer side: readers retry while sequence is odd or has changed
+  bool growLiveCounters(uint64_t capacity) {
+    size_t bytes = liveCounterBytes(capacity);
+    int fd = shm_open(liveName.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+      return false;
+    }
+    liveHeader->sequence.fetch_add(1, std::memory_order_acq_rel);
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, off_t(bytes)) == 0) {
+      map = mremap(liveHeader, liveMappedBytes, bytes, MREMAP_MAYMOVE);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+      liveHeader->sequence.fetch_add(1, std::memory_order_acq_rel);
+      return false;
+    }
+    liveHeader = static_cast<LiveCounterHeader*>(map);
+    liveMappedBytes = bytes;
+    liveHeader->capacity = capacity;
+    liveHeader->sequence.fetch_add(1, std::memory_order_release);
+    profileSlots = liveCounterSlots(liveHeader);
+    profileCapacity = capacity;
+    return true;
+  }
+
+  void growProfileCounts(uint64_t needed) {
+    uint64_t capacity = std::max(needed, 2 * profileCapacity);
+    if (liveHeader && growLiveCounters(capacity)) {
+      return;
+    }
+    if (liveHeader) {
+      // Keep counting on the heap; the viewer sees the counts up to here
+      std::cerr << "Warning: failed to grow shared memory " << liveName << std::endl;
+      profileCounts.assign(profileSlots, profileSlots + profileCapacity);
+      liveHeader = nullptr;
+    }
+    profileCounts.resize(capacity);
+    profileSlots = profileCounts.data();
+    profileCapacity = capacity;
+  }
+
+  // Drops the counts; a forked child must also let go of its parent's segment
+  void resetProfileCounts() {
+    if (liveHeader) {
+      munmap(liveHeader, liveMappedBytes);
+      liveHeader = nullptr;
+    }
+    profileCounts.clear();
+    profileSlots = nullptr;
+    profileCapacity = 0;
+    if (liveCountersEnabled) {
+      openLiveCounters();
+    }
+  }
+
+  void closeLiveCounters() {
+    if (liveHeader) {
+      liveHeader->exited.store(1, std::memory_order_release);
+      shm_unlink(liveName.c_str());
+    }
+  }
+
+  // fork() handlers. Before the fork everything already written is pushed out of
+  // the output buffer so that the child cannot write the parent's events a second
+  // time. The child then drops the state inherited from the parent (pending
+  // chunk/block, index, counters; the parent reports those itself) and continues
+  // in its own "_<pid>" trace, profile and correlation log. The global and path
+  // histories are kept: the child's first branches follow the parent's path.
+  void prepareFork() {
+    if (logFd >= 0 && !signalFlushed) {
+      flushOutput();
+    }
+    shardMutex.lock(); // no other thread may hold it in the child
+  }
+
+  void resumeInParent() {
+    shardMutex.unlock();
+  }
+
+  // The child's threads other than this one are gone; their shards only hold the parent's counts
+  void resetLayoutCounters() {
+    for (CounterShard* shard : liveShards) {
+      std::fill(shard->lines.begin(), shard->lines.end(), CounterLine());
+    }
+    lockedCounts.clear();
+    for (AtomicCounts* counts : atomicSlots) {
+      counts->executions.store(0, std::memory_order_relaxed);
+      counts->taken.store(0, std::memory_order_relaxed);
+      counts->transitions.store(0, std::memory_order_relaxed);
+      counts->lastOutcome.store(noOutcome, std::memory_order_relaxed);
+    }
+  }
+
+  void reopenInChild() {
+    shardMutex.unlock();
+    processSuffix = "_" + std::to_string(getpid());
+    if (finalized) {
+      return;
+    }
+    if (logFd >= 0) {
+      close(logFd); // only closes the child's descriptor
+      logFd = -1;
+    }
+    if (manifestFd >= 0) {
+      close(manifestFd);
+      manifestFd = -1;
+    }
+    resetTraceWriter();
+    segments.clear();
+    stats = RuntimeStats();
+    stats.startNanos = monotonicNanos();
+    if (initialized) {
+      resetProfileCounts();
+    }
+    if (counterLayout != CounterLayout::Flat) {
+      resetLayoutCounters();
+    }
+    ghrCounters.clear();
+    mispredictions.clear();
+    // The child's trace is opened by its first logged branch
+  }
+
+  // Registered at load time, so that a fork() before the first branch still
+  // gives the child its own files
+  const int forkHandlersRegistered = pthread_atfork(prepareFork, resumeInParent, reopenInChild);
+
+  inline void countOutcome(ProfileCounts& counts, bool taken) {
+    if (counts.executions && (counts.lastOutcome != 0) != taken) {
+      counts.transitions++;
+    }
+    counts.executions++;
+    counts.taken += taken;
+    counts.lastOutcome = taken ? 1 : 0;
+  }
+
+  inline void updateProfileCounts(uint64_t branchID, bool taken) {
+    if (branchID >= profileCapacity) {
+      growProfileCounts(branchID + 1);
+    }
+    countOutcome(profileSlots[branchID], taken);
+  }
+
+  // What n countOutcome calls with the outcomes in bits would leave, a word at a time
+  void countOutcomeWords(ProfileCounts& counts, const uint64_t* bits, uint64_t n) {
+    uint64_t last = counts.executions ? counts.lastOutcome : (bits[0] & 1); // the first outcome is no transition
+    for (uint64_t i = 0; i < n; i += 64) {
+      unsigned k = unsigned(std::min<uint64_t>(64, n - i));
+      uint64_t mask = k == 64 ? ~uint64_t(0) : (uint64_t(1) << k) - 1;
+      uint64_t word = bits[i / 64] & mask;
+      uint64_t previous = (word << 1) | last; // bit j: the outcome before outcome j
+      counts.taken += uint64_t(__builtin_popcountll(word));
+      counts.transitions += uint64_t(__builtin_popcountll((word ^ previous) & mask));
+      last = (word >> (k - 1)) & 1;
+    }
+    counts.executions += n;
+    counts.lastOutcome = last;
+  }
+
+  void updateProfileCountsBulk(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+    if (branchID >= profileCapacity) {
+      growProfileCounts(branchID + 1);
+    }
+    countOutcomeWords(profileSlots[branchID], bits, n);
+  }
+
+  // Constructed by a thread's first growShard
+  thread_local CounterShard shard;
+
+  CounterShard::CounterShard() {
+    std::lock_guard<std::mutex> lock(shardMutex);
+    liveShards.push_back(this);
+  }
+
+  CounterShard::~CounterShard() {
+    std::lock_guard<std::mutex> lock(shardMutex);
+    for (uint64_t id = 0; id < 2 * lines.size(); id++) {
+      const ProfileCounts& counts = lines[id / 2].slots[id % 2];
+      if (!counts.executions) {
+        continue;
+      }
+      if (id >= lockedCounts.size()) {
+        lockedCounts.resize(id + 1);
+      }
+      lockedCounts[id].executions += counts.executions;
+      lockedCounts[id].taken += counts.taken;
+      lockedCounts[id].transitions += counts.transitions;
+    }
+    liveShards.erase(std::find(liveShards.begin(), liveShards.end(), this));
+    shardLines = nullptr;
+    shardCapacity = 0;
+    shardFinished = true;
+  }
+
+  void countLocked(uint64_t branchID, bool taken) {
+    std::lock_guard<std::mutex> lock(shardMutex);
+    if (branchID >= lockedCounts.size()) {
+      lockedCounts.resize(branchID + 1);
+    }
+    countOutcome(lockedCounts[branchID], taken);
+  }
+
+  // A thread past its thread_local destructors (which may still log branches) keeps
+  // no shard; its events are counted under the lock
+  void growShard(uint64_t needed) {
+    if (shardFinished) {
+      return;
+    }
+    CounterShard& own = shard;
+    if (own.lines.empty() && signalHandlersInstalled) {
+      installSignalStack(); // this thread's first event
+    }
+    std::lock_guard<std::mutex> lock(shardMutex); // mergeCounters may be reading the lines
+    own.lines.resize(std::max<size_t>((needed + 1) / 2, 2 * own.lines.size()));
+    shardLines = own.lines.data();
+    shardCapacity = 2 * own.lines.size();
+  }
+
+  inline void updateShardCounts(uint64_t branchID, bool taken) {
+    if (branchID >= shardCapacity) {
+      growShard(branchID + 1);
+      if (branchID >= shardCapacity) {
+        countLocked(branchID, taken);
+        return;
+      }
+    }
+    countOutcome(shardLines[branchID >> 1].slots[branchID & 1], taken);
+  }
+
+  void setupAtomicCounters() {
+    uint64_t capacity = 1 << 16;
+    const char* capacityEnv = std::getenv("BRANCH_HISTORY_BRANCH_CAPACITY");
+    if (capacityEnv) {
+      capacity = std::strtoull(capacityEnv, nullptr, 10);
+    }
+    std::vector<uint64_t> hot;
+    const char* hotProfile = std::getenv("BRANCH_HISTORY_HOT_PROFILE");
+    if (hotProfile) {
+      BranchProfile profile;
+      if (readBranchProfile(hotProfile, profile)) {
+        size_t hotBranches = 64;
+        const char* hotEnv = std::getenv("BRANCH_HISTORY_HOT_BRANCHES");
+        if (hotEnv) {
+          hotBranches = size_t(std::strtoull(hotEnv, nullptr, 10));
+        }
+        std::vector<BranchProfileRecord> records = profile.records;
+        hotBranches = std::min(hotBranches, records.size());
+        std::partial_sort(records.begin(), records.begin() + hotBranches, records.end(),
+                          [](const BranchProfileRecord& a, const BranchProfileRecord& b) {
+                            return a.executions > b.executions;
+                          });
+        for (size_t i = 0; i < hotBranches; i++) {
+          hot.push_back(records[i].branchID);
+        }
+        if (!profile.records.empty()) {
+          capacity = std::max(capacity, profile.records.back().branchID + 1);
+        }
+      } else {
+        std::cerr << "Warning: failed to read BRANCH_HISTORY_HOT_PROFILE " << hotProfile << std::endl;
+      }
+    }
+
+    atomicLines = std::vector<AtomicCountLine>((capacity + 1) / 2);
+    atomicHotLines = std::vector<AtomicCountLine>(hot.size());
+    atomicSlots.resize(capacity);
+    for (uint64_t id = 0; id < capacity; id++) {
+      atomicSlots[id] = &atomicLines[id / 2].slots[id % 2];
+    }
+    for (size_t i = 0; i < hot.size(); i++) {
+      atomicSlots[hot[i]] = &atomicHotLines[i].slots[0];
+    }
+    for (AtomicCounts* counts : atomicSlots) {
+      counts->lastOutcome.store(noOutcome, std::memory_order_relaxed);
+    }
+    atomicCapacity = capacity;
+  }
+
+  // lastOutcome is read and written apart, so threads interleaving in one branch can
+  // miss or add a transition; the other counts are exact
+  inline void updateAtomicCounts(uint64_t branchID, bool taken) {
+    if (branchID >= atomicCapacity) {
+      countLocked(branchID, taken);
+      return;
+    }
+    AtomicCounts& counts = *atomicSlots[branchID];
+    counts.executions.fetch_add(1, std::memory_order_relaxed);
+    counts.taken.fetch_add(taken, std::memory_order_relaxed);
+    uint64_t last = counts.lastOutcome.load(std::memory_order_relaxed);
+    if (last != uint64_t(taken)) {
+      counts.lastOutcome.store(taken, std::memory_order_relaxed);
+      if (last != noOutcome) {
+        counts.transitions.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void addProfileCounts(uint64_t branchID, uint64_t executions, uint64_t taken, uint64_t transitions) {
+    if (!executions) {
+      return;
+    }
+    if (branchID >= profileCapacity) {
+      growProfileCounts(branchID + 1);
+    }
+    ProfileCounts& counts = profileSlots[branchID];
+    counts.executions += executions;
+    counts.taken += taken;
+    counts.transitions += transitions;
+    stats.events += executions;
+  }
+
+  // Sums the shards or the atomic table, and the locked counts, into the run's profile.
+  // Threads still running at exit are read as they are.
+  void mergeCounters() {
+    std::lock_guard<std::mutex> lock(shardMutex);
+    for (const CounterShard* shard : liveShards) {
+      for (uint64_t id = 0; id < 2 * shard->lines.size(); id++) {
+        const ProfileCounts& counts = shard->lines[id / 2].slots[id % 2];
+        addProfileCounts(id, counts.executions, counts.taken, counts.transitions);
+      }
+    }
+    for (uint64_t id = 0; id < atomicCapacity; id++) {
+      const AtomicCounts& counts = *atomicSlots[id];
+      addProfileCounts(id, counts.executions.load(std::memory_order_relaxed),
+                       counts.taken.load(std::memory_order_relaxed),
+                       counts.transitions.load(std::memory_order_relaxed));
+    }
+    for (uint64_t id = 0; id < lockedCounts.size(); id++) {
+      addProfileCounts(id, lockedCounts[id].executions, lockedCounts[id].taken, lockedCounts[id].transitions);
+    }
+  }
+
+  void shiftHistory(uint64_t branchID, bool taken) {
+    globalHistory = (globalHistory << 1) | (taken ? 1 : 0);
+    pathHistory = (pathHistory << 4) ^ ((branchID * 0x9E3779B97F4A7C15ull) >> 48);
+  }
+
+  // Only the last 64 outcomes and the last 16 path steps survive in the histories
+  void shiftHistoryBulk(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+    for (uint64_t i = n > 64 ? n - 64 : 0; i < n; i++) {
+      globalHistory = (globalHistory << 1) | ((bits[i / 64] >> (i % 64)) & 1);
+    }
+    for (uint64_t i = 0; i < n && i < 16; i++) {
+      pathHistory = (pathHistory << 4) ^ ((branchID * 0x9E3779B97F4A7C15ull) >> 48);
+    }
+  }
+
+  void writeRunProfile() {
+    BranchProfile profile;
+    profile.programName = getProgramName();
+    profile.runs = 1;
+    for (size_t id = 0; id < profileCapacity; id++) {
+      const ProfileCounts& counts = profileSlots[id];
+      if (counts.executions) {
+        profile.records.push_back({id, counts.executions, counts.taken, counts.transitions});
+      }
+    }
+
+    uint64_t timestamp = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                                      std::chrono::system_clock::now().time_since_epoch()).count());
+    std::string path = "branch_history_logs/";
+    path += getProgramName();
+    path += "_branch_profile_" + std::to_string(getpid()) + "_" + std::to_string(timestamp) + ".bprof";
+    if (!writeBranchProfile(path, profile)) {
+      std::cerr << "Failed to write " << path << std::endl;
+    }
+  }
+
+  void readBufferOptions() {
+    const char* bytes = std::getenv("BRANCH_HISTORY_BUFFER_BYTES");
+    if (bytes) {
+      outputBufferBytes = size_t(std::strtoull(bytes, nullptr, 10));
+    }
+  }
+
+  void readSegmentOptions() {
+    const char* segment = std::getenv("BRANCH_HISTORY_SEGMENT_BYTES");
+    if (segment) {
+      segmentBytesLimit = std::strtoull(segment, nullptr, 10);
+    }
+    const char* total = std::getenv("BRANCH_HISTORY_TOTAL_BYTES");
+    if (total) {
+      totalBytesLimit = std::strtoull(total, nullptr, 10);
+      if (!segmentBytesLimit) {
+        std::cerr << "Warning: BRANCH_HISTORY_TOTAL_BYTES needs BRANCH_HISTORY_SEGMENT_BYTES, ignored" << std::endl;
+        totalBytesLimit = 0;
+      }
+    }
+    const char* policy = std::getenv("BRANCH_HISTORY_CAP_POLICY");
+    if (policy && std::strcmp(policy, "stop") == 0) {
+      stopAtLimit = true;
+    } else if (policy && std::strcmp(policy, "drop-oldest") != 0) {
+      std::cerr << "Warning: unknown BRANCH_HISTORY_CAP_POLICY " << policy << ", using drop-oldest" << std::endl;
+    }
+  }
+
+  void readHistoryOptions() {
+    const char* record = std::getenv("BRANCH_HISTORY_RECORD_HISTORY");
+    recordHistory = record && std::strcmp(record, "0") != 0;
+
+    const char* bits = std::getenv("BRANCH_HISTORY_GHR_COUNTERS");
+    if (bits) {
+      ghrCounterBits = unsigned(std::strtoul(bits, nullptr, 10));
+      if (ghrCounterBits > 16) {
+        std::cerr << "Warning: BRANCH_HISTORY_GHR_COUNTERS capped at 16 bits" << std::endl;
+        ghrCounterBits = 16;
+      }
+    }
+  }
+
+  void updateGhrCounters(uint64_t branchID, bool taken) {
+    if (branchID >= ghrCounters.size()) {
+      ghrCounters.resize(branchID + 1);
+    }
+    std::vector<uint64_t>& counters = ghrCounters[branchID];
+    if (counters.empty()) {
+      counters.assign(size_t(2) << ghrCounterBits, 0);
+    }
+    uint64_t pattern = globalHistory & ((uint64_t(1) << ghrCounterBits) - 1);
+    counters[2 * pattern]++;
+    counters[2 * pattern + 1] += taken;
+  }
+
+  void finalizeAtExit() {
+    finalizeBranchPredictionData();
+  }
+
+  void writeGhrCounters() {
+    std::string path = "branch_history_logs/";
+    path += getProgramName();
+    path += "_branch_correlation" + processSuffix + ".log";
+    std::ofstream out(path, std::ios::out);
+    if (!out) {
+      std::cerr << "Failed to open " << path << std::endl;
+      return;
+    }
+    out << "branch_id,ghr_pattern,executions,taken\n";
+    for (size_t id = 0; id < ghrCounters.size(); id++) {
+      const std::vector<uint64_t>& counters = ghrCounters[id];
+      for (size_t pattern = 0; 2 * pattern < counters.size(); pattern++) {
+        if (counters[2 * pattern]) {
+          out << id << "," << pattern << "," << counters[2 * pattern] << "," << counters[2 * pattern + 1] << "\n";
+        }
+      }
+    }
+  }
+
+  void readSampleOptions() {
+    const char* period = std::getenv("BRANCH_HISTORY_SAMPLE_PERIOD");
+    if (period) {
+      samplePeriod = std::max<uint64_t>(1, std::strtoull(period, nullptr, 10));
+    }
+    sampleCountdown = samplePeriod;
+  }
+
+  inline void predictBranch(uint64_t branchID, bool taken) {
+    if (branchID >= mispredictions.size()) {
+      mispredictions.resize(std::max<size_t>(branchID + 1, 2 * mispredictions.size()));
+    }
+    uint8_t& counter = gshareCounters[(branchID ^ globalHistory) & ((1u << gshareBits) - 1)];
+    mispredictions[branchID] += (counter >> 1) != uint8_t(taken);
+    counter = uint8_t(counter + (taken & (counter < 3)) - (!taken & (counter > 0)));
+    globalHistory = (globalHistory << 1) | (taken ? 1 : 0);
+  }
+
+  void writeMispredictions() {
+    std::string path = "branch_history_logs/";
+    path += getProgramName();
+    path += "_branch_mispredictions" + processSuffix + ".log";
+    std::ofstream out(path, std::ios::out);
+    if (!out) {
+      std::cerr << "Failed to open " << path << std::endl;
+      return;
+    }
+    out << "branch_id,executions,mispredictions\n";
+    for (size_t id = 0; id < mispredictions.size() && id < profileCapacity; id++) {
+      if (profileSlots[id].executions) {
+        out << id << "," << profileSlots[id].executions << "," << mispredictions[id] << "\n";
+      }
+    }
+  }
+
+  // Options shared by every entry point; the trace format and the history options
+  // are read by logBranchOutcome only, the modes below fix their own
+  void initialize() {
+    initialized = true;
+    getProgramName();
+    readBufferOptions();
+    readSegmentOptions();
+    const char* shm = std::getenv("BRANCH_HISTORY_SHM");
+    if (shm && std::strcmp(shm, "0") != 0) {
+      if (counterLayout != CounterLayout::Flat) {
+        std::cerr << "Warning: BRANCH_HISTORY_SHM is not supported by the shards and atomic modes, ignored"
+                  << std::endl;
+      } else {
+        liveCountersEnabled = true;
+        openLiveCounters();
+      }
+    }
+    const char* perProcess = std::getenv("BRANCH_HISTORY_PER_PROCESS");
+    if (perProcess && std::strcmp(perProcess, "0") != 0) {
+      processSuffix = "_" + std::to_string(getpid());
+    }
+    const char* printStatsEnv = std::getenv("BRANCH_HISTORY_STATS");
+    printStats = printStatsEnv && std::strcmp(printStatsEnv, "0") != 0;
+    stats.startNanos = monotonicNanos();
+    std::atexit(finalizeAtExit);
+    installSignalHandlers();
+  }
+
+  inline void traceText(uint64_t branchID, bool taken, bool withHistory) {
+    char line[64];
+    char* end = appendDecimal(line, branchID);
+    *end++ = ',';
+    *end++ = taken ? '1' : '0';
+    if (withHistory) {
+      // History as seen by this branch, i.e. before its own outcome is shifted in
+      *end++ = ',';
+      end = appendDecimal(end, globalHistory);
+      *end++ = ',';
+      end = appendDecimal(end, pathHistory);
+    }
+    *end++ = '\n';
+    writeOutput(line, size_t(end - line));
+
+    textIndex.add(branchID, taken);
+    if (textIndex.blockEvents() == textIndexEvents) {
+      uint64_t position = outputPosition();
+      textIndex.finishBlock(position - textBlockStart);
+      textBlockStart = position;
+    }
+  }
+
+  inline void traceRle(uint64_t branchID, bool taken) {
+    // Buffered in memory; a chunk is written every rleChunkEvents events (fewer near the
+    // end of a segment) and at exit
+    beginEncoding();
+    rleEncoder.add(branchID, taken);
+    endEncoding();
+    if (rleEncoder.events() >= chunkEventsLimit) {
+      writeRleChunk(false);
+    }
+  }
+
+  void traceBlock(uint64_t branchID, bool taken) {
+    beginEncoding();
+    blockEncoder.add(branchID, taken);
+    endEncoding();
+    if (blockEncoder.events() >= chunkEventsLimit) {
+      writeBlock(false);
+    }
+  }
+
+  inline void countSegmentEvent() {
+    if (segmentBytesLimit) {
+      segmentEvents++;
+      bool full = traceFormat == TraceFormat::Text
+                      ? outputPosition() + maxTextRecordBytes > segmentBytesLimit
+                      : segmentFull;
+      if (full) {
+        rotateTrace();
+      }
+    }
+  }
+
+  // Recording modes of the specialized entry points logBranchOutcome_<mode>. A mode
+  // fixes at compile time what logBranchOutcome looks up per event, so each entry
+  // point is instantiated with only its own work and no dispatch on the mode:
+  //   count   - the per-branch counters behind the run's profile (and BranchTop)
+  //   trace   - counters and the "<id>,<taken>" text trace
+  //   pack    - counters and the rle trace
+  //   sample  - counters and a text trace of every BRANCH_HISTORY_SAMPLE_PERIOD-th event
+  //   predict - counters and the inline gshare's mispredictions
+  //   shards  - counters only, for multithreaded programs: one table per thread
+  //   atomic  - counters only, for multithreaded programs: one table of atomics
+  // The remaining per-event checks are on state that changes at most a few times per
+  // run (first event, profile growth, a stopped trace), so they are always predicted.
+  // History records and GHR counters stay with logBranchOutcome.
+  struct CountMode {
+    static constexpr TraceFormat format = TraceFormat::None;
+    static constexpr bool sampled = false;
+    static constexpr bool predicted = false;
+    static constexpr CounterLayout counters = CounterLayout::Flat;
+  };
+  struct TraceMode : CountMode {
+    static constexpr TraceFormat format = TraceFormat::Text;
+  };
+  struct PackMode : CountMode {
+    static constexpr TraceFormat format = TraceFormat::Rle;
+  };
+  struct SampleMode : TraceMode {
+    static constexpr bool sampled = true;
+  };
+  struct PredictMode : CountMode {
+    static constexpr bool predicted = true;
+  };
+  struct ShardsMode : CountMode {
+    static constexpr CounterLayout counters = CounterLayout::Sharded;
+  };
+  struct AtomicMode : CountMode {
+    static constexpr CounterLayout counters = CounterLayout::Atomic;
+  };
+
+  // The multithreaded modes initialize once, whichever thread logs first
+  std::once_flag countingOnce;
+  std::atomic<bool> countingInitialized{false};
+
+  template <typename Mode>
+  void initializeCounting() {
+    counterLayout = Mode::counters;
+    initialize();
+    traceFormat = TraceFormat::None;
+    if (Mode::counters == CounterLayout::Atomic) {
+      setupAtomicCounters();
+    }
+    countingInitialized.store(true, std::memory_order_release);
+  }
+
+  // logBranchOutcome: everything configured from the environment at the first event
+  inline void recordConfiguredBranch(uint64_t branchID, bool taken) {
+    if (!initialized) {
+      initialize();
+      readTraceFormat();
+      readHistoryOptions();
+    }
+    stats.events++;
+    if (logFd < 0 && traceFormat != TraceFormat::None) {
+      openTrace();
+    }
+
+    updateProfileCounts(branchID, taken);
+    if (ghrCounterBits) {
+      updateGhrCounters(branchID, taken);
+    }
+
+    if (traceFormat == TraceFormat::Rle) {
+      traceRle(branchID, taken);
+    } else if (traceFormat == TraceFormat::Block) {
+      traceBlock(branchID, taken);
+    } else if (traceFormat == TraceFormat::Text) {
+      traceText(branchID, taken, recordHistory);
+    } else if (traceDisabled) {
+      stats.eventsDropped++;
+    }
+
+    if (traceFormat != TraceFormat::None) {
+      countSegmentEvent();
+    }
+
+    shiftHistory(branchID, taken);
+  }
+
+  // logBranchOutcomesBulk: n outcomes of one branch, logged as n events. Without a
+  // trace or GHR counters only counters and histories change, a word at a time.
+  void recordConfiguredBranches(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+    if (initialized && n && traceFormat == TraceFormat::None && !ghrCounterBits) {
+      stats.events += n;
+      if (traceDisabled) {
+        stats.eventsDropped += n;
+      }
+      updateProfileCountsBulk(branchID, bits, n);
+      shiftHistoryBulk(branchID, bits, n);
       return;
     }
+    for (uint64_t i = 0; i < n; i++) {
+      recordConfiguredBranch(branchID, (bits[i / 64] >> (i % 64)) & 1);
+    }
+  }
+
+  template <typename Mode>
+  inline void recordBranch(uint64_t branchID, bool taken) {
+    if constexpr (Mode::counters != CounterLayout::Flat) {
+      if (!countingInitialized.load(std::memory_order_acquire)) {
+        std::call_once(countingOnce, initializeCounting<Mode>);
+      }
+      if constexpr (Mode::counters == CounterLayout::Sharded) {
+        updateShardCounts(branchID, taken);
+      } else {
+        updateAtomicCounts(branchID, taken);
+      }
+      return;
+    }
+    if (!initialized) {
+      initialize();
+      traceFormat = Mode::format;
+      if (Mode::sampled) {
+        readSampleOptions();
+      }
+    }
+    stats.events++;
+    updateProfileCounts(branchID, taken);
+    if constexpr (Mode::predicted) {
+      predictBranch(branchID, taken);
+    }
+    if constexpr (Mode::format != TraceFormat::None) {
+      if constexpr (Mode::sampled) {
+        if (--sampleCountdown) {
+          return;
+        }
+        sampleCountdown = samplePeriod;
+      }
+      if (logFd < 0 && traceFormat != TraceFormat::None) {
+        openTrace();
+      }
+      if (traceFormat != Mode::format) {
+        stats.eventsDropped++; // stopped at the size cap, failed or frozen by a signal
+        return;
+      }
+      if constexpr (Mode::format == TraceFormat::Text) {
+        traceText(branchID, taken, false);
+      } else {
+        traceRle(branchID, taken);
+      }
+      countSegmentEvent();
+    }
+  }
+
+  template <typename Mode>
+  void recordBranches(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+    if constexpr (Mode::counters == CounterLayout::Sharded) {
+      if (n && countingInitialized.load(std::memory_order_acquire)) {
+        if (branchID >= shardCapacity) {
+          growShard(branchID + 1);
+        }
+        if (branchID < shardCapacity) {
+          countOutcomeWords(shardLines[branchID >> 1].slots[branchID & 1], bits, n);
+          return;
+        }
+      }
+    } else if constexpr (Mode::format == TraceFormat::None && !Mode::predicted &&
+                         Mode::counters == CounterLayout::Flat) {
+      if (initialized && n) {
+        stats.events += n;
+        updateProfileCountsBulk(branchID, bits, n);
+        return;
+      }
+    }
+    for (uint64_t i = 0; i < n; i++) {
+      recordBranch<Mode>(branchID, (bits[i / 64] >> (i % 64)) & 1);
+    }
   }
-  logFile << branchID << "," << (taken ? 1 : 0) << "\n";
-  logFile.flush(); // Ensure immediate write
-}
\ No newline at end of file
+}
+
+// Function to initialize the program name (called from main or elsewhere)
+extern "C" void setProgramName(const char* name) {
+  programName = name;
+}
+
+// Completes the trace, writes this run's profile, the predict mode's mispredictions
+// and the online GHR-conditioned counters to
+// branch_history_logs/<program_name>_branch_correlation[_<pid>].log as
+// "<branch_id>,<ghr_pattern>,<executions>,<taken>" (non-empty patterns only).
+extern "C" void finalizeBranchPredictionData() {
+  if (finalized) {
+    return;
+  }
+  finalized = true;
+  if (logFd >= 0 && !signalFlushed) {
+    closeTrace();
+    if (segmentBytesLimit) {
+      writeManifestStatus(1);
+    }
+  }
+  if (initialized) {
+    if (counterLayout != CounterLayout::Flat) {
+      mergeCounters();
+    }
+    writeRunProfile();
+    closeLiveCounters();
+    if (printStats) {
+      std::cerr << "Branch trace statistics for " << getProgramName() << " (pid " << getpid() << "):\n"
+                << formatStats() << std::flush;
+    }
+  }
+  if (!mispredictions.empty()) {
+    writeMispredictions();
+  }
+  if (ghrCounterBits && !ghrCounters.empty()) {
+    writeGhrCounters();
+  }
+}
+
+extern "C" void logBranchOutcome(uint64_t branchID, bool taken) {
+  recordConfiguredBranch(branchID, taken);
+}
+
+extern "C" void logBranchOutcome_count(uint64_t branchID, bool taken) {
+  recordBranch<CountMode>(branchID, taken);
+}
+
+extern "C" void logBranchOutcome_trace(uint64_t branchID, bool taken) {
+  recordBranch<TraceMode>(branchID, taken);
+}
+
+extern "C" void logBranchOutcome_pack(uint64_t branchID, bool taken) {
+  recordBranch<PackMode>(branchID, taken);
+}
+
+extern "C" void logBranchOutcome_sample(uint64_t branchID, bool taken) {
+  recordBranch<SampleMode>(branchID, taken);
+}
+
+extern "C" void logBranchOutcome_predict(uint64_t branchID, bool taken) {
+  recordBranch<PredictMode>(branchID, taken);
+}
+
+extern "C" void logBranchOutcome_shards(uint64_t branchID, bool taken) {
+  recordBranch<ShardsMode>(branchID, taken);
+}
+
+extern "C" void logBranchOutcome_atomic(uint64_t branchID, bool taken) {
+  recordBranch<AtomicMode>(branchID, taken);
+}
+
+// n outcomes of one branch, oldest first in bit i % 64 of bits[i / 64], logged exactly
+// as n logBranchOutcome[_<mode>] calls would log them. The instrumenter batches a loop's
+// exit test through these when nothing else can log a branch before the loop exits.
+extern "C" void logBranchOutcomesBulk(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+  recordConfiguredBranches(branchID, bits, n);
+}
+
+extern "C" void logBranchOutcomesBulk_count(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+  recordBranches<CountMode>(branchID, bits, n);
+}
+
+extern "C" void logBranchOutcomesBulk_trace(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+  recordBranches<TraceMode>(branchID, bits, n);
+}
+
+extern "C" void logBranchOutcomesBulk_pack(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+  recordBranches<PackMode>(branchID, bits, n);
+}
+
+extern "C" void logBranchOutcomesBulk_sample(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+  recordBranches<SampleMode>(branchID, bits, n);
+}
+
+extern "C" void logBranchOutcomesBulk_predict(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+  recordBranches<PredictMode>(branchID, bits, n);
+}
+
+extern "C" void logBranchOutcomesBulk_shards(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+  recordBranches<ShardsMode>(branchID, bits, n);
+}
+
+extern "C" void logBranchOutcomesBulk_atomic(uint64_t branchID, const uint64_t* bits, uint64_t n) {
+  recordBranches<AtomicMode>(branchID, bits, n);
+}
+
+// preserve_most variants of every entry point, called by instrumented code whose call
+// sites use the same convention (BRANCH_HISTORY_PRESERVE_MOST=1 in the instrumenter).
+// The callee saves whatever registers it uses, so the instrumented loop keeps its
+// values in caller-saved registers across the call instead of spilling them at every
+// branch; the fast paths above touch few registers, and the save of the rest only
+// matters on the paths that call out (first event, flushes, profile growth).
+// They exist only where the compiler implements the convention (clang): called as
+// preserve_most, a C entry point would corrupt the caller's registers, so the link
+// fails instead.
+#if defined(__has_attribute)
+#if __has_attribute(preserve_most)
+#define BRANCH_HISTORY_PRESERVE_MOST_ENTRY(name, record)                              \
+  extern "C" __attribute__((preserve_most)) void name(uint64_t branchID, bool taken) { \
+    record(branchID, taken);                                                           \
+  }
+
+BRANCH_HISTORY_PRESERVE_MOST_ENTRY(logBranchOutcome_preserve_most, recordConfiguredBranch)
+BRANCH_HISTORY_PRESERVE_MOST_ENTRY(logBranchOutcome_count_preserve_most, recordBranch<CountMode>)
+BRANCH_HISTORY_PRESERVE_MOST_ENTRY(logBranchOutcome_trace_preserve_most, recordBranch<TraceMode>)
+BRANCH_HISTORY_PRESERVE_MOST_ENTRY(logBranchOutcome_pack_preserve_most, recordBranch<PackMode>)
+BRANCH_HISTORY_PRESERVE_MOST_ENTRY(logBranchOutcome_sample_preserve_most, recordBranch<SampleMode>)
+BRANCH_HISTORY_PRESERVE_MOST_ENTRY(logBranchOutcome_predict_preserve_most, recordBranch<PredictMode>)
+BRANCH_HISTORY_PRESERVE_MOST_ENTRY(logBranchOutcome_shards_preserve_most, recordBranch<ShardsMode>)
+BRANCH_HISTORY_PRESERVE_MOST_ENTRY(logBranchOutcome_atomic_preserve_most, recordBranch<AtomicMode>)
+#endif
+#endif
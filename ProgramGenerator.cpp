@@ -0,0 +1,440 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+    - Writes a random C++ program for the training corpus, in the spirit of Csmith but
+      with its branches, not its expressions, made varied: the program's branches follow
+      one of the predictability profiles below, so TAGE-SC-L labels cover the whole range
+      from always right to coin flips. program_corpus.sh drives it at scale.
+    - Profiles:
+        data       - conditions on random data, taken with a set probability
+        loop       - counted loops with constant or data-dependent trip counts, and
+                     periodic branches on the induction variable
+        correlated - conditions saved in variables and tested again later, alone or
+                     combined, and overlapping thresholds on the same value
+        pointer    - bounded walks of a linked list in random order and binary search
+                     tree lookups, branching on the visited nodes
+        mixed      - each function picks one of the above (the default)
+      --hard is the share of data-dependent conditions that are near 50/50; the others are
+      taken 1%, 10%, 90% or 99% of the time.
+    - The programs are free of undefined behaviour by construction: all arithmetic is on
+      uint32_t (divisors are or'ed with 1, shift counts masked), array indices are masked
+      to the power-of-two array size, pointers only ever point into the node pool or are
+      null, every loop is bounded, and calls only go to later functions, so there is no
+      recursion. Every variable is initialised.
+    - A generated program runs as <program> [size [seed]], like the dsa programs: main calls
+      f0 size times on data from a splitmix64 stream, refreshing one data element per call,
+      and prints a checksum of the results.
+    - Usage: ProgramGenerator [--profile data|loop|correlated|pointer|mixed] [--functions N]
+                              [--statements N] [--hard P] [--seed N] <output.cpp>
+*/
+
+namespace {
+  enum class Profile { Data, Loop, Correlated, Pointer, Mixed };
+
+  const char *const ProfileNames[] = {"data", "loop", "correlated", "pointer", "mixed"};
+
+  struct Options {
+    Profile profile = Profile::Mixed;
+    unsigned functions = 4;
+    unsigned statements = 24; // per function, nested ones included
+    double hard = 0.3;
+    uint64_t seed = 1;
+  };
+
+  // Generated programs' shape; DataSize must be a power of two
+  const unsigned DataSize = 1024;
+  const unsigned Locals = 4;     // v0..v3
+  const unsigned Conditions = 4; // c0..c3, for the correlated profile
+  const unsigned MaxLoopDepth = 2;
+  const unsigned MaxDepth = 4;
+  const unsigned MaxTrips = 16;
+  const unsigned DefaultSize = 200;
+
+  void usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0
+              << " [--profile data|loop|correlated|pointer|mixed] [--functions N] [--statements N] [--hard P]"
+                 " [--seed N] <output.cpp>"
+              << std::endl;
+  }
+
+  bool parseProfile(const std::string &name, Profile &profile) {
+    for (unsigned p = 0; p <= unsigned(Profile::Mixed); p++) {
+      if (name == ProfileNames[p]) {
+        profile = Profile(p);
+        return true;
+      }
+    }
+    std::cerr << "Unknown profile " << name << " (data, loop, correlated, pointer or mixed)" << std::endl;
+    return false;
+  }
+
+  class ProgramWriter {
+  public:
+    explicit ProgramWriter(const Options &O) : O(O), Rng(O.seed) {}
+
+    std::string write(const std::string &command) {
+      line("// Generated by " + command);
+      line("#include <cstdint>");
+      line("#include <cstdio>");
+      line("#include <cstdlib>");
+      line("");
+      line("const uint32_t DataSize = " + std::to_string(DataSize) + ";");
+      line("const uint32_t Mask = DataSize - 1;");
+      line("");
+      line("struct Node {");
+      indent++;
+      line("uint32_t value;");
+      line("Node* next;");
+      line("Node* left;");
+      line("Node* right;");
+      indent--;
+      line("};");
+      line("");
+      line("uint32_t data[DataSize];");
+      line("Node nodes[DataSize];");
+      line("Node* head = nullptr;");
+      line("Node* root = nullptr;");
+      line("uint64_t state = 0;");
+      line("");
+      writeSupport();
+      for (unsigned f = O.functions; f-- > 0;) {
+        line("");
+        writeFunction(f);
+      }
+      line("");
+      writeMain();
+      return out.str();
+    }
+
+  private:
+    const Options &O;
+    std::mt19937_64 Rng;
+    std::ostringstream out;
+    unsigned indent = 0;
+
+    // The function being written
+    unsigned function = 0;
+    Profile profile = Profile::Data;
+    unsigned left = 0;   // statements still to write
+    unsigned names = 0;  // for block-scoped temporaries
+    unsigned loops = 0;  // loops around the current statement
+    std::vector<unsigned> setConditions; // the c<i> assigned so far
+
+    uint64_t random(uint64_t n) { return n ? Rng() % n : 0; }
+    bool chance(double p) { return std::uniform_real_distribution<double>(0, 1)(Rng) < p; }
+
+    void line(const std::string &text) {
+      if (!text.empty()) out << std::string(indent * 4, ' ') << text;
+      out << "\n";
+    }
+
+    std::string fresh(const char *prefix) { return prefix + std::to_string(names++); }
+    std::string local() { return "v" + std::to_string(random(Locals)); }
+    std::string constant() { return std::to_string(random(64)) + "u"; }
+    std::string operand() { return chance(0.3) ? constant() : local(); }
+    std::string dataAt() { return "data[(" + local() + " + " + constant() + ") & Mask]"; }
+
+    // A threshold under which a uniform uint32_t falls with the profile's probability
+    std::string threshold() {
+      static const double Easy[] = {0.01, 0.1, 0.9, 0.99};
+      double p = chance(O.hard) ? 0.4 + 0.2 * std::uniform_real_distribution<double>(0, 1)(Rng) : Easy[random(4)];
+      return std::to_string(uint32_t(p * 4294967295.0)) + "u";
+    }
+
+    void writeSupport() {
+      line("uint32_t nextRandom() {");
+      indent++;
+      line("uint64_t z = (state += 0x9E3779B97F4A7C15ull);");
+      line("z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;");
+      line("z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;");
+      line("return uint32_t((z ^ (z >> 31)) >> 32);");
+      indent--;
+      line("}");
+      line("");
+      line("// Random data, a list through all nodes in random order and a search tree of them");
+      line("void setup(uint64_t seed) {");
+      indent++;
+      line("state = seed;");
+      line("uint32_t order[DataSize];");
+      line("for (uint32_t i = 0; i < DataSize; i++) {");
+      indent++;
+      line("data[i] = nextRandom();");
+      line("nodes[i].value = nextRandom();");
+      line("nodes[i].next = nodes[i].left = nodes[i].right = nullptr;");
+      line("order[i] = i;");
+      indent--;
+      line("}");
+      line("for (uint32_t i = DataSize - 1; i > 0; i--) {");
+      indent++;
+      line("uint32_t j = nextRandom() % (i + 1);");
+      line("uint32_t t = order[i];");
+      line("order[i] = order[j];");
+      line("order[j] = t;");
+      indent--;
+      line("}");
+      line("head = &nodes[order[0]];");
+      line("root = head;");
+      line("for (uint32_t i = 1; i < DataSize; i++) {");
+      indent++;
+      line("Node* node = &nodes[order[i]];");
+      line("nodes[order[i - 1]].next = node;");
+      line("Node** link = &root;");
+      line("while (*link) link = node->value < (*link)->value ? &(*link)->left : &(*link)->right;");
+      line("*link = node;");
+      indent--;
+      line("}");
+      indent--;
+      line("}");
+    }
+
+    void writeFunction(unsigned f) {
+      function = f;
+      profile = O.profile == Profile::Mixed ? Profile(random(unsigned(Profile::Mixed))) : O.profile;
+      left = O.statements;
+      names = 0;
+      loops = 0;
+      setConditions.clear();
+      line("// Profile: " + std::string(ProfileNames[unsigned(profile)]));
+      line("uint32_t f" + std::to_string(f) + "(uint32_t a, uint32_t b) {");
+      indent++;
+      line("uint32_t v0 = a, v1 = b, v2 = a ^ b, v3 = " + std::to_string(f) + "u;");
+      if (profile == Profile::Correlated) line("uint32_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;");
+      // Every function but the last calls the next one, so all of them run
+      if (f + 1 < O.functions) writeCall(f + 1);
+      writeBlock(0);
+      if (profile == Profile::Correlated) {
+        line("return v0 ^ v1 ^ v2 ^ v3 ^ c0 ^ c1 ^ c2 ^ c3;");
+      } else {
+        line("return v0 ^ v1 ^ v2 ^ v3;");
+      }
+      indent--;
+      line("}");
+    }
+
+    void writeBlock(unsigned depth) {
+      unsigned budget = left;
+      while (left > 0 && (depth == 0 || budget - left < 1 + random(budget))) {
+        left--;
+        writeStatement(depth);
+      }
+    }
+
+    // The statement's body gets a share of what is left
+    void writeNested(unsigned depth) {
+      unsigned saved = left;
+      left = unsigned(random(left / 2 + 1));
+      saved -= left;
+      writeBlock(depth + 1);
+      left += saved;
+    }
+
+    void writeStatement(unsigned depth) {
+      bool nest = depth < MaxDepth && chance(0.5);
+      if (!nest) {
+        if (function + 2 < O.functions && loops == 0 && chance(0.05)) {
+          writeCall(function + 2 + unsigned(random(O.functions - function - 2)));
+        } else {
+          writeAssignment();
+        }
+        return;
+      }
+      switch (profile) {
+      case Profile::Data: writeDataBranch(depth); break;
+      case Profile::Loop: loops < MaxLoopDepth ? writeLoop(depth) : writeDataBranch(depth); break;
+      case Profile::Correlated: writeCorrelatedBranch(depth); break;
+      default: chance(0.5) ? writeListWalk(depth) : writeTreeLookup(depth); break;
+      }
+    }
+
+    void writeAssignment() {
+      std::string target = local(), l = local(), r = operand();
+      switch (random(9)) {
+      case 0: line(target + " = " + l + " + " + r + ";"); break;
+      case 1: line(target + " = " + l + " - " + r + ";"); break;
+      case 2: line(target + " = " + l + " * " + r + ";"); break;
+      case 3: line(target + " = " + l + " ^ " + r + ";"); break;
+      case 4: line(target + " = " + l + " / (" + r + " | 1u);"); break;
+      case 5: line(target + " = " + l + " % (" + r + " | 1u);"); break;
+      case 6: line(target + " = " + l + " << (" + r + " & 31u);"); break;
+      case 7: line(target + " = " + l + " >> (" + r + " & 31u);"); break;
+      default: line(target + " += " + dataAt() + ";"); break;
+      }
+    }
+
+    void writeCall(unsigned callee) {
+      line(local() + " += f" + std::to_string(callee) + "(" + local() + ", " + local() + ");");
+    }
+
+    void writeIf(const std::string &condition, unsigned depth) {
+      line("if (" + condition + ") {");
+      indent++;
+      writeNested(depth);
+      indent--;
+      if (chance(0.4)) {
+        line("} else {");
+        indent++;
+        writeNested(depth);
+        indent--;
+      }
+      line("}");
+    }
+
+    void writeDataBranch(unsigned depth) { writeIf(dataAt() + " < " + threshold(), depth); }
+
+    void writeLoop(unsigned depth) {
+      std::string i = fresh("i");
+      std::string trips = chance(0.5) ? std::to_string(1 + random(MaxTrips)) + "u"
+                                      : "(" + local() + " & " + std::to_string(MaxTrips - 1) + "u) + 1u";
+      line("for (uint32_t " + i + " = 0; " + i + " < " + trips + "; " + i + "++) {");
+      indent++;
+      loops++;
+      if (chance(0.6)) {
+        // Taken once every period iterations: predictable from local history
+        unsigned period = 2 + unsigned(random(7));
+        writeIf(i + " % " + std::to_string(period) + "u == " + std::to_string(random(period)) + "u", depth + 1);
+      }
+      writeNested(depth);
+      line(local() + " += " + i + ";");
+      loops--;
+      indent--;
+      line("}");
+    }
+
+    // Either saves a condition for later or tests saved ones again
+    void writeCorrelatedBranch(unsigned depth) {
+      if (setConditions.empty() || chance(0.3)) {
+        unsigned i = unsigned(random(Conditions));
+        std::string c = "c" + std::to_string(i), value = fresh("x");
+        line("uint32_t " + value + " = " + dataAt() + ";");
+        line(c + " = " + value + " < " + threshold() + ";");
+        if (std::find(setConditions.begin(), setConditions.end(), i) == setConditions.end()) {
+          setConditions.push_back(i);
+        }
+        writeIf(c, depth);
+        if (chance(0.5)) {
+          // Overlapping threshold on the same value: implied by the first outcome half the time
+          writeIf(value + " < " + threshold(), depth);
+        }
+        return;
+      }
+      unsigned i = setConditions[random(setConditions.size())];
+      std::string c = "c" + std::to_string(i);
+      if (setConditions.size() == 1) {
+        writeIf(chance(0.5) ? c : "!" + c, depth);
+        return;
+      }
+      unsigned j = setConditions[random(setConditions.size())];
+      while (j == i) j = setConditions[random(setConditions.size())];
+      std::string d = "c" + std::to_string(j);
+      switch (random(4)) {
+      case 0: writeIf(c, depth); break;
+      case 1: writeIf("!" + c, depth); break;
+      case 2: writeIf(c + " && " + d, depth); break;
+      default: writeIf(c + " != " + d, depth); break;
+      }
+    }
+
+    void writeListWalk(unsigned depth) {
+      std::string p = fresh("p"), steps = fresh("s");
+      line("Node* " + p + " = &nodes[(" + local() + " + " + constant() + ") & Mask];");
+      line("for (uint32_t " + steps + " = 0; " + p + " && " + steps + " < " + std::to_string(1 + random(MaxTrips)) +
+           "u; " + steps + "++) {");
+      indent++;
+      loops++;
+      writeIf(p + "->value < " + threshold(), depth + 1);
+      line(local() + " ^= " + p + "->value;");
+      line(p + " = " + p + "->next;");
+      loops--;
+      indent--;
+      line("}");
+    }
+
+    void writeTreeLookup(unsigned depth) {
+      std::string t = fresh("t"), key = fresh("k");
+      line("uint32_t " + key + " = " + dataAt() + ";");
+      line("Node* " + t + " = root;");
+      line("while (" + t + " && " + t + "->value != " + key + ") {");
+      indent++;
+      line(t + " = " + key + " < " + t + "->value ? " + t + "->left : " + t + "->right;");
+      indent--;
+      line("}");
+      writeIf(t + " != nullptr", depth);
+    }
+
+    void writeMain() {
+      line("int main(int argc, char** argv) {");
+      indent++;
+      line("uint64_t size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : " + std::to_string(DefaultSize) + ";");
+      line("uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;");
+      line("setup(seed);");
+      line("uint32_t checksum = 0;");
+      line("for (uint64_t n = 0; n < size; n++) {");
+      indent++;
+      line("checksum ^= f0(uint32_t(n), checksum);");
+      line("data[n & Mask] = nextRandom();");
+      indent--;
+      line("}");
+      line("printf(\"%u\\n\", checksum);");
+      line("return 0;");
+      indent--;
+      line("}");
+    }
+  };
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  std::string output;
+  bool ok = true;
+  for (int i = 1; i < argc && ok; i++) {
+    std::string arg = argv[i];
+    if (arg == "--profile" && i + 1 < argc) {
+      ok = parseProfile(argv[++i], options.profile);
+    } else if (arg == "--functions" && i + 1 < argc) {
+      options.functions = unsigned(std::strtoul(argv[++i], nullptr, 10));
+      ok = options.functions > 0;
+    } else if (arg == "--statements" && i + 1 < argc) {
+      options.statements = unsigned(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--hard" && i + 1 < argc) {
+      options.hard = std::strtod(argv[++i], nullptr);
+      ok = options.hard >= 0 && options.hard <= 1;
+    } else if (arg == "--seed" && i + 1 < argc) {
+      options.seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg.compare(0, 2, "--") == 0 || !output.empty()) {
+      ok = false;
+    } else {
+      output = arg;
+    }
+  }
+  if (!ok || output.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::string command = "ProgramGenerator --profile " + std::string(ProfileNames[unsigned(options.profile)]) +
+                        " --functions " + std::to_string(options.functions) + " --statements " +
+                        std::to_string(options.statements) + " --hard " + std::to_string(options.hard) +
+                        " --seed " + std::to_string(options.seed);
+  ProgramWriter writer(options);
+  std::string program = writer.write(command);
+
+  std::ofstream out(output);
+  if (!out) {
+    std::cerr << "Failed to open " << output << std::endl;
+    return 1;
+  }
+  out << program;
+  if (!out) {
+    std::cerr << "Failed to write " << output << std::endl;
+    return 1;
+  }
+  return 0;
+}
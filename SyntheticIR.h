@@ -0,0 +1,340 @@
+#ifndef SYNTHETIC_IR_H
+#define SYNTHETIC_IR_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+    - Random but verifier-clean LLVM modules for scaling tests of the IR passes
+      (SyntheticIRGenerator writes them, ControlFlowExtractorBenchmark times the extractor
+      on them).
+    - Functions are structured like clang -O0 output: every variable lives in an entry
+      block alloca, statements load their operands and store their results, so any
+      statement may go anywhere without dominance bookkeeping. Statements are arithmetic,
+      array loads and stores, calls, if/else diamonds, counted loops (natural loops,
+      nested up to loopDepth) and switches of up to switchCases cases.
+    - branchDensity is the share of statements that branch. Nested regions take a random
+      part of their parent's instruction budget, so a function ends up with about
+      instructions instructions.
+    - Calls follow the call-graph shape and only go to later functions, so the graph is
+      acyclic: chain (f<i> calls f<i+1>), tree (f<i> calls f<2i+1> and f<2i+2>), star (f0
+      calls all), dag (each function calls a few random later ones) or none.
+    - Arithmetic avoids division and out-of-range shifts, loops run a bounded count and
+      array indices are masked, so the code is well defined if run.
+    - The same options and seed always give the same module.
+*/
+
+enum class CallGraphShape { None, Chain, Tree, Star, Dag };
+
+struct SyntheticIROptions {
+  unsigned functions = 4;
+  uint64_t instructions = 10000; // per function, approximately
+  double branchDensity = 0.2;
+  unsigned loopDepth = 3;
+  unsigned switchCases = 16;
+  CallGraphShape callGraph = CallGraphShape::Chain;
+  uint64_t seed = 1;
+};
+
+inline bool parseCallGraphShape(const std::string &name, CallGraphShape &shape) {
+  static const char *const Names[] = {"none", "chain", "tree", "star", "dag"};
+  for (unsigned i = 0; i < 5; i++) {
+    if (name == Names[i]) {
+      shape = CallGraphShape(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Consumes argv[i] and its value if it is a generator option; sets ok to false on a bad value
+inline bool parseSyntheticIROption(int argc, char **argv, int &i, SyntheticIROptions &options, bool &ok) {
+  std::string arg = argv[i];
+  if (i + 1 >= argc) return false;
+  const char *value = argv[i + 1];
+  if (arg == "--functions") {
+    options.functions = unsigned(std::strtoul(value, nullptr, 10));
+  } else if (arg == "--instructions") {
+    options.instructions = std::strtoull(value, nullptr, 10);
+  } else if (arg == "--branch-density") {
+    options.branchDensity = std::strtod(value, nullptr);
+    ok = ok && options.branchDensity >= 0 && options.branchDensity <= 1;
+  } else if (arg == "--loop-depth") {
+    options.loopDepth = unsigned(std::strtoul(value, nullptr, 10));
+  } else if (arg == "--switch-cases") {
+    options.switchCases = unsigned(std::strtoul(value, nullptr, 10));
+  } else if (arg == "--call-graph") {
+    ok = ok && parseCallGraphShape(value, options.callGraph);
+  } else if (arg == "--seed") {
+    options.seed = std::strtoull(value, nullptr, 10);
+  } else {
+    return false;
+  }
+  i++;
+  return true;
+}
+
+class SyntheticIRGenerator {
+public:
+  SyntheticIRGenerator(llvm::LLVMContext &Ctx, const SyntheticIROptions &O)
+      : Ctx(Ctx), O(O), Rng(O.seed), I32(llvm::Type::getInt32Ty(Ctx)),
+        B(Ctx, llvm::ConstantFolder(), llvm::IRBuilderCallbackInserter([this](llvm::Instruction *) { Emitted++; })) {}
+
+  std::unique_ptr<llvm::Module> generate(const std::string &name) {
+    auto M = std::make_unique<llvm::Module>(name, Ctx);
+    llvm::FunctionType *FT = llvm::FunctionType::get(I32, {I32, I32}, false);
+    for (unsigned i = 0; i < O.functions; i++) {
+      Functions.push_back(
+          llvm::Function::Create(FT, llvm::Function::ExternalLinkage, "f" + std::to_string(i), M.get()));
+    }
+    for (unsigned i = 0; i < O.functions; i++) {
+      generateFunction(i);
+    }
+    return M;
+  }
+
+private:
+  static constexpr unsigned Variables = 8;
+  static constexpr unsigned ArrayElements = 16;
+
+  llvm::LLVMContext &Ctx;
+  const SyntheticIROptions &O;
+  std::mt19937_64 Rng;
+  llvm::Type *I32;
+  llvm::IRBuilder<llvm::ConstantFolder, llvm::IRBuilderCallbackInserter> B;
+  std::vector<llvm::Function *> Functions;
+
+  // The function being generated
+  llvm::Function *F = nullptr;
+  llvm::BasicBlock *Entry = nullptr;
+  std::vector<llvm::AllocaInst *> Vars;
+  llvm::AllocaInst *Array = nullptr;
+  std::vector<llvm::Function *> PendingCalls; // call-graph edges not yet emitted
+  uint64_t Emitted = 0;                       // instructions in F so far
+
+  uint64_t random(uint64_t n) { return n ? Rng() % n : 0; }
+  bool chance(double p) { return std::uniform_real_distribution<double>(0.0, 1.0)(Rng) < p; }
+
+  std::vector<llvm::Function *> calleesOf(unsigned i) {
+    std::vector<llvm::Function *> callees;
+    auto add = [&](uint64_t j) {
+      if (j > i && j < Functions.size()) callees.push_back(Functions[j]);
+    };
+    switch (O.callGraph) {
+    case CallGraphShape::None:
+      break;
+    case CallGraphShape::Chain:
+      add(i + 1);
+      break;
+    case CallGraphShape::Tree:
+      add(2 * uint64_t(i) + 1);
+      add(2 * uint64_t(i) + 2);
+      break;
+    case CallGraphShape::Star:
+      if (i == 0) {
+        for (uint64_t j = 1; j < Functions.size(); j++) add(j);
+      }
+      break;
+    case CallGraphShape::Dag:
+      if (i + 1 < Functions.size()) {
+        for (unsigned k = 0; k < 3; k++) add(i + 1 + random(Functions.size() - i - 1));
+      }
+      break;
+    }
+    return callees;
+  }
+
+  // Allocas go to the top of the entry block, as clang puts them
+  llvm::AllocaInst *entryAlloca(llvm::Type *Ty) {
+    llvm::IRBuilder<> EntryBuilder(Entry, Entry->begin());
+    Emitted++;
+    return EntryBuilder.CreateAlloca(Ty);
+  }
+
+  llvm::Value *loadVar() { return B.CreateLoad(I32, Vars[random(Variables)]); }
+
+  llvm::Value *operand() {
+    if (chance(0.3)) return llvm::ConstantInt::get(I32, random(64));
+    return loadVar();
+  }
+
+  void storeVar(llvm::Value *V) { B.CreateStore(V, Vars[random(Variables)]); }
+
+  llvm::BasicBlock *newBlock() { return llvm::BasicBlock::Create(Ctx, "", F); }
+
+  void generateFunction(unsigned i) {
+    F = Functions[i];
+    Entry = llvm::BasicBlock::Create(Ctx, "", F);
+    Emitted = 0;
+    B.SetInsertPoint(Entry);
+    Vars.clear();
+    for (unsigned v = 0; v < Variables; v++) Vars.push_back(B.CreateAlloca(I32));
+    Array = B.CreateAlloca(llvm::ArrayType::get(I32, ArrayElements));
+    auto Arg = F->arg_begin();
+    B.CreateStore(&*Arg, Vars[0]);
+    B.CreateStore(&*++Arg, Vars[1]);
+    for (unsigned v = 2; v < Variables; v++) B.CreateStore(llvm::ConstantInt::get(I32, v), Vars[v]);
+    for (unsigned e = 0; e < ArrayElements; e++) {
+      B.CreateStore(llvm::ConstantInt::get(I32, e), B.CreateConstInBoundsGEP2_32(Array->getAllocatedType(), Array, 0, e));
+    }
+    PendingCalls = calleesOf(i);
+
+    emitRegion(0, O.instructions > Emitted ? O.instructions - Emitted : 0);
+    while (!PendingCalls.empty()) emitCall();
+    B.CreateRet(B.CreateLoad(I32, Vars[0]));
+  }
+
+  // Statements until budget more instructions are emitted
+  void emitRegion(unsigned depth, uint64_t budget) {
+    uint64_t end = Emitted + budget;
+    while (Emitted < end) {
+      uint64_t left = end - Emitted;
+      if (left >= 8 && chance(O.branchDensity)) {
+        // A nested region takes between a tenth and half of what is left
+        uint64_t share = left / 10 + random(left / 2 - left / 10 + 1);
+        unsigned kind = unsigned(random(3));
+        if (kind == 1 && depth < O.loopDepth) {
+          emitLoop(depth, share);
+        } else if (kind == 2 && O.switchCases > 0) {
+          emitSwitch(depth, share);
+        } else {
+          emitIf(depth, share);
+        }
+      } else if (!PendingCalls.empty() && chance(0.05)) {
+        emitCall();
+      } else if (chance(0.25)) {
+        emitArrayAccess();
+      } else {
+        emitArithmetic();
+      }
+    }
+  }
+
+  void emitArithmetic() {
+    llvm::Value *L = loadVar(), *R = operand();
+    llvm::Value *V;
+    switch (random(8)) {
+    case 0: V = B.CreateAdd(L, R); break;
+    case 1: V = B.CreateSub(L, R); break;
+    case 2: V = B.CreateMul(L, R); break;
+    case 3: V = B.CreateXor(L, R); break;
+    case 4: V = B.CreateAnd(L, R); break;
+    case 5: V = B.CreateOr(L, R); break;
+    case 6: V = B.CreateShl(L, B.CreateAnd(R, 31)); break;
+    default: V = B.CreateSelect(B.CreateICmpSLT(L, R), L, R); break;
+    }
+    storeVar(V);
+  }
+
+  void emitArrayAccess() {
+    llvm::Value *Index = B.CreateAnd(loadVar(), ArrayElements - 1);
+    llvm::Value *Slot = B.CreateInBoundsGEP(Array->getAllocatedType(), Array, {B.getInt32(0), Index});
+    if (chance(0.5)) {
+      storeVar(B.CreateLoad(I32, Slot));
+    } else {
+      B.CreateStore(loadVar(), Slot);
+    }
+  }
+
+  void emitCall() {
+    llvm::Function *Callee = PendingCalls.back();
+    if (O.callGraph != CallGraphShape::Dag || chance(0.5)) PendingCalls.pop_back();
+    storeVar(B.CreateCall(Callee, {loadVar(), loadVar()}));
+  }
+
+  llvm::Value *condition() {
+    static const llvm::CmpInst::Predicate Predicates[] = {llvm::CmpInst::ICMP_EQ, llvm::CmpInst::ICMP_NE,
+                                                          llvm::CmpInst::ICMP_SLT, llvm::CmpInst::ICMP_SGT,
+                                                          llvm::CmpInst::ICMP_ULE};
+    return B.CreateICmp(Predicates[random(5)], loadVar(), operand());
+  }
+
+  void emitIf(unsigned depth, uint64_t budget) {
+    llvm::BasicBlock *Then = newBlock(), *Merge = newBlock();
+    llvm::BasicBlock *Else = chance(0.5) ? newBlock() : Merge;
+    B.CreateCondBr(condition(), Then, Else);
+    B.SetInsertPoint(Then);
+    emitRegion(depth, Else == Merge ? budget : budget / 2);
+    B.CreateBr(Merge);
+    if (Else != Merge) {
+      B.SetInsertPoint(Else);
+      emitRegion(depth, budget / 2);
+      B.CreateBr(Merge);
+    }
+    B.SetInsertPoint(Merge);
+  }
+
+  // for (c = 0; c < trips; c++) { body }, trips a constant or a variable's low bits
+  void emitLoop(unsigned depth, uint64_t budget) {
+    llvm::AllocaInst *Counter = entryAlloca(I32);
+    llvm::Value *Trips = chance(0.5) ? llvm::ConstantInt::get(I32, 1 + random(8))
+                                     : B.CreateAdd(B.CreateAnd(loadVar(), 7), B.getInt32(1));
+    llvm::AllocaInst *TripVar = entryAlloca(I32);
+    B.CreateStore(Trips, TripVar);
+    B.CreateStore(B.getInt32(0), Counter);
+    llvm::BasicBlock *Header = newBlock(), *Body = newBlock(), *Exit = newBlock();
+    B.CreateBr(Header);
+    B.SetInsertPoint(Header);
+    B.CreateCondBr(B.CreateICmpSLT(B.CreateLoad(I32, Counter), B.CreateLoad(I32, TripVar)), Body, Exit);
+    B.SetInsertPoint(Body);
+    emitRegion(depth + 1, budget);
+    B.CreateStore(B.CreateAdd(B.CreateLoad(I32, Counter), B.getInt32(1)), Counter);
+    B.CreateBr(Header);
+    B.SetInsertPoint(Exit);
+  }
+
+  void emitSwitch(unsigned depth, uint64_t budget) {
+    // Every case costs at least its branch to Merge, so big switches need big budgets
+    unsigned cases = unsigned(1 + random(std::min<uint64_t>(O.switchCases, budget / 4)));
+    llvm::Value *Selector = B.CreateAnd(loadVar(), llvm::NextPowerOf2(cases) * 2 - 1);
+    llvm::BasicBlock *Merge = newBlock();
+    llvm::SwitchInst *Switch = B.CreateSwitch(Selector, Merge, cases);
+    for (unsigned c = 0; c < cases; c++) {
+      llvm::BasicBlock *Case = newBlock();
+      Switch->addCase(B.getInt32(c), Case);
+      B.SetInsertPoint(Case);
+      emitRegion(depth, (budget - cases) / cases);
+      B.CreateBr(Merge);
+    }
+    B.SetInsertPoint(Merge);
+  }
+};
+
+struct SyntheticIRStats {
+  uint64_t functions = 0;
+  uint64_t blocks = 0;
+  uint64_t instructions = 0;
+  uint64_t branches = 0; // conditional branches and switches
+};
+
+inline SyntheticIRStats syntheticIRStats(const llvm::Module &M) {
+  SyntheticIRStats stats;
+  for (const llvm::Function &F : M) {
+    if (F.isDeclaration()) continue;
+    stats.functions++;
+    for (const llvm::BasicBlock &BB : F) {
+      stats.blocks++;
+      stats.instructions += BB.size();
+      const llvm::Instruction *Term = BB.getTerminator();
+      if (llvm::isa<llvm::SwitchInst>(Term) ||
+          (llvm::isa<llvm::BranchInst>(Term) && llvm::cast<llvm::BranchInst>(Term)->isConditional())) {
+        stats.branches++;
+      }
+    }
+  }
+  return stats;
+}
+
+#endif // SYNTHETIC_IR_H
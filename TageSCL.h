@@ -0,0 +1,471 @@
+#ifndef TAGE_SCL_H
+#define TAGE_SCL_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+/*
+    - TAGE-SC-L reference predictor used to label hard-to-predict branches.
+    - TAGE: a bimodal base table plus tagged tables indexed with geometric history lengths.
+    - SC: statistical corrector (bias table + GEHL-style tables over short global histories)
+      that overrides TAGE when TAGE is statistically wrong.
+    - L: loop predictor for loops with a constant trip count.
+    - Folded histories are updated incrementally (a few shifts/xors per table per branch).
+    - Branch IDs assigned by the instrumenter stand in for branch PCs.
+*/
+
+struct TageSCLConfig {
+  unsigned logBase;     // log2 entries of the bimodal table (2-bit counters)
+  unsigned numTagged;   // number of tagged tables
+  unsigned logTagged;   // log2 entries per tagged table
+  unsigned minTagBits;  // tag width of the shortest-history table
+  unsigned maxTagBits;  // tag width of the longest-history table
+  unsigned minHist;     // shortest geometric history length
+  unsigned maxHist;     // longest geometric history length
+  unsigned logLoop;     // log2 entries of the loop predictor (4-way)
+  unsigned numSC;       // number of SC global-history tables (plus one bias table)
+  unsigned logSC;       // log2 entries per SC table (6-bit counters)
+
+  // Presets tuned so storageBits() lands just under 8/16/32/64 KB; budgets
+  // beyond 64 KB double every table per doubling of the budget.
+  static TageSCLConfig forBudgetKB(unsigned kb) {
+    static const struct { unsigned kb; TageSCLConfig cfg; } Presets[] = {
+      { 8, {12,  7,  9, 7, 11, 4,  300, 5, 4,  7}},
+      {16, {13,  7, 10, 7, 12, 4,  400, 6, 5,  8}},
+      {32, {14, 12, 10, 8, 13, 4,  640, 6, 6,  9}},
+      {64, {14, 12, 11, 8, 15, 4, 1000, 7, 6, 10}},
+    };
+    TageSCLConfig cfg = Presets[0].cfg;
+    unsigned presetKB = Presets[0].kb;
+    for (const auto &P : Presets) {
+      if (P.kb <= kb) {
+        cfg = P.cfg;
+        presetKB = P.kb;
+      }
+    }
+    for (unsigned b = presetKB * 2; b <= kb; b *= 2) {
+      cfg.logBase++;
+      cfg.logTagged++;
+      cfg.logLoop++;
+      cfg.logSC++;
+    }
+    return cfg;
+  }
+
+  unsigned tagBits(unsigned table) const {
+    if (numTagged <= 1) return maxTagBits;
+    return minTagBits + (maxTagBits - minTagBits) * table / (numTagged - 1);
+  }
+
+  uint64_t storageBits() const {
+    uint64_t bits = (1ull << logBase) * 2;
+    for (unsigned i = 0; i < numTagged; i++) {
+      bits += (1ull << logTagged) * (3 + 2 + tagBits(i)); // ctr + u + tag
+    }
+    bits += (1ull << logLoop) * (14 * 3 + 4 + 8 + 1);      // iters/tag + conf + age + dir
+    bits += (numSC + 1) * (1ull << logSC) * 6;
+    bits += maxHist + 16;                                  // global + path history
+    return bits;
+  }
+};
+
+class TageSCL {
+public:
+  explicit TageSCL(const TageSCLConfig &cfg) : Cfg(cfg) {
+    Base.assign(1u << Cfg.logBase, 2);
+    Tagged.assign(size_t(Cfg.numTagged) << Cfg.logTagged, TaggedEntry());
+    Loops.assign(1u << Cfg.logLoop, LoopEntry());
+    SC.assign(Cfg.numSC + 1, std::vector<int8_t>(1u << Cfg.logSC, 0));
+
+    HistLen.resize(Cfg.numTagged);
+    TagMask.resize(Cfg.numTagged);
+    IdxFold.resize(Cfg.numTagged);
+    TagFold1.resize(Cfg.numTagged);
+    TagFold2.resize(Cfg.numTagged);
+    Idx.resize(Cfg.numTagged);
+    Tag.resize(Cfg.numTagged);
+    SCIdx.resize(Cfg.numSC);
+    for (unsigned i = 0; i < Cfg.numTagged; i++) {
+      double ratio = Cfg.numTagged > 1 ? double(i) / (Cfg.numTagged - 1) : 1.0;
+      HistLen[i] = unsigned(Cfg.minHist * std::pow(double(Cfg.maxHist) / Cfg.minHist, ratio) + 0.5);
+      if (i > 0 && HistLen[i] <= HistLen[i - 1]) HistLen[i] = HistLen[i - 1] + 1;
+      unsigned tb = Cfg.tagBits(i);
+      TagMask[i] = (1u << tb) - 1;
+      IdxFold[i].init(HistLen[i], Cfg.logTagged);
+      TagFold1[i].init(HistLen[i], tb);
+      TagFold2[i].init(HistLen[i], tb - 1);
+    }
+
+    unsigned histBuf = 1;
+    while (histBuf < HistLen.back() + 64) histBuf <<= 1;
+    GHist.assign(histBuf, 0);
+    GHistMask = histBuf - 1;
+
+    static const unsigned SCLengths[] = {4, 8, 12, 16, 24, 32, 48, 64};
+    for (unsigned i = 0; i < Cfg.numSC; i++) {
+      SCHistLen.push_back(SCLengths[i < 8 ? i : 7]);
+    }
+  }
+
+  // Returns the final TAGE-SC-L prediction; must be followed by update() for
+  // the same branch before the next predict().
+  bool predict(uint64_t pc) {
+    CurPC = pc;
+
+    // TAGE lookup
+    for (unsigned i = 0; i < Cfg.numTagged; i++) {
+      uint64_t h = pc ^ (pc >> (Cfg.logTagged - (i % Cfg.logTagged))) ^ IdxFold[i].comp ^ pathHash(i);
+      Idx[i] = (i << Cfg.logTagged) | (unsigned(h) & ((1u << Cfg.logTagged) - 1));
+      Tag[i] = unsigned(pc ^ TagFold1[i].comp ^ (TagFold2[i].comp << 1)) & TagMask[i];
+    }
+    Provider = -1;
+    AltProvider = -1;
+    for (int i = int(Cfg.numTagged) - 1; i >= 0; i--) {
+      if (Tagged[Idx[i]].tag == Tag[i]) {
+        if (Provider < 0) {
+          Provider = i;
+        } else {
+          AltProvider = i;
+          break;
+        }
+      }
+    }
+    BaseIdx = unsigned(pc) & ((1u << Cfg.logBase) - 1);
+    bool basePred = Base[BaseIdx] >= 2;
+    AltPred = AltProvider >= 0 ? Tagged[Idx[AltProvider]].ctr >= 0 : basePred;
+    if (Provider >= 0) {
+      int8_t ctr = Tagged[Idx[Provider]].ctr;
+      ProviderPred = ctr >= 0;
+      bool weak = ctr == 0 || ctr == -1;
+      TagePred = (weak && UseAltOnNA >= 0) ? AltPred : ProviderPred;
+      TageHighConf = ctr == 3 || ctr == -4;
+    } else {
+      ProviderPred = basePred;
+      TagePred = basePred;
+      TageHighConf = Base[BaseIdx] == 0 || Base[BaseIdx] == 3;
+    }
+
+    // Loop predictor
+    loopLookup(pc);
+    LoopUsed = LoopValid && WithLoop >= 0;
+    bool pred = LoopUsed ? LoopPred : TagePred;
+
+    // Statistical corrector
+    SCIdx0 = unsigned((pc << 1) | (TagePred ? 1 : 0)) & ((1u << Cfg.logSC) - 1);
+    SCSum = 2 * SC[0][SCIdx0] + 1;
+    for (unsigned i = 0; i < Cfg.numSC; i++) {
+      SCIdx[i] = scIndex(pc, i);
+      SCSum += 2 * SC[i + 1][SCIdx[i]] + 1;
+    }
+    SCPred = SCSum >= 0;
+    SCUsed = false;
+    if (!LoopUsed && SCPred != TagePred) {
+      int mag = std::abs(SCSum);
+      if (mag >= SCThreshold || (!TageHighConf && 2 * mag >= SCThreshold)) {
+        pred = SCPred;
+        SCUsed = true;
+      }
+    }
+    FinalPred = pred;
+    return pred;
+  }
+
+  void update(uint64_t pc, bool taken) {
+    updateSC(taken);
+    updateLoop(pc, taken);
+    updateTage(taken);
+    updateHistories(pc, taken);
+  }
+
+  const TageSCLConfig &config() const { return Cfg; }
+
+private:
+  struct TaggedEntry {
+    int8_t ctr = 0;    // 3-bit signed counter
+    uint8_t u = 0;     // 2-bit useful counter
+    uint16_t tag = 0;
+  };
+
+  struct LoopEntry {
+    uint16_t numIter = 0;
+    uint16_t currentIter = 0;
+    uint16_t tag = 0;
+    uint8_t confidence = 0;
+    uint8_t age = 0;
+    bool dir = false;
+  };
+
+  // Incrementally folded view of the most recent origLength history bits.
+  struct FoldedHistory {
+    unsigned comp = 0;
+    unsigned compLength = 0;
+    unsigned origLength = 0;
+    unsigned outPoint = 0;
+
+    void init(unsigned orig, unsigned compLen) {
+      comp = 0;
+      origLength = orig;
+      compLength = compLen;
+      outPoint = compLen ? orig % compLen : 0;
+    }
+
+    void update(const std::vector<uint8_t> &hist, unsigned ptr, unsigned mask) {
+      comp = (comp << 1) ^ hist[ptr & mask];
+      comp ^= unsigned(hist[(ptr + origLength) & mask]) << outPoint;
+      comp ^= comp >> compLength;
+      comp &= (1u << compLength) - 1;
+    }
+  };
+
+  static constexpr int LoopConfMax = 15;
+  static constexpr unsigned LoopTagMask = (1u << 14) - 1;
+  static constexpr unsigned UsefulResetPeriod = 1u << 19;
+
+  TageSCLConfig Cfg;
+  std::vector<uint8_t> Base;
+  std::vector<TaggedEntry> Tagged; // numTagged tables laid out back to back
+  std::vector<LoopEntry> Loops;
+  std::vector<std::vector<int8_t>> SC;
+
+  std::vector<unsigned> HistLen;
+  std::vector<unsigned> TagMask;
+  std::vector<FoldedHistory> IdxFold, TagFold1, TagFold2;
+  std::vector<unsigned> SCHistLen;
+
+  std::vector<uint8_t> GHist; // ring buffer, GHist[Ptr] is the newest outcome
+  unsigned GHistMask = 0;
+  unsigned Ptr = 0;
+  uint64_t GHR = 0;           // newest 64 outcomes, used by the SC tables
+  uint64_t PathHist = 0;
+
+  int UseAltOnNA = 0;
+  int WithLoop = -1;
+  int SCThreshold = 35;
+  int SCThresholdCtr = 0;
+  uint64_t Tick = 0;
+  uint64_t Seed = 0x2545F4914F6CDD1Dull;
+
+  // Per-prediction state carried into update()
+  uint64_t CurPC = 0;
+  std::vector<unsigned> Idx, Tag; // Idx already includes the table offset
+  unsigned BaseIdx = 0;
+  int Provider = -1, AltProvider = -1;
+  bool ProviderPred = false, AltPred = false, TagePred = false, TageHighConf = false;
+  bool LoopValid = false, LoopPred = false, LoopUsed = false;
+  int LoopHit = -1;
+  unsigned LoopSetIdx = 0;
+  uint16_t LoopTag = 0;
+  unsigned SCIdx0 = 0;
+  std::vector<unsigned> SCIdx;
+  int SCSum = 0;
+  bool SCPred = false, SCUsed = false, FinalPred = false;
+
+  uint64_t random() {
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 7;
+    Seed ^= Seed << 17;
+    return Seed;
+  }
+
+  unsigned pathHash(unsigned table) const {
+    unsigned len = HistLen[table] < 16 ? HistLen[table] : 16;
+    unsigned p = unsigned(PathHist) & ((1u << len) - 1);
+    unsigned shift = table % Cfg.logTagged;
+    return (p << shift) ^ (p >> (Cfg.logTagged - shift));
+  }
+
+  unsigned scIndex(uint64_t pc, unsigned table) const {
+    unsigned len = SCHistLen[table];
+    uint64_t h = len >= 64 ? GHR : GHR & ((1ull << len) - 1);
+    uint64_t folded = 0;
+    while (h) {
+      folded ^= h & ((1ull << Cfg.logSC) - 1);
+      h >>= Cfg.logSC;
+    }
+    return unsigned(pc ^ (pc >> (table + 1)) ^ folded ^ (uint64_t(table) << (Cfg.logSC - 2))) &
+           ((1u << Cfg.logSC) - 1);
+  }
+
+  void loopLookup(uint64_t pc) {
+    uint64_t mixed = pc * 0x9E3779B97F4A7C15ull;
+    LoopSetIdx = unsigned(mixed >> (64 - (Cfg.logLoop - 2))) << 2;
+    LoopTag = uint16_t((pc ^ (pc >> 14)) & LoopTagMask);
+    LoopHit = -1;
+    LoopValid = false;
+    for (unsigned w = 0; w < 4; w++) {
+      const LoopEntry &E = Loops[LoopSetIdx + w];
+      if (E.tag == LoopTag && E.age > 0) {
+        LoopHit = int(LoopSetIdx + w);
+        LoopValid = E.confidence == LoopConfMax;
+        LoopPred = (E.currentIter + 1 == E.numIter) ? !E.dir : E.dir;
+        return;
+      }
+    }
+  }
+
+  void updateLoop(uint64_t pc, bool taken) {
+    (void)pc;
+    if (LoopValid && LoopPred != TagePred) {
+      WithLoop += LoopPred == taken ? 1 : -1;
+      if (WithLoop > 63) WithLoop = 63;
+      if (WithLoop < -64) WithLoop = -64;
+    }
+
+    if (LoopHit >= 0) {
+      LoopEntry &E = Loops[LoopHit];
+      if (LoopValid) {
+        if (LoopPred != taken) {
+          E = LoopEntry();
+          return;
+        }
+        if (LoopPred != TagePred && E.age < 255) E.age++;
+      }
+
+      E.currentIter = (E.currentIter + 1) & LoopTagMask;
+      if (E.currentIter > E.numIter) {
+        E.confidence = 0;
+        E.numIter = 0;
+      }
+      if (taken != E.dir) {
+        if (E.currentIter == E.numIter) {
+          if (E.confidence < LoopConfMax) E.confidence++;
+          if (E.numIter < 3) {
+            // Very short loops are left to TAGE
+            E.dir = taken;
+            E.numIter = 0;
+            E.age = 0;
+            E.confidence = 0;
+          }
+        } else if (E.numIter == 0) {
+          E.confidence = 0;
+          E.numIter = E.currentIter;
+        } else {
+          E.numIter = 0;
+          E.confidence = 0;
+        }
+        E.currentIter = 0;
+      }
+    } else if (taken != TagePred) {
+      LoopEntry &E = Loops[LoopSetIdx + (random() & 3)];
+      if (E.age == 0) {
+        E.tag = LoopTag;
+        E.numIter = 0;
+        E.currentIter = 0;
+        E.confidence = 0;
+        E.age = 255;
+        E.dir = !taken;
+      } else {
+        E.age--;
+      }
+    }
+  }
+
+  void updateSC(bool taken) {
+    if (SCPred != TagePred && !LoopUsed) {
+      SCThresholdCtr += SCPred == taken ? -1 : 1;
+      if (SCThresholdCtr >= 31) {
+        SCThreshold++;
+        SCThresholdCtr = 0;
+      } else if (SCThresholdCtr <= -32) {
+        if (SCThreshold > 6) SCThreshold--;
+        SCThresholdCtr = 0;
+      }
+    }
+    if (SCPred != taken || std::abs(SCSum) < SCThreshold) {
+      bump6(SC[0][SCIdx0], taken);
+      for (unsigned i = 0; i < Cfg.numSC; i++) {
+        bump6(SC[i + 1][SCIdx[i]], taken);
+      }
+    }
+  }
+
+  void updateTage(bool taken) {
+    bool mispredicted = TagePred != taken;
+
+    // Allocate new entries on longer histories after a TAGE misprediction
+    if (mispredicted && Provider < int(Cfg.numTagged) - 1) {
+      int start = Provider + 1;
+      if ((random() & 1) && start < int(Cfg.numTagged) - 1) start++;
+      bool allocated = false;
+      for (int i = start; i < int(Cfg.numTagged); i++) {
+        TaggedEntry &E = Tagged[Idx[i]];
+        if (E.u == 0) {
+          E.tag = uint16_t(Tag[i]);
+          E.ctr = taken ? 0 : -1;
+          allocated = true;
+          break;
+        }
+      }
+      if (!allocated) {
+        for (int i = start; i < int(Cfg.numTagged); i++) {
+          TaggedEntry &E = Tagged[Idx[i]];
+          if (E.u > 0) E.u--;
+        }
+      }
+    }
+
+    if (Provider >= 0) {
+      TaggedEntry &P = Tagged[Idx[Provider]];
+      bool weak = P.ctr == 0 || P.ctr == -1;
+      if (weak && ProviderPred != AltPred) {
+        UseAltOnNA += AltPred == taken ? 1 : -1;
+        if (UseAltOnNA > 7) UseAltOnNA = 7;
+        if (UseAltOnNA < -8) UseAltOnNA = -8;
+      }
+      // A freshly allocated provider still trains its fallback
+      if (weak && P.u == 0) {
+        if (AltProvider >= 0) {
+          bump3(Tagged[Idx[AltProvider]].ctr, taken);
+        } else {
+          bump2(Base[BaseIdx], taken);
+        }
+      }
+      bump3(P.ctr, taken);
+      if (ProviderPred != AltPred) {
+        if (ProviderPred == taken) {
+          if (P.u < 3) P.u++;
+        } else if (P.u > 0) {
+          P.u--;
+        }
+      }
+    } else {
+      bump2(Base[BaseIdx], taken);
+    }
+
+    // Graceful aging of the useful bits
+    if ((++Tick & (UsefulResetPeriod - 1)) == 0) {
+      for (auto &E : Tagged) E.u >>= 1;
+    }
+  }
+
+  void updateHistories(uint64_t pc, bool taken) {
+    Ptr--;
+    GHist[Ptr & GHistMask] = taken ? 1 : 0;
+    for (unsigned i = 0; i < Cfg.numTagged; i++) {
+      IdxFold[i].update(GHist, Ptr, GHistMask);
+      TagFold1[i].update(GHist, Ptr, GHistMask);
+      TagFold2[i].update(GHist, Ptr, GHistMask);
+    }
+    GHR = (GHR << 1) | (taken ? 1 : 0);
+    PathHist = ((PathHist << 1) ^ (pc & 1) ^ ((pc >> 1) & 1)) & 0xFFFF;
+  }
+
+  static void bump2(uint8_t &c, bool up) {
+    if (up) { if (c < 3) c++; }
+    else if (c > 0) c--;
+  }
+
+  static void bump3(int8_t &c, bool up) {
+    if (up) { if (c < 3) c++; }
+    else if (c > -4) c--;
+  }
+
+  static void bump6(int8_t &c, bool up) {
+    if (up) { if (c < 31) c++; }
+    else if (c > -32) c--;
+  }
+};
+
+#endif // TAGE_SCL_H
@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# Directory containing branch history logs written by the instrumented programs
+LOG_DIR="branch_history_logs"
+
+# TAGE-SC-L labels from branch_predictor_simulator.sh (used to pick the hard branches when present)
+LABEL_DIR="branch_labels"
+
+# Output directory for the branch correlation edges
+OUTPUT_DIR="branch_correlations"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+if [ ! -d "$OUTPUT_DIR" ]; then
+    echo "Creating directory: $OUTPUT_DIR"
+    mkdir "$OUTPUT_DIR"
+    if [ $? -ne 0 ]; then
+        echo "Failed to create directory $OUTPUT_DIR"
+        exit 1
+    fi
+fi
+
+# Compile the analyzer
+echo "Compiling BranchCorrelationAnalyzer..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O3 -pthread -o BranchCorrelationAnalyzer BranchCorrelationAnalyzer.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchCorrelationAnalyzer failed"
+    exit 1
+fi
+
+LOG_FILES=($(find "$LOG_DIR" -type f -name "*_branch_history.log"))
+TOTAL_FILES=${#LOG_FILES[@]}
+
+if [ $TOTAL_FILES -eq 0 ]; then
+    echo "No branch history logs found in $LOG_DIR"
+    exit 1
+fi
+
+echo "Found $TOTAL_FILES branch history logs to analyze"
+
+for ((i = 0; i < TOTAL_FILES; i++)); do
+    LOG_FILE="${LOG_FILES[$i]}"
+    BASE_NAME=$(basename "$LOG_FILE" _branch_history.log)
+    LABEL_FILE="$LABEL_DIR/${BASE_NAME}_branch_labels.txt"
+    OUTPUT_FILE="$OUTPUT_DIR/${BASE_NAME}_branch_correlations.txt"
+
+    PROGRESS=$((i + 1))
+    echo "Analyzing $PROGRESS out of $TOTAL_FILES: $LOG_FILE -> $OUTPUT_FILE"
+
+    LABEL_ARGS=()
+    if [ -f "$LABEL_FILE" ]; then
+        LABEL_ARGS=(--labels "$LABEL_FILE")
+    fi
+
+    ./BranchCorrelationAnalyzer "${LABEL_ARGS[@]}" "$LOG_FILE" "$OUTPUT_FILE"
+
+    if [ $? -ne 0 ]; then
+        echo "Correlation analysis failed for $LOG_FILE"
+    else
+        echo "Successfully analyzed $LOG_FILE"
+    fi
+done
+
+echo "Done processing all $TOTAL_FILES branch history logs"
@@ -0,0 +1,155 @@
+#!/bin/bash
+
+# Measures what instrumentation costs: every program in SRC_DIR is compiled to -O0 IR in
+# BENCH_DIR (not taken from dsa/dsa/llvm, so it always matches the sources that read
+# "<size> <seed>", see dsa/dsa/inputs.h), built uninstrumented and once per variant, run
+# for each size in BENCH_SIZES, BENCH_TRIALS times, and the slowdowns, events per second
+# and trace bytes per event are written as JSON to BENCH_OUTPUT (see BranchBenchmark.cpp).
+# Without BENCH_SIZES, each program gets sizes for about 10^6, 10^7 and 10^8 events.
+#
+# A variant is "generic" (logBranchOutcome, configured at run time as usual) or any
+# suffix of the pass name branch-history-instrumenter-<variant>, e.g. count, pack-bulk or
+# trace-preserve-most. All builds compile the same -O0 IR with BENCH_OPT.
+
+SRC_DIR="dsa/dsa"
+
+# IR and executables, and the directory the runs write their traces and profiles in
+BENCH_DIR="benchmark_programs"
+RUN_DIR="benchmark_runs"
+
+BENCH_TRIALS="${BENCH_TRIALS:-5}"
+BENCH_SEED="${BENCH_SEED:-1}"
+BENCH_OPT="${BENCH_OPT:--O2}"
+BENCH_VARIANTS="${BENCH_VARIANTS:-generic count trace pack sample predict shards atomic}"
+BENCH_OUTPUT="${BENCH_OUTPUT:-branch_history_benchmark.json}"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+# What a size counts differs per program (elements, queries, matrix dimension, ...)
+default_sizes() {
+    case "$1" in
+        binary_search) echo "30000,300000,3000000" ;;
+        factorial) echo "30000,300000,3000000" ;;
+        linear_search|sorting) echo "1400,4500,14000" ;;
+        linked_list) echo "500000,5000000,50000000" ;;
+        matrix_mul) echo "100,215,464" ;;
+        prime) echo "600,6000,60000" ;;
+        quick_sort) echo "30000,300000,3000000" ;;
+        *) echo "1000,10000,100000" ;;
+    esac
+}
+
+for DIR in "$BENCH_DIR" "$RUN_DIR/branch_history_logs"; do
+    if [ ! -d "$DIR" ]; then
+        echo "Creating directory: $DIR"
+        mkdir -p "$DIR"
+        if [ $? -ne 0 ]; then
+            echo "Failed to create directory $DIR"
+            exit 1
+        fi
+    fi
+done
+
+echo "Compiling BranchHistoryInstrumenter.so..."
+$LLVM_DIR/bin/clang++ -std=c++17 -fPIC -shared -o BranchHistoryInstrumenter.so BranchHistoryInstrumenter.cpp \
+    $(/usr/local/llvm-10/bin/llvm-config --cxxflags --ldflags) \
+    -I/usr/local/llvm-10/include \
+    -L/usr/local/llvm-10/lib \
+    -Wl,-rpath,/usr/local/llvm-10/lib
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchHistoryInstrumenter.so failed"
+    exit 1
+fi
+
+echo "Compiling DynamicLog.o..."
+$LLVM_DIR/bin/clang -std=c++17 -O2 -c -o DynamicLog.o DynamicLog.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of DynamicLog.o failed"
+    exit 1
+fi
+
+echo "Compiling BranchBenchmark..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O2 -o BranchBenchmark BranchBenchmark.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchBenchmark failed"
+    exit 1
+fi
+
+CPP_FILES=($(find "$SRC_DIR" -maxdepth 1 -type f -name "*.cpp" | sort))
+TOTAL_FILES=${#CPP_FILES[@]}
+
+if [ $TOTAL_FILES -eq 0 ]; then
+    echo "No .cpp files found in $SRC_DIR"
+    exit 1
+fi
+
+echo "Benchmarking $TOTAL_FILES programs, $BENCH_TRIALS trials"
+
+RESULTS=()
+for ((i = 0; i < TOTAL_FILES; i++)); do
+    CPP_FILE="${CPP_FILES[$i]}"
+    BASE_NAME=$(basename "$CPP_FILE" .cpp)
+    echo "Building $((i + 1)) out of $TOTAL_FILES: $BASE_NAME"
+
+    IR_FILE="$BENCH_DIR/${BASE_NAME}.ll"
+    $LLVM_DIR/bin/clang -std=c++17 -S -emit-llvm -O0 "$CPP_FILE" -o "$IR_FILE"
+    if [ $? -ne 0 ]; then
+        echo "Conversion to IR failed for $CPP_FILE"
+        continue
+    fi
+
+    NATIVE="$PWD/$BENCH_DIR/${BASE_NAME}_native"
+    $LLVM_DIR/bin/clang $BENCH_OPT "$IR_FILE" -o "$NATIVE" -lstdc++
+    if [ $? -ne 0 ]; then
+        echo "Compilation failed for $IR_FILE"
+        continue
+    fi
+
+    BUILDS=()
+    for VARIANT in $BENCH_VARIANTS; do
+        PASS_NAME="branch-history-instrumenter"
+        if [ "$VARIANT" != "generic" ]; then
+            PASS_NAME="$PASS_NAME-$VARIANT"
+        fi
+        INSTR_FILE="$BENCH_DIR/${BASE_NAME}_${VARIANT}.bc"
+        EXEC_FILE="$BENCH_DIR/${BASE_NAME}_${VARIANT}"
+        $LLVM_DIR/bin/opt -load-pass-plugin=./BranchHistoryInstrumenter.so -passes="$PASS_NAME" \
+            "$IR_FILE" -o "$INSTR_FILE" &&
+            $LLVM_DIR/bin/clang $BENCH_OPT "$INSTR_FILE" DynamicLog.o -o "$EXEC_FILE" -lstdc++ -pthread -lrt
+        if [ $? -ne 0 ]; then
+            echo "Building variant $VARIANT failed for $IR_FILE"
+            continue
+        fi
+        BUILDS+=("$VARIANT=$PWD/$EXEC_FILE")
+    done
+
+    SIZES="${BENCH_SIZES:-$(default_sizes "$BASE_NAME")}"
+    echo "Running $BASE_NAME at sizes $SIZES (native ${BUILDS[*]%%=*})..."
+    RESULT=$(cd "$RUN_DIR" && ../BranchBenchmark --trials "$BENCH_TRIALS" --sizes "$SIZES" \
+        --seed "$BENCH_SEED" --program "$BASE_NAME" --native "$NATIVE" "${BUILDS[@]}")
+    if [ $? -ne 0 ] || [ -z "$RESULT" ]; then
+        echo "Benchmark failed for $BASE_NAME"
+        continue
+    fi
+    RESULTS+=("$RESULT")
+
+    # Traces are overwritten by the next run; profiles would pile up
+    rm -f "$RUN_DIR"/branch_history_logs/*
+done
+
+{
+    echo "["
+    for ((i = 0; i < ${#RESULTS[@]}; i++)); do
+        SEPARATOR=","
+        if [ $i -eq $((${#RESULTS[@]} - 1)) ]; then
+            SEPARATOR=""
+        fi
+        echo "  ${RESULTS[$i]}$SEPARATOR"
+    done
+    echo "]"
+} > "$BENCH_OUTPUT"
+
+echo "Results for ${#RESULTS[@]} programs written to $BENCH_OUTPUT"
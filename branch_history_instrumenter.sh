@@ -10,6 +10,34 @@ LOG_DIR="branch_history_logs"
 # Path to LLVM 10
 LLVM_DIR="/usr/local/llvm-10"
 
+# BRANCH_HISTORY_MODE=count|trace|pack|sample|predict|shards|atomic instruments calls to the
+# runtime's logBranchOutcome_<mode>, which records only that mode's data with no per-event
+# dispatch; unset, programs call logBranchOutcome, configured at run time (BRANCH_TRACE_FORMAT
+# etc.). shards and atomic count multithreaded programs without contending on one table
+PASS_NAME="branch-history-instrumenter"
+case "$BRANCH_HISTORY_MODE" in
+    "") ;;
+    count|trace|pack|sample|predict|shards|atomic) PASS_NAME="branch-history-instrumenter-$BRANCH_HISTORY_MODE" ;;
+    *)
+        echo "Unknown BRANCH_HISTORY_MODE $BRANCH_HISTORY_MODE (count, trace, pack, sample, predict, shards or atomic)"
+        exit 1
+        ;;
+esac
+
+# BRANCH_HISTORY_PRESERVE_MOST=1 makes the calls use the preserve_most convention (the
+# runtime's *_preserve_most entry points, built by clang), so instrumented loops keep
+# their registers across the call instead of spilling them at every branch
+if [ -n "$BRANCH_HISTORY_PRESERVE_MOST" ] && [ "$BRANCH_HISTORY_PRESERVE_MOST" != "0" ]; then
+    PASS_NAME="$PASS_NAME-preserve-most"
+fi
+
+# BRANCH_HISTORY_BULK=1 batches the exit tests of innermost loops that call nothing and
+# have no other branch: outcomes collect in a register and reach the runtime's
+# logBranchOutcomesBulk every 64 iterations and at loop exit, with the same trace
+if [ -n "$BRANCH_HISTORY_BULK" ] && [ "$BRANCH_HISTORY_BULK" != "0" ]; then
+    PASS_NAME="$PASS_NAME-bulk"
+fi
+
 # Create directories if they don't exist
 for DIR in "$INSTR_DIR" "$LOG_DIR"; do
     if [ ! -d "$DIR" ]; then
@@ -37,7 +65,7 @@ fi
 
 # Compile DynamicLog.cpp
 echo "Compiling DynamicLog.o..."
-$LLVM_DIR/bin/clang -c -o DynamicLog.o DynamicLog.cpp
+$LLVM_DIR/bin/clang -std=c++17 -O2 -c -o DynamicLog.o DynamicLog.cpp
 
 if [ $? -ne 0 ]; then
     echo "Compilation of DynamicLog.o failed"
@@ -65,7 +93,7 @@ for ((i = 0; i < TOTAL_FILES; i++)); do
     echo "Instrumenting $PROGRESS out of $TOTAL_FILES: $IR_FILE -> $INSTR_FILE"
 
     $LLVM_DIR/bin/opt -load-pass-plugin=./BranchHistoryInstrumenter.so \
-        -passes=branch-history-instrumenter \
+        -passes="$PASS_NAME" \
         "$IR_FILE" -o "$INSTR_FILE"
 
     if [ $? -ne 0 ]; then
@@ -88,12 +116,31 @@ for ((i = 0; i < TOTAL_INSTR; i++)); do
     BASE_NAME=$(basename "$INSTR_FILE" _instrumented.ll)
     EXEC_FILE="${INSTR_DIR}/${BASE_NAME}_instrumented"
     LOG_FILE="$LOG_DIR/${BASE_NAME}_branch_history.log"
+    if [ "$BRANCH_TRACE_FORMAT" = "rle" ]; then
+        LOG_FILE="$LOG_DIR/${BASE_NAME}_branch_history.rle"
+    elif [ "$BRANCH_TRACE_FORMAT" = "block" ]; then
+        LOG_FILE="$LOG_DIR/${BASE_NAME}_branch_history.blk"
+    elif [ "$BRANCH_TRACE_FORMAT" = "none" ]; then
+        LOG_FILE=""
+    fi
+    if [ -n "$BRANCH_HISTORY_MODE" ]; then
+        # The mode decides the trace, whatever BRANCH_TRACE_FORMAT says
+        case "$BRANCH_HISTORY_MODE" in
+            trace|sample) LOG_FILE="$LOG_DIR/${BASE_NAME}_branch_history.log" ;;
+            pack) LOG_FILE="$LOG_DIR/${BASE_NAME}_branch_history.rle" ;;
+            *) LOG_FILE="" ;;
+        esac
+    fi
+    if [ -n "$LOG_FILE" ] && [ -n "$BRANCH_HISTORY_SEGMENT_BYTES" ] && [ "$BRANCH_HISTORY_SEGMENT_BYTES" != "0" ]; then
+        # Rotated into segments listed by a manifest
+        LOG_FILE="$LOG_DIR/${BASE_NAME}_branch_history.manifest"
+    fi
     
     PROGRESS=$((i + 1))
     echo "Compiling and running $PROGRESS out of $TOTAL_INSTR: $INSTR_FILE -> $EXEC_FILE"
 
     # Compile with DynamicLog.o
-    $LLVM_DIR/bin/clang "$INSTR_FILE" DynamicLog.o -o "$EXEC_FILE" -lstdc++
+    $LLVM_DIR/bin/clang "$INSTR_FILE" DynamicLog.o -o "$EXEC_FILE" -lstdc++ -pthread -lrt
 
     if [ $? -ne 0 ]; then
         echo "Compilation failed for $INSTR_FILE"
@@ -101,6 +148,13 @@ for ((i = 0; i < TOTAL_INSTR; i++)); do
     fi
 
     # Run the instrumented program with PROGRAM_NAME set
+    # (BRANCH_TRACE_FORMAT / BRANCH_HISTORY_RECORD_HISTORY / BRANCH_HISTORY_GHR_COUNTERS /
+    # BRANCH_HISTORY_PER_PROCESS / BRANCH_HISTORY_BUFFER_BYTES / BRANCH_HISTORY_SIGNAL_HANDLERS /
+    # BRANCH_HISTORY_SEGMENT_BYTES / BRANCH_HISTORY_TOTAL_BYTES / BRANCH_HISTORY_CAP_POLICY /
+    # BRANCH_HISTORY_SHM / BRANCH_HISTORY_STATS / BRANCH_HISTORY_SAMPLE_PERIOD /
+    # BRANCH_HISTORY_HOT_PROFILE / BRANCH_HISTORY_HOT_BRANCHES / BRANCH_HISTORY_BRANCH_CAPACITY are passed through
+    # from the caller; forked children always
+    # trace to ${BASE_NAME}_branch_history_<pid>.*)
     echo "Running $EXEC_FILE..."
     PROGRAM_NAME="$BASE_NAME" ./"$EXEC_FILE"
 
@@ -108,7 +162,11 @@ for ((i = 0; i < TOTAL_INSTR; i++)); do
         echo "Execution failed for $EXEC_FILE"
     else
         echo "Successfully ran $EXEC_FILE"
-        if [ -f "$LOG_FILE" ]; then
+        if [ "$BRANCH_HISTORY_MODE" = "predict" ]; then
+            echo "Mispredictions written to $LOG_DIR/${BASE_NAME}_branch_mispredictions.log"
+        elif [ -z "$LOG_FILE" ]; then
+            echo "Trace disabled; per-run profiles are in $LOG_DIR/${BASE_NAME}_branch_profile_*.bprof"
+        elif [ -f "$LOG_FILE" ]; then
             echo "Log file created: $LOG_FILE"
         else
             echo "Warning: $LOG_FILE not found"
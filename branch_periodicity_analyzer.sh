@@ -0,0 +1,56 @@
+#!/bin/bash
+
+# Directory containing branch history logs written by the instrumented programs
+LOG_DIR="branch_history_logs"
+
+# Output directory for the per-branch periodicity and run-length statistics
+OUTPUT_DIR="branch_periodicity"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+if [ ! -d "$OUTPUT_DIR" ]; then
+    echo "Creating directory: $OUTPUT_DIR"
+    mkdir "$OUTPUT_DIR"
+    if [ $? -ne 0 ]; then
+        echo "Failed to create directory $OUTPUT_DIR"
+        exit 1
+    fi
+fi
+
+# Compile the analyzer
+echo "Compiling BranchPeriodicityAnalyzer..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O3 -pthread -o BranchPeriodicityAnalyzer BranchPeriodicityAnalyzer.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchPeriodicityAnalyzer failed"
+    exit 1
+fi
+
+LOG_FILES=($(find "$LOG_DIR" -type f -name "*_branch_history.log"))
+TOTAL_FILES=${#LOG_FILES[@]}
+
+if [ $TOTAL_FILES -eq 0 ]; then
+    echo "No branch history logs found in $LOG_DIR"
+    exit 1
+fi
+
+echo "Found $TOTAL_FILES branch history logs to analyze"
+
+for ((i = 0; i < TOTAL_FILES; i++)); do
+    LOG_FILE="${LOG_FILES[$i]}"
+    BASE_NAME=$(basename "$LOG_FILE" _branch_history.log)
+    OUTPUT_FILE="$OUTPUT_DIR/${BASE_NAME}_branch_periodicity.txt"
+
+    PROGRESS=$((i + 1))
+    echo "Analyzing $PROGRESS out of $TOTAL_FILES: $LOG_FILE -> $OUTPUT_FILE"
+
+    ./BranchPeriodicityAnalyzer "$LOG_FILE" "$OUTPUT_FILE"
+
+    if [ $? -ne 0 ]; then
+        echo "Periodicity analysis failed for $LOG_FILE"
+    else
+        echo "Successfully analyzed $LOG_FILE"
+    fi
+done
+
+echo "Done processing all $TOTAL_FILES branch history logs"
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Directory containing branch history logs written by the instrumented programs
+LOG_DIR="branch_history_logs"
+
+# Output directory for the per-branch TAGE-SC-L labels
+LABEL_DIR="branch_labels"
+
+# Predictor storage budget in KB (8, 16, 32, 64, ...); override with the first argument
+BUDGET_KB="${1:-64}"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+if [ ! -d "$LABEL_DIR" ]; then
+    echo "Creating directory: $LABEL_DIR"
+    mkdir "$LABEL_DIR"
+    if [ $? -ne 0 ]; then
+        echo "Failed to create directory $LABEL_DIR"
+        exit 1
+    fi
+fi
+
+# Compile the simulator
+echo "Compiling BranchPredictorSimulator..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O3 -pthread -o BranchPredictorSimulator BranchPredictorSimulator.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchPredictorSimulator failed"
+    exit 1
+fi
+
+LOG_FILES=($(find "$LOG_DIR" -type f -name "*_branch_history.log"))
+TOTAL_FILES=${#LOG_FILES[@]}
+
+if [ $TOTAL_FILES -eq 0 ]; then
+    echo "No branch history logs found in $LOG_DIR"
+    exit 1
+fi
+
+echo "Found $TOTAL_FILES branch history logs to label with a ${BUDGET_KB} KB TAGE-SC-L"
+
+for ((i = 0; i < TOTAL_FILES; i++)); do
+    LOG_FILE="${LOG_FILES[$i]}"
+    BASE_NAME=$(basename "$LOG_FILE" _branch_history.log)
+    LABEL_FILE="$LABEL_DIR/${BASE_NAME}_branch_labels.txt"
+
+    PROGRESS=$((i + 1))
+    echo "Simulating $PROGRESS out of $TOTAL_FILES: $LOG_FILE -> $LABEL_FILE"
+
+    ./BranchPredictorSimulator --budget-kb "$BUDGET_KB" "$LOG_FILE" "$LABEL_FILE"
+
+    if [ $? -ne 0 ]; then
+        echo "Simulation failed for $LOG_FILE"
+    else
+        echo "Successfully labelled $LOG_FILE"
+    fi
+done
+
+echo "Done processing all $TOTAL_FILES branch history logs"
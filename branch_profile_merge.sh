@@ -0,0 +1,62 @@
+#!/bin/bash
+
+# Directory containing the per-run profiles written by the instrumented programs
+LOG_DIR="branch_history_logs"
+
+# Output directory for the merged profiles and their CSV dumps
+OUTPUT_DIR="branch_profiles"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+if [ ! -d "$OUTPUT_DIR" ]; then
+    echo "Creating directory: $OUTPUT_DIR"
+    mkdir "$OUTPUT_DIR"
+    if [ $? -ne 0 ]; then
+        echo "Failed to create directory $OUTPUT_DIR"
+        exit 1
+    fi
+fi
+
+# Compile the profile tool
+echo "Compiling BranchProfData..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O3 -pthread -o BranchProfData BranchProfData.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchProfData failed"
+    exit 1
+fi
+
+# Per-run profiles are named <program>_branch_profile_<pid>_<timestamp>.bprof
+PROGRAMS=($(find "$LOG_DIR" -type f -name "*_branch_profile_*.bprof" | sed -e 's|.*/||' -e 's|_branch_profile_[0-9]*_[0-9]*\.bprof$||' | sort -u))
+TOTAL_PROGRAMS=${#PROGRAMS[@]}
+
+if [ $TOTAL_PROGRAMS -eq 0 ]; then
+    echo "No per-run profiles found in $LOG_DIR"
+    exit 1
+fi
+
+echo "Found profiles for $TOTAL_PROGRAMS programs"
+
+for ((i = 0; i < TOTAL_PROGRAMS; i++)); do
+    PROGRAM="${PROGRAMS[$i]}"
+    LIST_FILE="$OUTPUT_DIR/${PROGRAM}_inputs.txt"
+    OUTPUT_FILE="$OUTPUT_DIR/${PROGRAM}.bprof"
+
+    find "$LOG_DIR" -type f -name "${PROGRAM}_branch_profile_*.bprof" > "$LIST_FILE"
+    RUNS=$(wc -l < "$LIST_FILE")
+
+    PROGRESS=$((i + 1))
+    echo "Merging $PROGRESS out of $TOTAL_PROGRAMS: $RUNS runs of $PROGRAM -> $OUTPUT_FILE"
+
+    ./BranchProfData merge --input-files "$LIST_FILE" -o "$OUTPUT_FILE" && \
+        ./BranchProfData show "$OUTPUT_FILE" > "$OUTPUT_DIR/${PROGRAM}_branch_profile.txt"
+
+    if [ $? -ne 0 ]; then
+        echo "Merge failed for $PROGRAM"
+    else
+        echo "Successfully merged $PROGRAM"
+    fi
+    rm -f "$LIST_FILE"
+done
+
+echo "Done processing all $TOTAL_PROGRAMS programs"
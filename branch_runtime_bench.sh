@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Microbenchmarks the runtime's entry points (see BranchRuntimeBench.cpp), e.g.
+#   ./branch_runtime_bench.sh --threads 8 --entries count,shards,atomic
+# Arguments are passed to BranchRuntimeBench; the CSV goes to stdout and to OUTPUT_FILE.
+
+# The runs write their traces and profiles here; it is removed afterwards
+RUN_DIR="runtime_bench_runs"
+OUTPUT_FILE="runtime_bench.csv"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+if [ ! -d "$RUN_DIR/branch_history_logs" ]; then
+    mkdir -p "$RUN_DIR/branch_history_logs"
+    if [ $? -ne 0 ]; then
+        echo "Failed to create directory $RUN_DIR"
+        exit 1
+    fi
+fi
+
+echo "Compiling DynamicLog.o..."
+$LLVM_DIR/bin/clang -std=c++17 -O2 -c -o DynamicLog.o DynamicLog.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of DynamicLog.o failed"
+    exit 1
+fi
+
+echo "Compiling BranchRuntimeBench..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O2 -pthread -o BranchRuntimeBench BranchRuntimeBench.cpp DynamicLog.o -lrt
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchRuntimeBench failed"
+    exit 1
+fi
+
+(cd "$RUN_DIR" && ../BranchRuntimeBench "$@") | tee "$OUTPUT_FILE"
+STATUS=${PIPESTATUS[0]}
+rm -rf "$RUN_DIR"
+exit $STATUS
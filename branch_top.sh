@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# Watches the live branch counters of a program run with BRANCH_HISTORY_SHM=1, e.g.
+#   BRANCH_HISTORY_SHM=1 ./branch_history_instrumenter.sh &
+#   ./branch_top.sh --sort unpredictable <program or pid>
+# Without a target, lists the programs currently exporting counters.
+
+LLVM_DIR="/usr/local/llvm-10"
+
+# Compile the viewer
+echo "Compiling BranchTop..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O3 -pthread -o BranchTop BranchTop.cpp -lrt
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchTop failed"
+    exit 1
+fi
+
+./BranchTop "$@"
@@ -0,0 +1,56 @@
+#!/bin/bash
+
+# Directory containing branch history logs written by the instrumented programs
+LOG_DIR="branch_history_logs"
+
+# Target format: text, rle or block (first argument, default rle)
+FORMAT="${1:-rle}"
+
+# Source extension when converting back to text (second argument, default rle)
+SOURCE_EXT="${2:-rle}"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+case "$FORMAT" in
+    text) IN_EXT="$SOURCE_EXT"; OUT_EXT="log" ;;
+    rle) IN_EXT="log"; OUT_EXT="rle" ;;
+    block) IN_EXT="log"; OUT_EXT="blk" ;;
+    *) echo "Unknown format $FORMAT (expected text, rle or block)"; exit 1 ;;
+esac
+
+# Compile the converter
+echo "Compiling BranchTraceConvert..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O3 -pthread -o BranchTraceConvert BranchTraceConvert.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchTraceConvert failed"
+    exit 1
+fi
+
+TRACE_FILES=($(find "$LOG_DIR" -type f -name "*_branch_history.$IN_EXT"))
+TOTAL_FILES=${#TRACE_FILES[@]}
+
+if [ $TOTAL_FILES -eq 0 ]; then
+    echo "No *_branch_history.$IN_EXT traces found in $LOG_DIR"
+    exit 1
+fi
+
+echo "Found $TOTAL_FILES traces to convert to $FORMAT"
+
+for ((i = 0; i < TOTAL_FILES; i++)); do
+    TRACE_FILE="${TRACE_FILES[$i]}"
+    OUTPUT_FILE="${TRACE_FILE%.$IN_EXT}.$OUT_EXT"
+
+    PROGRESS=$((i + 1))
+    echo "Converting $PROGRESS out of $TOTAL_FILES: $TRACE_FILE -> $OUTPUT_FILE"
+
+    ./BranchTraceConvert --format "$FORMAT" "$TRACE_FILE" "$OUTPUT_FILE"
+
+    if [ $? -ne 0 ]; then
+        echo "Conversion failed for $TRACE_FILE"
+    else
+        echo "Successfully converted $TRACE_FILE"
+    fi
+done
+
+echo "Done processing all $TOTAL_FILES traces"
@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Directory containing branch history logs written by the instrumented programs
+LOG_DIR="branch_history_logs"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+# Compile the index builder
+echo "Compiling BranchTraceIndex..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O3 -pthread -o BranchTraceIndex BranchTraceIndex.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchTraceIndex failed"
+    exit 1
+fi
+
+# Text logs from before the runtime wrote index sidecars, and binary traces whose run
+# did not reach exit, get a "<trace>.idx" sidecar; indexed traces are left alone.
+# A rotated trace's manifest gets its segments indexed in parallel.
+TRACE_FILES=($(find "$LOG_DIR" -type f \( -name "*_branch_history.log" -o -name "*_branch_history.rle" -o -name "*_branch_history.blk" -o -name "*_branch_history.manifest" \)))
+TOTAL_FILES=${#TRACE_FILES[@]}
+
+if [ $TOTAL_FILES -eq 0 ]; then
+    echo "No branch history traces found in $LOG_DIR"
+    exit 1
+fi
+
+echo "Found $TOTAL_FILES traces to index"
+
+for ((i = 0; i < TOTAL_FILES; i++)); do
+    TRACE_FILE="${TRACE_FILES[$i]}"
+
+    PROGRESS=$((i + 1))
+    echo "Indexing $PROGRESS out of $TOTAL_FILES: $TRACE_FILE"
+
+    ./BranchTraceIndex "$TRACE_FILE"
+
+    if [ $? -ne 0 ]; then
+        echo "Indexing failed for $TRACE_FILE"
+    else
+        echo "Successfully indexed $TRACE_FILE"
+    fi
+done
+
+echo "Done processing all $TOTAL_FILES traces"
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Directory containing branch history logs written by the instrumented programs
+LOG_DIR="branch_history_logs"
+
+# Memory budget for each transposition in MB (first argument, default 1024)
+MEMORY_MB="${1:-1024}"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+# Compile the transposer
+echo "Compiling BranchTraceTranspose..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O3 -pthread -o BranchTraceTranspose BranchTraceTranspose.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of BranchTraceTranspose failed"
+    exit 1
+fi
+
+TRACE_FILES=($(find "$LOG_DIR" -type f \( -name "*_branch_history.log" -o -name "*_branch_history.rle" -o -name "*_branch_history.blk" -o -name "*_branch_history.manifest" \)))
+TOTAL_FILES=${#TRACE_FILES[@]}
+
+if [ $TOTAL_FILES -eq 0 ]; then
+    echo "No branch history traces found in $LOG_DIR"
+    exit 1
+fi
+
+echo "Found $TOTAL_FILES traces to transpose"
+
+for ((i = 0; i < TOTAL_FILES; i++)); do
+    TRACE_FILE="${TRACE_FILES[$i]}"
+    OUTPUT_FILE="${TRACE_FILE%.*}.pack"
+
+    PROGRESS=$((i + 1))
+    echo "Transposing $PROGRESS out of $TOTAL_FILES: $TRACE_FILE -> $OUTPUT_FILE"
+
+    ./BranchTraceTranspose --memory-mb "$MEMORY_MB" "$TRACE_FILE" "$OUTPUT_FILE"
+
+    if [ $? -ne 0 ]; then
+        echo "Transposition failed for $TRACE_FILE"
+    else
+        echo "Successfully transposed $TRACE_FILE"
+    fi
+done
+
+echo "Done processing all $TOTAL_FILES traces"
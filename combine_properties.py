@@ -209,7 +209,8 @@ def parse_branch_history(bh_file):
         with open(bh_file, 'r') as f:
             next(f)  # Skip header
             for line in f:
-                branch_id, taken = map(int, line.strip().split(','))
+                fields = line.strip().split(',')  # Optional ghr/path columns follow the outcome
+                branch_id, taken = int(fields[0]), int(fields[1])
                 branch_outcomes[branch_id].append(taken)
     except Exception as e:
         print(f"Error parsing {bh_file}: {e}")
@@ -224,7 +225,86 @@ def parse_branch_history(bh_file):
         print(f"Branch {branch_id}: taken_prob={taken_prob}, geo={geo}")
     return history_features
 
-def build_edge_features(cf_data, instr_text, label_to_start, function_to_head_and_tail, function_scopes, func_map, instr_order, node_to_id, mem_ops, bh_data, dependencies, branch_ids, max_dist=100):
+def parse_branch_correlation(corr_file):
+    """Parse the runtime's GHR-conditioned counters (BRANCH_HISTORY_GHR_COUNTERS)."""
+    pattern_counts = defaultdict(list)  # branch_id: [(executions, taken), ...]
+    try:
+        with open(corr_file, 'r') as f:
+            next(f)  # Skip header
+            for line in f:
+                branch_id, pattern, executions, taken = map(int, line.strip().split(','))
+                pattern_counts[branch_id].append((executions, taken))
+    except Exception as e:
+        print(f"Error parsing {corr_file}: {e}")
+        return {}
+
+    correlation_features = {}
+    for branch_id, counts in pattern_counts.items():
+        n = sum(e for e, _ in counts)
+        # Accuracy of an ideal per-branch predictor indexed by global history
+        ghr_predictability = sum(max(t, e - t) for e, t in counts) / n if n > 0 else 0.0
+        correlation_features[branch_id] = [ghr_predictability, len(counts)]
+        print(f"Branch {branch_id}: ghr_predictability={ghr_predictability}, patterns={len(counts)}")
+    return correlation_features
+
+def parse_markov_features(markov_file):
+    """Parse per-branch order-k transition statistics written by BranchMarkovAnalyzer."""
+    markov_features = {}  # branch_id: [acc_1, acc_2, acc_4, acc_8, entropy_8]
+    try:
+        with open(markov_file, 'r') as f:
+            next(f)  # Skip header
+            for line in f:
+                fields = line.strip().split(',')
+                acc = [float(v) for v in fields[2:10]]
+                markov_features[int(fields[0])] = [acc[0], acc[1], acc[3], acc[7], float(fields[10])]
+    except Exception as e:
+        print(f"Error parsing {markov_file}: {e}")
+        return {}
+    return markov_features
+
+def parse_periodicity(periodicity_file):
+    """Parse per-branch period and run-length statistics written by BranchPeriodicityAnalyzer."""
+    periodicity_features = {}  # branch_id: [period, period_exact, period_match, loop_predictable, trip_count]
+    try:
+        with open(periodicity_file, 'r') as f:
+            next(f)  # Skip header
+            for line in f:
+                fields = line.strip().split(',')
+                periodicity_features[int(fields[0])] = [int(fields[3]), int(fields[4]), float(fields[5]), int(fields[12]), int(fields[13])]
+    except Exception as e:
+        print(f"Error parsing {periodicity_file}: {e}")
+        return {}
+    return periodicity_features
+
+def parse_branch_labels(label_file):
+    """Parse per-branch TAGE-SC-L residual mispredictions written by BranchPredictorSimulator."""
+    branch_labels = {}  # branch_id: [executions, mispredictions, misprediction_rate]
+    try:
+        with open(label_file, 'r') as f:
+            next(f)  # Skip header
+            for line in f:
+                branch_id, executions, taken, mispredictions, rate = line.strip().split(',')
+                branch_labels[int(branch_id)] = [int(executions), int(mispredictions), float(rate)]
+    except Exception as e:
+        print(f"Error parsing {label_file}: {e}")
+        return {}
+    return branch_labels
+
+def parse_correlation_edges(corr_edge_file):
+    """Parse branch-to-branch correlation edges written by BranchCorrelationAnalyzer."""
+    correlation_edges = []  # (source_branch, target_branch, mutual_information, agreement, coverage)
+    try:
+        with open(corr_edge_file, 'r') as f:
+            next(f)  # Skip header
+            for line in f:
+                source, target, samples, mi, agreement, coverage = line.strip().split(',')
+                correlation_edges.append((int(source), int(target), float(mi), float(agreement), float(coverage)))
+    except Exception as e:
+        print(f"Error parsing {corr_edge_file}: {e}")
+        return []
+    return correlation_edges
+
+def build_edge_features(cf_data, instr_text, label_to_start, function_to_head_and_tail, function_scopes, func_map, instr_order, node_to_id, mem_ops, bh_data, dependencies, branch_ids, max_dist=100, correlation_edges=None):
     """Build edge features ensuring branches and returns connect to correct instructions."""
     edge_features = {}
     branch_mapping = {}
@@ -345,9 +425,32 @@ def build_edge_features(cf_data, instr_text, label_to_start, function_to_head_an
                     edge_features[(store_id, load_id)] = [dist_to_branch_dep, 0.0, 0.0, 0.0, *cf_data[store_id][2:10], src_in_loop_dep, cf_data[load_id][0], 1, 4]
                     print(f"Memory edge (RAW, store->load): {store_id} -> {load_id}, mem_addr={mem_addr}")
     
-    return edge_features, branch_mapping
+    # Correlation edges (earlier branch -> hard branch it predicts), kept apart: the two
+    # branches are often already joined by a branch or sequential edge
+    correlation_edge_features = {}
+    for source, target, mi, agreement, coverage in (correlation_edges or []):
+        src_node = branch_mapping.get(source)
+        tgt_node = branch_mapping.get(target)
+        if src_node is None or tgt_node is None:
+            print(f"Warning: Skipping correlation edge {source} -> {target}, branch not found")
+            continue
+        dist_to_branch_src = min(cf_data[src_node][1] / max_dist, 1.0)
+        correlation_edge_features[(src_node, tgt_node)] = [dist_to_branch_src, mi, agreement, coverage, *cf_data[src_node][2:10], cf_data[src_node][0], cf_data[tgt_node][0], 0, 9]
+        print(f"Correlation edge: {src_node} -> {tgt_node} (branch {source} -> {target}), mi={mi}, agreement={agreement}")
 
-def merge_features_for_corpus(ll_dir="dsa/dsa/llvm", cf_dir="control_flow_features", bh_dir="branch_history_logs", output_dir="edge_features"):
+    return edge_features, branch_mapping, correlation_edge_features
+
+def write_branch_node_features(output_file, features, branch_mapping):
+    """Write per-branch features keyed by the branch's node in the edge graph."""
+    with open(output_file, 'w') as f:
+        for branch_id, feat in sorted(features.items()):
+            node = branch_mapping.get(branch_id)
+            if node is None:
+                print(f"Warning: Skipping features of branch {branch_id}, branch not found")
+                continue
+            f.write(f"  Node {node} (branch {branch_id}): {feat}\n")
+
+def merge_features_for_corpus(ll_dir="dsa/dsa/llvm", cf_dir="control_flow_features", bh_dir="branch_history_logs", output_dir="edge_features", label_dir="branch_labels", corr_dir="branch_correlations", markov_dir="branch_markov", periodicity_dir="branch_periodicity"):
     corpus_data = {}
     
     # Create output directory if it doesn't exist
@@ -373,16 +476,39 @@ def merge_features_for_corpus(ll_dir="dsa/dsa/llvm", cf_dir="control_flow_featur
                 continue
             
             bh_data = parse_branch_history(bh_file)
+            label_file = f"{label_dir}/{base_name}_branch_labels.txt"
+            branch_labels = parse_branch_labels(label_file) if os.path.exists(label_file) else {}
+            periodicity_file = f"{periodicity_dir}/{base_name}_branch_periodicity.txt"
+            periodicity_features = parse_periodicity(periodicity_file) if os.path.exists(periodicity_file) else {}
+            corr_file = f"{bh_dir}/{base_name}_branch_correlation.log"
+            correlation_features = parse_branch_correlation(corr_file) if os.path.exists(corr_file) else {}
             
-            edge_features, branch_mapping = build_edge_features(
-                cf_data, instr_text, label_to_start, function_to_head_and_tail, function_scopes, func_map, instr_order, node_to_id, mem_ops, bh_data, dependencies, branch_ids, max_dist=100
+            corr_edge_file = f"{corr_dir}/{base_name}_branch_correlations.txt"
+            correlation_edges = parse_correlation_edges(corr_edge_file) if os.path.exists(corr_edge_file) else []
+
+            edge_features, branch_mapping, correlation_edge_features = build_edge_features(
+                cf_data, instr_text, label_to_start, function_to_head_and_tail, function_scopes, func_map, instr_order, node_to_id, mem_ops, bh_data, dependencies, branch_ids, max_dist=100, correlation_edges=correlation_edges
             )
             
+            # Markov features for conditional branch edges (taken / not taken)
+            markov_file = f"{markov_dir}/{base_name}_branch_markov.txt"
+            markov_data = parse_markov_features(markov_file) if os.path.exists(markov_file) else {}
+            node_to_branch = {node: bid for bid, node in branch_mapping.items()}
+            markov_edge_features = {}
+            for (src_node, tgt_node), feat in edge_features.items():
+                if feat[-1] in (1, 2) and node_to_branch.get(src_node) in markov_data:
+                    markov_edge_features[(src_node, tgt_node)] = markov_data[node_to_branch[src_node]]
+
             corpus_data[base_name] = {
                 "edge_features": edge_features,
+                "correlation_edge_features": correlation_edge_features,
                 "node_to_id": node_to_id,
                 "instr_text": instr_text,
-                "branch_mapping": branch_mapping
+                "branch_mapping": branch_mapping,
+                "branch_labels": branch_labels,
+                "correlation_features": correlation_features,
+                "markov_edge_features": markov_edge_features,
+                "periodicity_features": periodicity_features
             }
             
             # Write edge features to program-specific file
@@ -393,6 +519,28 @@ def merge_features_for_corpus(ll_dir="dsa/dsa/llvm", cf_dir="control_flow_featur
                     src_instr = instr_text.get(src_node, "Unknown")
                     tgt_instr = instr_text.get(tgt_node, "Unknown")
                     f.write(f"  Edge {src_node} -> {tgt_node} (\"{src_instr}\" -> \"{tgt_instr}\"): {feat}\n")
+                for (src_node, tgt_node), feat in sorted(correlation_edge_features.items()):
+                    src_instr = instr_text.get(src_node, "Unknown")
+                    tgt_instr = instr_text.get(tgt_node, "Unknown")
+                    f.write(f"  Edge {src_node} -> {tgt_node} (\"{src_instr}\" -> \"{tgt_instr}\"): {feat}\n")
+
+            if markov_edge_features:
+                markov_output_file = os.path.join(output_dir, f"{base_name}_markov_edge_features.txt")
+                with open(markov_output_file, 'w') as f:
+                    for (src_node, tgt_node), feat in sorted(markov_edge_features.items()):
+                        f.write(f"  Edge {src_node} -> {tgt_node}: {feat}\n")
+
+            # TAGE-SC-L ground truth: [executions, mispredictions, misprediction_rate]
+            if branch_labels:
+                write_branch_node_features(os.path.join(output_dir, f"{base_name}_branch_labels.txt"), branch_labels, branch_mapping)
+
+            # GHR-conditioned predictability: [ghr_predictability, patterns]
+            if correlation_features:
+                write_branch_node_features(os.path.join(output_dir, f"{base_name}_ghr_node_features.txt"), correlation_features, branch_mapping)
+
+            # Periodicity: [period, period_exact, period_match, loop_predictable, trip_count]
+            if periodicity_features:
+                write_branch_node_features(os.path.join(output_dir, f"{base_name}_periodicity_node_features.txt"), periodicity_features, branch_mapping)
     
     # Print the processing log
     with open(os.path.join(output_dir, "processing_log.txt"), 'r') as log_f:
@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# Measures how ControlFlowExtractor's time and peak memory grow with function size on
+# synthetic modules (see ControlFlowExtractorBenchmark.cpp), e.g.
+#   ./control_flow_extractor_benchmark.sh --sizes 1000,10000,100000 --loop-depth 6
+# Arguments are passed to ControlFlowExtractorBenchmark; the CSV goes to stdout and to
+# OUTPUT_FILE. The exit status is 2 when growth is super-linear.
+
+# The synthetic modules are written here; it is removed afterwards
+RUN_DIR="control_flow_extractor_benchmark_runs"
+OUTPUT_FILE="control_flow_extractor_benchmark.csv"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+if [ ! -d "$RUN_DIR" ]; then
+    mkdir -p "$RUN_DIR"
+    if [ $? -ne 0 ]; then
+        echo "Failed to create directory $RUN_DIR"
+        exit 1
+    fi
+fi
+
+echo "Compiling ControlFlowExtractor.so..."
+$LLVM_DIR/bin/clang++ -std=c++17 -fPIC -shared -o ControlFlowExtractor.so ControlFlowExtractor.cpp \
+    $(/usr/local/llvm-10/bin/llvm-config --cxxflags --ldflags) \
+    -I/usr/local/llvm-10/include \
+    -L/usr/local/llvm-10/lib \
+    -Wl,-rpath,/usr/local/llvm-10/lib
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of ControlFlowExtractor.so failed"
+    exit 1
+fi
+
+echo "Compiling ControlFlowExtractorBenchmark..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O2 -o ControlFlowExtractorBenchmark ControlFlowExtractorBenchmark.cpp \
+    $(/usr/local/llvm-10/bin/llvm-config --cxxflags --ldflags --libs core support --system-libs) \
+    -Wl,-rpath,/usr/local/llvm-10/lib
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of ControlFlowExtractorBenchmark failed"
+    exit 1
+fi
+
+(cd "$RUN_DIR" && ../ControlFlowExtractorBenchmark --opt "$LLVM_DIR/bin/opt" \
+    --plugin ../ControlFlowExtractor.so "$@") | tee "$OUTPUT_FILE"
+STATUS=${PIPESTATUS[0]}
+rm -rf "$RUN_DIR"
+exit $STATUS
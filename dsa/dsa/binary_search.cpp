@@ -1,4 +1,5 @@
 #include <iostream>
+#include "inputs.h"
 using namespace std;
 
 int binarySearch(int arr[], int l, int r, int x) {
@@ -11,11 +12,33 @@ int binarySearch(int arr[], int l, int r, int x) {
     return -1;
 }
 
-int main() {
-    int arr[] = {1, 3, 5, 7, 9};
-    int n = sizeof(arr) / sizeof(arr[0]);
-    int x = 5;
-    int result = binarySearch(arr, 0, n - 1, x);
-    cout << (result != -1 ? "Found" : "Not Found") << endl;
+// size: array length and number of searches. The array holds the odd numbers below
+// 2 * size; queries come in the given order, half of them present. Adversarial
+// queries are random even numbers, none present, so every search runs to full depth.
+int main(int argc, char** argv) {
+    Input input;
+    if (!parseInput(argc, argv, input, 1 << 30)) return 1; // 2 * size - 1 is an int
+    if (!input.given) {
+        int arr[] = {1, 3, 5, 7, 9};
+        int n = sizeof(arr) / sizeof(arr[0]);
+        int x = 5;
+        int result = binarySearch(arr, 0, n - 1, x);
+        cout << (result != -1 ? "Found" : "Not Found") << endl;
+        return 0;
+    }
+
+    int n = int(input.size);
+    vector<int> arr(n);
+    for (int i = 0; i < n; i++) arr[i] = 2 * i + 1;
+    vector<int> queries = makeValues(n, 2 * uint64_t(n), input.seed,
+                                     input.order == AdversarialOrder ? RandomOrder : input.order);
+    if (input.order == AdversarialOrder) {
+        for (int i = 0; i < n; i++) queries[i] &= ~1;
+    }
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        if (binarySearch(arr.data(), 0, n - 1, queries[i]) != -1) found++;
+    }
+    cout << "Found " << found << " of " << n << endl;
     return 0;
 }
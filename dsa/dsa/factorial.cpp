@@ -1,13 +1,29 @@
 #include <iostream>
+#include "inputs.h"
 using namespace std;
 
-int factorial(int n) {
+// Wraps modulo 2^64 past 20!
+uint64_t factorial(uint64_t n) {
     if (n <= 1) return 1;
     return n * factorial(n - 1);
 }
 
-int main() {
-    int num = 5;
-    cout << "Factorial of " << num << " is " << factorial(num) << endl;
+// size: number of factorials, of arguments below 64 in the given order; the
+// adversarial arguments are all 63, the deepest recursion.
+int main(int argc, char** argv) {
+    Input input;
+    if (!parseInput(argc, argv, input)) return 1;
+    if (!input.given) {
+        int num = 5;
+        cout << "Factorial of " << num << " is " << factorial(num) << endl;
+        return 0;
+    }
+
+    vector<int> args = makeValues(input.size, 64, input.seed, input.order);
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < input.size; i++) {
+        checksum = checksum * 31 + factorial(input.order == AdversarialOrder ? 63 : args[i]);
+    }
+    cout << "Checksum of " << input.size << " factorials is " << checksum << endl;
     return 0;
 }
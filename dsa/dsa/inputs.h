@@ -0,0 +1,106 @@
+#ifndef DSA_INPUTS_H
+#define DSA_INPUTS_H
+
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Scalable inputs for the corpus programs. Every program runs as
+//   <program> [size [seed [random|sorted|nearly-sorted|adversarial]]]
+// and, without arguments, on its original small example. What size counts (elements,
+// queries, matrix dimension, ...) is up to the program; the same size, seed and order
+// always give the same input. Orders:
+//   random        - uniformly random values (the default)
+//   sorted        - ascending values
+//   nearly-sorted - ascending, with one element in a hundred swapped with a random one
+//   adversarial   - the worst case of the program's algorithm
+// Generating an input is O(size) and logs branch events of its own. A size the program
+// cannot index (maxSize, e.g. INT_MAX for int indices) is rejected, not truncated.
+
+enum InputOrder { RandomOrder, SortedOrder, NearlySortedOrder, AdversarialOrder };
+
+struct Input {
+    bool given; // false: run the original example
+    uint64_t size;
+    uint64_t seed;
+    InputOrder order;
+};
+
+inline bool parseInput(int argc, char** argv, Input& input, uint64_t maxSize = UINT64_MAX) {
+    input = {argc > 1, 0, 1, RandomOrder};
+    if (argc > 4) {
+        std::cerr << "Usage: " << argv[0] << " [size [seed [random|sorted|nearly-sorted|adversarial]]]" << std::endl;
+        return false;
+    }
+    if (argc > 1) {
+        char* end = nullptr;
+        errno = 0;
+        input.size = std::strtoull(argv[1], &end, 10);
+        if (end == argv[1] || *end || argv[1][0] == '-' || errno == ERANGE) {
+            std::cerr << "Size " << argv[1] << " is not a number" << std::endl;
+            return false;
+        }
+        if (input.size > maxSize) {
+            std::cerr << "Size " << input.size << " is above " << maxSize << ", the largest " << argv[0]
+                      << " can index" << std::endl;
+            return false;
+        }
+    }
+    if (argc > 2) input.seed = std::strtoull(argv[2], nullptr, 10);
+    if (argc > 3) {
+        if (std::strcmp(argv[3], "random") == 0) input.order = RandomOrder;
+        else if (std::strcmp(argv[3], "sorted") == 0) input.order = SortedOrder;
+        else if (std::strcmp(argv[3], "nearly-sorted") == 0) input.order = NearlySortedOrder;
+        else if (std::strcmp(argv[3], "adversarial") == 0) input.order = AdversarialOrder;
+        else {
+            std::cerr << "Unknown order " << argv[3] << " (random, sorted, nearly-sorted or adversarial)" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// splitmix64: the same sequence on every platform
+inline uint64_t nextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// n values below limit (at most 2^31) in the given order. Ordered values rise by random
+// steps instead of being sorted, which would log O(n log n) events; adversarial gives
+// descending values, for programs whose worst case is not their own.
+inline std::vector<int> makeValues(uint64_t n, uint64_t limit, uint64_t seed, InputOrder order) {
+    std::vector<int> values(n);
+    uint64_t state = seed;
+    if (order == RandomOrder) {
+        for (uint64_t i = 0; i < n; i++) values[i] = int(nextRandom(state) % limit);
+        return values;
+    }
+    uint64_t step = limit / (n ? n : 1);
+    for (uint64_t i = 0; i < n; i++) {
+        values[i] = int(i * limit / n + (step ? nextRandom(state) % step : 0));
+    }
+    if (order == NearlySortedOrder) {
+        for (uint64_t k = 0; k < n / 100; k++) {
+            uint64_t a = nextRandom(state) % n, b = nextRandom(state) % n;
+            int t = values[a];
+            values[a] = values[b];
+            values[b] = t;
+        }
+    } else if (order == AdversarialOrder) {
+        for (uint64_t i = 0; i < n / 2; i++) {
+            int t = values[i];
+            values[i] = values[n - 1 - i];
+            values[n - 1 - i] = t;
+        }
+    }
+    return values;
+}
+
+#endif // DSA_INPUTS_H
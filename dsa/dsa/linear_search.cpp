@@ -1,4 +1,5 @@
 #include <iostream>
+#include "inputs.h"
 using namespace std;
 
 bool linearSearch(int arr[], int n, int x) {
@@ -8,10 +9,28 @@ bool linearSearch(int arr[], int n, int x) {
     return false;
 }
 
-int main() {
-    int arr[] = {1, 3, 5, 7, 9};
-    int n = sizeof(arr) / sizeof(arr[0]);
-    int x = 7;
-    cout << (linearSearch(arr, n, x) ? "Found" : "Not Found") << endl;
+// size: array length and number of searches, about size^2 / 2 events. The array
+// holds values below 2 * size in the given order and the queries are random; the
+// adversarial array is descending and no query is present, so every search scans it all.
+int main(int argc, char** argv) {
+    Input input;
+    if (!parseInput(argc, argv, input, 1 << 30)) return 1; // values below 2 * size are ints
+    if (!input.given) {
+        int arr[] = {1, 3, 5, 7, 9};
+        int n = sizeof(arr) / sizeof(arr[0]);
+        int x = 7;
+        cout << (linearSearch(arr, n, x) ? "Found" : "Not Found") << endl;
+        return 0;
+    }
+
+    int n = int(input.size);
+    vector<int> arr = makeValues(n, 2 * uint64_t(n), input.seed, input.order);
+    vector<int> queries = makeValues(n, 2 * uint64_t(n), input.seed + 1, RandomOrder);
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        int x = input.order == AdversarialOrder ? 2 * n : queries[i];
+        if (linearSearch(arr.data(), n, x)) found++;
+    }
+    cout << "Found " << found << " of " << n << endl;
     return 0;
 }
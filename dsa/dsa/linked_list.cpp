@@ -1,4 +1,5 @@
 #include <iostream>
+#include "inputs.h"
 using namespace std;
 
 struct Node {
@@ -14,11 +15,55 @@ void printList(Node* head) {
     cout << endl;
 }
 
-int main() {
-    Node* head = new Node{1, nullptr};
-    head->next = new Node{2, nullptr};
-    head->next->next = new Node{3, nullptr};
+int countBelow(Node* head, int limit) {
+    int count = 0;
+    while (head) {
+        if (head->data < limit) count++;
+        head = head->next;
+    }
+    return count;
+}
+
+// size: nodes visited. The list holds up to 2^22 nodes with values in the given order
+// and is walked as often as it takes, counting values below the middle of their range.
+// Adversarial lists are linked in random memory order, so every step misses the cache.
+int main(int argc, char** argv) {
+    Input input;
+    if (!parseInput(argc, argv, input)) return 1;
+    if (!input.given) {
+        Node* head = new Node{1, nullptr};
+        head->next = new Node{2, nullptr};
+        head->next->next = new Node{3, nullptr};
 
-    printList(head);
+        printList(head);
+        return 0;
+    }
+
+    uint64_t length = input.size < (1 << 22) ? input.size : (1 << 22);
+    if (length == 0) length = 1;
+    vector<int> values = makeValues(length, 1 << 30, input.seed,
+                                    input.order == AdversarialOrder ? RandomOrder : input.order);
+    vector<Node> nodes(length);
+    vector<uint64_t> slot(length);
+    for (uint64_t i = 0; i < length; i++) slot[i] = i;
+    if (input.order == AdversarialOrder) {
+        uint64_t state = input.seed;
+        for (uint64_t i = length - 1; i > 0; i--) {
+            uint64_t j = nextRandom(state) % (i + 1);
+            uint64_t t = slot[i];
+            slot[i] = slot[j];
+            slot[j] = t;
+        }
+    }
+    for (uint64_t i = 0; i < length; i++) {
+        nodes[slot[i]].data = values[i];
+        nodes[slot[i]].next = i + 1 < length ? &nodes[slot[i + 1]] : nullptr;
+    }
+
+    uint64_t below = 0;
+    for (uint64_t visited = 0; visited < input.size; visited += length) {
+        below += countBelow(&nodes[slot[0]], 1 << 29);
+    }
+    cout << below << " values below " << (1 << 29) << endl;
     return 0;
 }
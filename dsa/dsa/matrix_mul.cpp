@@ -1,26 +1,44 @@
 #include <iostream>
+#include "inputs.h"
 using namespace std;
 
-void multiply(int A[2][2], int B[2][2], int C[2][2]) {
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 2; j++) {
-            C[i][j] = 0;
-            for (int k = 0; k < 2; k++) {
-                C[i][j] += A[i][k] * B[k][j];
+// n x n matrices in row-major order
+void multiply(int* A, int* B, int* C, int n) {
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            C[i * n + j] = 0;
+            for (int k = 0; k < n; k++) {
+                C[i * n + j] += A[i * n + k] * B[k * n + j];
             }
         }
     }
 }
 
-int main() {
-    int A[2][2] = {{1, 2}, {3, 4}};
-    int B[2][2] = {{5, 6}, {7, 8}};
-    int C[2][2];
+// size: matrix dimension, about size^3 events. Entries are below 100 in the given order;
+// the loops do not depend on the values, so every order is the worst case.
+int main(int argc, char** argv) {
+    Input input;
+    if (!parseInput(argc, argv, input, 46340)) return 1; // size * size is an int index
+    if (!input.given) {
+        int A[2][2] = {{1, 2}, {3, 4}};
+        int B[2][2] = {{5, 6}, {7, 8}};
+        int C[2][2];
 
-    multiply(A, B, C);
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 2; j++) cout << C[i][j] << " ";
-        cout << endl;
+        multiply(&A[0][0], &B[0][0], &C[0][0], 2);
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < 2; j++) cout << C[i][j] << " ";
+            cout << endl;
+        }
+        return 0;
     }
+
+    int n = int(input.size);
+    vector<int> A = makeValues(uint64_t(n) * n, 100, input.seed, input.order);
+    vector<int> B = makeValues(uint64_t(n) * n, 100, input.seed + 1, input.order);
+    vector<int> C(uint64_t(n) * n);
+    multiply(A.data(), B.data(), C.data(), n);
+    long long trace = 0;
+    for (int i = 0; i < n; i++) trace += C[i * n + i];
+    cout << "Trace of the " << n << "x" << n << " product is " << trace << endl;
     return 0;
 }
@@ -1,4 +1,5 @@
 #include <iostream>
+#include "inputs.h"
 using namespace std;
 
 bool isPrime(int n) {
@@ -9,8 +10,39 @@ bool isPrime(int n) {
     return true;
 }
 
-int main() {
-    int n = 29;
-    cout << (isPrime(n) ? "Prime" : "Not Prime") << endl;
+// size: numbers tested, below 2^30 in the given order. Adversarial numbers are products
+// of two primes between 2^14 and 2^15, which trial division only rules out near the
+// square root.
+int main(int argc, char** argv) {
+    Input input;
+    if (!parseInput(argc, argv, input)) return 1;
+    if (!input.given) {
+        int n = 29;
+        cout << (isPrime(n) ? "Prime" : "Not Prime") << endl;
+        return 0;
+    }
+
+    vector<int> numbers;
+    if (input.order == AdversarialOrder) {
+        vector<bool> composite(1 << 15);
+        vector<int> primes;
+        for (int p = 2; p < (1 << 15); p++) {
+            if (composite[p]) continue;
+            if (p > (1 << 14)) primes.push_back(p);
+            for (int m = 2 * p; m < (1 << 15); m += p) composite[m] = true;
+        }
+        uint64_t state = input.seed;
+        numbers.resize(input.size);
+        for (uint64_t i = 0; i < input.size; i++) {
+            numbers[i] = primes[nextRandom(state) % primes.size()] * primes[nextRandom(state) % primes.size()];
+        }
+    } else {
+        numbers = makeValues(input.size, 1 << 30, input.seed, input.order);
+    }
+    uint64_t primeCount = 0;
+    for (uint64_t i = 0; i < input.size; i++) {
+        if (isPrime(numbers[i])) primeCount++;
+    }
+    cout << primeCount << " of " << input.size << " numbers are prime" << endl;
     return 0;
 }
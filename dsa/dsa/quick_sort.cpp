@@ -1,4 +1,5 @@
 #include <iostream>
+#include "inputs.h"
 using namespace std;
 
 int partition(int arr[], int low, int high) {
@@ -19,11 +20,26 @@ void quickSort(int arr[], int low, int high) {
     }
 }
 
-int main() {
-    int arr[] = {10, 80, 30, 90, 40, 50, 70};
-    int n = sizeof(arr) / sizeof(arr[0]);
-    quickSort(arr, 0, n - 1);
-    for (int i = 0; i < n; i++) cout << arr[i] << " ";
-    cout << endl;
+// size: elements, below 2^30 in the given order. Sorted and adversarial (descending)
+// inputs make every last-element pivot extreme: size^2 / 2 events and a recursion
+// size deep, so keep them to about 10^5 elements on a default stack.
+int main(int argc, char** argv) {
+    Input input;
+    if (!parseInput(argc, argv, input, INT_MAX)) return 1; // int indices
+    if (!input.given) {
+        int arr[] = {10, 80, 30, 90, 40, 50, 70};
+        int n = sizeof(arr) / sizeof(arr[0]);
+        quickSort(arr, 0, n - 1);
+        for (int i = 0; i < n; i++) cout << arr[i] << " ";
+        cout << endl;
+        return 0;
+    }
+
+    int n = int(input.size);
+    vector<int> arr = makeValues(n, 1 << 30, input.seed, input.order);
+    quickSort(arr.data(), 0, n - 1);
+    uint64_t checksum = 0;
+    for (int i = 0; i < n; i++) checksum = checksum * 31 + uint64_t(arr[i]);
+    cout << "Sorted " << n << " elements, checksum " << checksum << endl;
     return 0;
 }
@@ -11,6 +11,25 @@ extern "C" {
 // Function signature expected by the LLVM pass
 void logBranchOutcome(uint64_t branchID, bool taken);
 
+// Entry points with the recording mode fixed at compile time (see DynamicLog.cpp)
+void logBranchOutcome_count(uint64_t branchID, bool taken);
+void logBranchOutcome_trace(uint64_t branchID, bool taken);
+void logBranchOutcome_pack(uint64_t branchID, bool taken);
+void logBranchOutcome_sample(uint64_t branchID, bool taken);
+void logBranchOutcome_predict(uint64_t branchID, bool taken);
+void logBranchOutcome_shards(uint64_t branchID, bool taken);
+void logBranchOutcome_atomic(uint64_t branchID, bool taken);
+
+// n outcomes of one branch, oldest first in bit i % 64 of bits[i / 64]
+void logBranchOutcomesBulk(uint64_t branchID, const uint64_t* bits, uint64_t n);
+void logBranchOutcomesBulk_count(uint64_t branchID, const uint64_t* bits, uint64_t n);
+void logBranchOutcomesBulk_trace(uint64_t branchID, const uint64_t* bits, uint64_t n);
+void logBranchOutcomesBulk_pack(uint64_t branchID, const uint64_t* bits, uint64_t n);
+void logBranchOutcomesBulk_sample(uint64_t branchID, const uint64_t* bits, uint64_t n);
+void logBranchOutcomesBulk_predict(uint64_t branchID, const uint64_t* bits, uint64_t n);
+void logBranchOutcomesBulk_shards(uint64_t branchID, const uint64_t* bits, uint64_t n);
+void logBranchOutcomesBulk_atomic(uint64_t branchID, const uint64_t* bits, uint64_t n);
+
 // Function to print/save collected dynamic features (call this at program exit)
 void finalizeBranchPredictionData();
 
@@ -0,0 +1,160 @@
+#!/bin/bash
+
+# Mass-produces labelled programs: CORPUS_PROGRAMS random programs (see ProgramGenerator.cpp)
+# are generated, compiled to -O0 IR, feature-extracted, instrumented, run, labelled with
+# TAGE-SC-L and analysed for correlation, Markov and periodicity features, CORPUS_JOBS
+# programs at a time, and their edge features are merged by combine_properties.py.
+# Everything goes under CORPUS_DIR, in the directory layout of the dsa corpus (llvm,
+# control_flow_features, branch_history_logs, branch_labels, branch_correlations, ...).
+#
+# Program k gets profile k modulo the CORPUS_PROFILES list and seed CORPUS_SEED + k, so the
+# same settings always give the same corpus; already finished programs are skipped, so an
+# interrupted run picks up where it stopped. Per-program output is in CORPUS_DIR/logs.
+
+CORPUS_DIR="${CORPUS_DIR:-generated_corpus}"
+CORPUS_PROGRAMS="${CORPUS_PROGRAMS:-100}"
+CORPUS_JOBS="${CORPUS_JOBS:-$(nproc)}"
+CORPUS_PROFILES="${CORPUS_PROFILES:-data loop correlated pointer mixed}"
+CORPUS_SEED="${CORPUS_SEED:-1}"
+# Generator options, see ProgramGenerator.cpp
+CORPUS_FUNCTIONS="${CORPUS_FUNCTIONS:-4}"
+CORPUS_STATEMENTS="${CORPUS_STATEMENTS:-24}"
+CORPUS_HARD="${CORPUS_HARD:-0.3}"
+# Argument of the generated programs; their branch events grow linearly with it
+CORPUS_RUN_SIZE="${CORPUS_RUN_SIZE:-500}"
+CORPUS_TIMEOUT="${CORPUS_TIMEOUT:-120}"
+BUDGET_KB="${BUDGET_KB:-64}"
+
+LLVM_DIR="/usr/local/llvm-10"
+
+for DIR in src llvm control_flow_features instrumented_programs branch_history_logs branch_labels \
+    branch_correlations branch_markov branch_periodicity logs; do
+    if [ ! -d "$CORPUS_DIR/$DIR" ]; then
+        mkdir -p "$CORPUS_DIR/$DIR"
+        if [ $? -ne 0 ]; then
+            echo "Failed to create directory $CORPUS_DIR/$DIR"
+            exit 1
+        fi
+    fi
+done
+
+echo "Compiling ProgramGenerator..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O2 -o ProgramGenerator ProgramGenerator.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of ProgramGenerator failed"
+    exit 1
+fi
+
+for PLUGIN in ControlFlowExtractor BranchHistoryInstrumenter; do
+    echo "Compiling $PLUGIN.so..."
+    $LLVM_DIR/bin/clang++ -std=c++17 -fPIC -shared -o "$PLUGIN.so" "$PLUGIN.cpp" \
+        $(/usr/local/llvm-10/bin/llvm-config --cxxflags --ldflags) \
+        -I/usr/local/llvm-10/include \
+        -L/usr/local/llvm-10/lib \
+        -Wl,-rpath,/usr/local/llvm-10/lib
+
+    if [ $? -ne 0 ]; then
+        echo "Compilation of $PLUGIN.so failed"
+        exit 1
+    fi
+done
+
+echo "Compiling DynamicLog.o..."
+$LLVM_DIR/bin/clang -std=c++17 -O2 -c -o DynamicLog.o DynamicLog.cpp
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of DynamicLog.o failed"
+    exit 1
+fi
+
+for TOOL in BranchPredictorSimulator BranchCorrelationAnalyzer BranchMarkovAnalyzer BranchPeriodicityAnalyzer; do
+    echo "Compiling $TOOL..."
+    $LLVM_DIR/bin/clang++ -std=c++17 -O3 -pthread -o "$TOOL" "$TOOL.cpp"
+
+    if [ $? -ne 0 ]; then
+        echo "Compilation of $TOOL failed"
+        exit 1
+    fi
+done
+
+# Takes one program from generation to labels and analyses; prints one line with the outcome
+process_program() {
+    local NAME="$1" PROFILE="$2" SEED="$3"
+    local LOG="logs/$NAME.log"
+    cd "$CORPUS_DIR" || return 1
+    # Periodicity is the last step, so its output means everything before it is there
+    if [ -s "branch_periodicity/${NAME}_branch_periodicity.txt" ]; then
+        echo "Skipped $NAME (already done)"
+        return 0
+    fi
+
+    step() {
+        local WHAT="$1"
+        shift
+        echo "== $WHAT: $*" >> "$LOG"
+        "$@" >> "$LOG" 2>&1
+        if [ $? -ne 0 ]; then
+            echo "Failed $NAME at $WHAT (see $CORPUS_DIR/$LOG)"
+            return 1
+        fi
+    }
+
+    : > "$LOG"
+    step generation "$REPO_DIR/ProgramGenerator" --profile "$PROFILE" --seed "$SEED" \
+        --functions "$CORPUS_FUNCTIONS" --statements "$CORPUS_STATEMENTS" --hard "$CORPUS_HARD" \
+        "src/$NAME.cpp" &&
+        step compilation "$LLVM_DIR/bin/clang" -std=c++17 -S -emit-llvm -O0 "src/$NAME.cpp" -o "llvm/$NAME.ll" &&
+        step extraction sh -c "\"$LLVM_DIR/bin/opt\" -load-pass-plugin=\"$REPO_DIR/ControlFlowExtractor.so\" \
+            -passes=control-flow-extractor \"llvm/$NAME.ll\" -o /dev/null \
+            2> \"control_flow_features/${NAME}_control_flow_features.txt\"" &&
+        step instrumentation "$LLVM_DIR/bin/opt" -load-pass-plugin="$REPO_DIR/BranchHistoryInstrumenter.so" \
+            -passes=branch-history-instrumenter "llvm/$NAME.ll" -o "instrumented_programs/${NAME}_instrumented.ll" &&
+        step linking "$LLVM_DIR/bin/clang" "instrumented_programs/${NAME}_instrumented.ll" "$REPO_DIR/DynamicLog.o" \
+            -o "instrumented_programs/${NAME}_instrumented" -lstdc++ -pthread -lrt &&
+        step execution env PROGRAM_NAME="$NAME" BRANCH_TRACE_FORMAT=text timeout "$CORPUS_TIMEOUT" \
+            "./instrumented_programs/${NAME}_instrumented" "$CORPUS_RUN_SIZE" "$SEED" &&
+        step labelling "$REPO_DIR/BranchPredictorSimulator" --budget-kb "$BUDGET_KB" \
+            "branch_history_logs/${NAME}_branch_history.log" "branch_labels/${NAME}_branch_labels.txt" &&
+        step correlation "$REPO_DIR/BranchCorrelationAnalyzer" --labels "branch_labels/${NAME}_branch_labels.txt" \
+            "branch_history_logs/${NAME}_branch_history.log" "branch_correlations/${NAME}_branch_correlations.txt" &&
+        step markov "$REPO_DIR/BranchMarkovAnalyzer" \
+            "branch_history_logs/${NAME}_branch_history.log" "branch_markov/${NAME}_branch_markov.txt" &&
+        step periodicity "$REPO_DIR/BranchPeriodicityAnalyzer" \
+            "branch_history_logs/${NAME}_branch_history.log" "branch_periodicity/${NAME}_branch_periodicity.txt" &&
+        echo "Labelled $NAME ($PROFILE)"
+}
+
+export -f process_program
+export REPO_DIR="$PWD" CORPUS_DIR CORPUS_FUNCTIONS CORPUS_STATEMENTS CORPUS_HARD CORPUS_RUN_SIZE CORPUS_TIMEOUT \
+    BUDGET_KB LLVM_DIR
+
+PROFILES=($CORPUS_PROFILES)
+echo "Generating $CORPUS_PROGRAMS programs ($CORPUS_PROFILES), $CORPUS_JOBS at a time, in $CORPUS_DIR"
+
+for ((k = 0; k < CORPUS_PROGRAMS; k++)); do
+    PROFILE="${PROFILES[$((k % ${#PROFILES[@]}))]}"
+    SEED=$((CORPUS_SEED + k))
+    printf "gen_%s_%06d %s %s\n" "$PROFILE" "$SEED" "$PROFILE" "$SEED"
+done | xargs -P "$CORPUS_JOBS" -L 1 bash -c 'process_program "$@"' _
+
+LABELLED=$(find "$CORPUS_DIR/branch_periodicity" -type f -name "gen_*_branch_periodicity.txt" | wc -l)
+echo "$LABELLED programs labelled"
+
+echo "Merging edge features into $CORPUS_DIR/edge_features..."
+python3 -c "
+import sys
+from combine_properties import merge_features_for_corpus
+d = sys.argv[1]
+merge_features_for_corpus(ll_dir=d + '/llvm', cf_dir=d + '/control_flow_features',
+                          bh_dir=d + '/branch_history_logs', output_dir=d + '/edge_features',
+                          label_dir=d + '/branch_labels', corr_dir=d + '/branch_correlations',
+                          markov_dir=d + '/branch_markov', periodicity_dir=d + '/branch_periodicity')
+" "$CORPUS_DIR" > "$CORPUS_DIR/logs/combine_properties.log" 2>&1
+
+if [ $? -ne 0 ]; then
+    echo "Merging failed (see $CORPUS_DIR/logs/combine_properties.log)"
+    exit 1
+fi
+
+echo "Done: $LABELLED labelled programs in $CORPUS_DIR"
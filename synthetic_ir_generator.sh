@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# Writes a synthetic LLVM module (see SyntheticIRGenerator.cpp), e.g.
+#   ./synthetic_ir_generator.sh --functions 8 --instructions 100000 --switch-cases 1000 big.ll
+# Arguments are passed to SyntheticIRGenerator.
+
+LLVM_DIR="/usr/local/llvm-10"
+
+echo "Compiling SyntheticIRGenerator..."
+$LLVM_DIR/bin/clang++ -std=c++17 -O2 -o SyntheticIRGenerator SyntheticIRGenerator.cpp \
+    $(/usr/local/llvm-10/bin/llvm-config --cxxflags --ldflags --libs core support --system-libs) \
+    -Wl,-rpath,/usr/local/llvm-10/lib
+
+if [ $? -ne 0 ]; then
+    echo "Compilation of SyntheticIRGenerator failed"
+    exit 1
+fi
+
+./SyntheticIRGenerator "$@"